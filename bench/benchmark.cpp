@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "frameScaler.hpp"
+
+// Version of the layout of the JSON report. Increase it whenever a key is
+// added, removed or renamed.
+#define BENCH_SCHEMA 3
+
+// Number of times each measurement is repeated. The fastest repetition is
+// reported, which is the least affected by the noise of the machine.
+#define BENCH_REPETITIONS 5
+
+// Number of instructions executed in each repetition of an opcode family.
+#define BENCH_INSTRUCTIONS 2000000
+
+// Number of cycles executed in each repetition of a program.
+#define BENCH_CYCLES 1000000
+
+// Max number of times a program that fails is loaded again in each
+// repetition.
+#define BENCH_RELOADS 1000
+
+// Number of calls in each repetition of a latency measurement.
+#define BENCH_CALLS 2000
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// An opcode family, with the instructions executed to measure it. The
+// instructions are executed one after the other, so a family that changes
+// the stack uses a sequence that leaves it as it was.
+struct Family
+{
+    const char *name;
+    std::vector<unsigned short> opcodes;
+};
+
+// Returns the seconds elapsed since start
+double elapsed(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Formats a number with a fixed precision, so that reports can be compared
+// line by line
+std::string number(double value, int precision)
+{
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(precision) << value;
+    return stream.str();
+}
+
+// Formats an opcode in hexadecimal
+std::string hex(unsigned short value)
+{
+    std::ostringstream stream;
+    stream << "0x" << std::hex << std::setfill('0') << std::setw(4) << value;
+    return stream.str();
+}
+
+// Returns the nanoseconds per instruction of a family executed through
+// executeInstruction
+double measureFamily(const Family &family)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    double best = 0.0;
+    for (size_t repetition = 0; repetition < BENCH_REPETITIONS; repetition++)
+    {
+        // Keep I pointing to memory the loads and stores can use
+        chip8.initialize();
+        chip8.seedRandom(0x5eed);
+        chip8.setI(0x300);
+
+        const size_t rounds = BENCH_INSTRUCTIONS / family.opcodes.size();
+        const Clock::time_point start = Clock::now();
+        for (size_t round = 0; round < rounds; round++)
+        {
+            for (unsigned short opcode : family.opcodes)
+            {
+                chip8.executeInstruction(opcode);
+            }
+        }
+        const double seconds = elapsed(start);
+        const double ns = seconds * 1e9 / (rounds * family.opcodes.size());
+        best = repetition == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+// Result of running a program through executeCycle.
+struct ProgramResult
+{
+    unsigned long cycles = 0;
+    bool error = false;
+    double cyclesPerSecond = 0.0;
+};
+
+// Runs a program for BENCH_CYCLES cycles through executeCycle. A program that
+// fails before is loaded again and resumed, up to BENCH_RELOADS times and
+// without counting the time spent loading it, so that the rate reflects the
+// instructions it gets to execute.
+ProgramResult measureProgram(const std::vector<unsigned char> &program)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    ProgramResult result;
+    double best = 0.0;
+    for (size_t repetition = 0; repetition < BENCH_REPETITIONS; repetition++)
+    {
+        unsigned long cycles = 0;
+        double seconds = 0.0;
+        bool error = false;
+        for (size_t load = 0; load < BENCH_RELOADS && cycles < BENCH_CYCLES;
+             load++)
+        {
+            chip8.initialize();
+            chip8.seedRandom(0x5eed);
+            chip8.loadProgram(program.data(), program.size());
+
+            unsigned long run = 0;
+            const Clock::time_point start = Clock::now();
+            while (cycles + run < BENCH_CYCLES && chip8.executeCycle() == Ok)
+            {
+                run++;
+            }
+            seconds += elapsed(start);
+            error = error || cycles + run < BENCH_CYCLES;
+
+            // A program that fails on its first instruction cannot be
+            // measured
+            if (run == 0)
+            {
+                break;
+            }
+            cycles += run;
+        }
+
+        const double rate = seconds > 0.0 ? cycles / seconds : 0.0;
+        best = std::max(best, rate);
+        result.cycles = cycles;
+        result.error = error;
+    }
+    result.cyclesPerSecond = best;
+    return result;
+}
+
+// Returns the nanoseconds per call of function
+template <typename Function>
+double measureLatency(Function function)
+{
+    double best = 0.0;
+    for (size_t repetition = 0; repetition < BENCH_REPETITIONS; repetition++)
+    {
+        const Clock::time_point start = Clock::now();
+        for (size_t call = 0; call < BENCH_CALLS; call++)
+        {
+            function();
+        }
+        const double ns = elapsed(start) * 1e9 / BENCH_CALLS;
+        best = repetition == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Usage: runbench [games directory] [output file]
+    const std::string games = argc > 1 ? argv[1] : "games";
+    const std::string output = argc > 2 ? argv[2] : "";
+
+    // Families of the instructions implemented by executeInstruction
+    const std::vector<Family> families = {
+        {"00E0", {0x00e0}},
+        {"2nnn/00EE", {0x2300, 0x00ee}},
+        {"1nnn", {0x1200}},
+        {"3xkk", {0x3a12}},
+        {"4xkk", {0x4a12}},
+        {"5xy0", {0x5ab0}},
+        {"6xkk", {0x6a12}},
+        {"7xkk", {0x7a12}},
+        {"8xy0", {0x8ab0}},
+        {"8xy1", {0x8ab1}},
+        {"8xy2", {0x8ab2}},
+        {"8xy3", {0x8ab3}},
+        {"8xy4", {0x8ab4}},
+        {"8xy5", {0x8ab5}},
+        {"8xy6", {0x8ab6}},
+        {"8xy7", {0x8ab7}},
+        {"8xyE", {0x8abe}},
+        {"Annn", {0xa300}},
+        {"Bnnn", {0xb200}},
+        {"Cxkk", {0xca12}},
+        {"Dxyn", {0xdab8}},
+        {"Fx07", {0xfa07}},
+        {"Fx15", {0xfa15}},
+        {"Fx18", {0xfa18}},
+        {"Fx1E", {0xfa1e}},
+        {"Fx29", {0xfa29}},
+        {"Fx33", {0xfa33}},
+        {"Fx55", {0xff55}},
+        {"Fx65", {0xff65}},
+    };
+
+    // Programs in the games directory, in a stable order
+    std::vector<std::string> roms;
+    for (const auto &entry : std::filesystem::directory_iterator(games))
+    {
+        if (entry.is_regular_file())
+        {
+            roms.push_back(entry.path().string());
+        }
+    }
+    std::sort(roms.begin(), roms.end());
+    if (roms.empty())
+    {
+        std::cout << "Error: there are no programs in " << games << std::endl;
+        return -1;
+    }
+
+    std::ostringstream report;
+    report << "{" << std::endl;
+    report << "  \"schema\": " << BENCH_SCHEMA << "," << std::endl;
+
+    report << "  \"opcodes\": [" << std::endl;
+    for (size_t index = 0; index < families.size(); index++)
+    {
+        const Family &family = families[index];
+        report << "    {\"family\": \"" << family.name << "\", \"opcode\": \""
+               << hex(family.opcodes[0]) << "\", \"nsPerInstruction\": "
+               << number(measureFamily(family), 3) << "}"
+               << (index + 1 < families.size() ? "," : "") << std::endl;
+    }
+    report << "  ]," << std::endl;
+
+    report << "  \"roms\": [" << std::endl;
+    for (size_t index = 0; index < roms.size(); index++)
+    {
+        std::ifstream file(roms[index], std::ios::binary);
+        const std::vector<unsigned char> program(
+            (std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+        const ProgramResult result = measureProgram(program);
+        report << "    {\"rom\": \""
+               << std::filesystem::path(roms[index]).filename().string()
+               << "\", \"cycles\": " << result.cycles << ", \"error\": "
+               << (result.error ? "true" : "false")
+               << ", \"cyclesPerSecond\": "
+               << number(result.cyclesPerSecond, 0) << "}"
+               << (index + 1 < roms.size() ? "," : "") << std::endl;
+    }
+    report << "  ]," << std::endl;
+
+    // Latency of preparing an interpreter, with the first program available
+    Chip8 chip8;
+    chip8.setLogging(false);
+    std::ifstream file(roms[0], std::ios::binary);
+    const std::vector<unsigned char> program(
+        (std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+    report << "  \"latency\": {" << std::endl;
+    report << "    \"initializeNs\": "
+           << number(measureLatency([&chip8]() { chip8.initialize(); }), 1)
+           << "," << std::endl;
+    report << "    \"loadProgramFileNs\": "
+           << number(measureLatency([&chip8, &roms]()
+                                    { chip8.loadProgram(roms[0]); }),
+                     1)
+           << "," << std::endl;
+    report << "    \"loadProgramBufferNs\": "
+           << number(measureLatency(
+                         [&chip8, &program]()
+                         { chip8.loadProgram(program.data(), program.size()); }),
+                     1)
+           << "," << std::endl;
+    std::vector<unsigned char> state(Chip8::getStateSize());
+    report << "    \"saveStateNs\": "
+           << number(measureLatency([&chip8, &state]()
+                                    { chip8.saveState(state.data(), state.size()); }),
+                     1)
+           << "," << std::endl;
+    report << "    \"loadStateNs\": "
+           << number(measureLatency([&chip8, &state]()
+                                    { chip8.loadState(state.data(), state.size()); }),
+                     1)
+           << std::endl;
+    report << "  }," << std::endl;
+
+    // Time to expand a frame into pixels, with the display of the first
+    // program after it has run for a while
+    chip8.initialize();
+    chip8.loadProgram(program.data(), program.size());
+    chip8.runCycles(BENCH_CYCLES / 10);
+    FrameScaler scaler(10);
+    std::vector<uint32_t> pixels(scaler.getWidth(chip8) *
+                                 scaler.getHeight(chip8));
+    auto expand = [&scaler, &chip8, &pixels]()
+    { scaler.expand(chip8, pixels.data()); };
+    report << "  \"scaler\": {" << std::endl;
+    report << "    \"vectorNsPerFrame\": " << number(measureLatency(expand), 1)
+           << "," << std::endl;
+    scaler.setKernel(ScalarKernel);
+    report << "    \"scalarNsPerFrame\": " << number(measureLatency(expand), 1)
+           << "," << std::endl;
+    scaler.setKernel(VectorKernel);
+    scaler.setDecay(192);
+    report << "    \"decayNsPerFrame\": " << number(measureLatency(expand), 1)
+           << "," << std::endl;
+    scaler.setDecay(0);
+    scaler.setScale(5);
+    Chip8 extended;
+    extended.setLogging(false);
+    extended.setExtended(true);
+    extended.initialize();
+    extended.executeInstruction(0x00ff);
+    auto expandExtended = [&scaler, &extended, &pixels]()
+    { scaler.expand(extended, pixels.data()); };
+    report << "    \"extendedNsPerFrame\": "
+           << number(measureLatency(expandExtended), 1) << std::endl;
+    report << "  }" << std::endl;
+    report << "}" << std::endl;
+
+    if (output.empty())
+    {
+        std::cout << report.str();
+        return 0;
+    }
+    std::ofstream outputFile(output);
+    if (!outputFile.is_open())
+    {
+        std::cout << "Error opening file " << output << std::endl;
+        return -1;
+    }
+    outputFile << report.str();
+    return 0;
+}
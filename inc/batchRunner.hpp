@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "quirks.hpp"
+
+// Outcome of running one program in a batch.
+struct BatchResult
+{
+    // Path of the program file.
+    std::string rom;
+
+    // Hash of the state of the interpreter when the run stopped.
+    uint64_t stateHash = 0;
+
+    // Number of cycles executed successfully.
+    unsigned long cycles = 0;
+
+    // Number of frames emulated, when the batch runs for a number of frames.
+    unsigned long frames = 0;
+
+    // Ok if the program could be loaded, or the error that prevented it
+    // otherwise.
+    ErrorCode error = Ok;
+
+    // BudgetExhausted if the program ran for all the cycles requested, or
+    // the reason it stopped before otherwise.
+    StopReason reason = BudgetExhausted;
+
+    // Value of the PC when the run stopped.
+    unsigned short pc = 0;
+
+    // Wall time spent loading and running the program, in seconds.
+    double seconds = 0.0;
+};
+
+// This class runs a list of programs headless, each one on its own
+// interpreter, spread across a pool of worker threads.
+class BatchRunner
+{
+public:
+    // Adds a program file, or all the files inside a directory, to the batch.
+    // Returns FileOpenError, without printing anything, if the path is not
+    // a file or a directory.
+    ErrorCode addPath(const std::string &path);
+
+    // Sets the number of cycles each program runs for.
+    inline void setCycles(unsigned long value) { cycles = value; }
+
+    // Sets the number of frames each program runs for, with the timers
+    // counting down once per frame, instead of a number of cycles. Zero runs
+    // for the number of cycles.
+    inline void setFrames(unsigned long value) { frames = value; }
+
+    // Sets the number of worker threads. Zero uses one per hardware thread.
+    inline void setThreads(unsigned int value) { threads = value; }
+
+    // Sets the seed the random generator of each program is derived from, so
+    // that a batch can be reproduced regardless of the number of threads.
+    inline void setSeed(uint64_t value) { seed = value; }
+
+    // Sets the quirk set each program runs with.
+    inline void setQuirkConfig(const QuirkConfig &config)
+    {
+        quirkConfig = config;
+    }
+
+    // Runs all the programs and returns their results, in the order the
+    // programs were added.
+    const std::vector<BatchResult> &run();
+
+    // Writes the results of the last run as CSV, one line per program.
+    void writeResults(std::ostream &output) const;
+
+private:
+    // Loads and runs the program in result.rom on the provided interpreter.
+    void runProgram(Chip8 &chip8, BatchResult &result) const;
+
+    // Paths of the programs in the batch.
+    std::vector<std::string> roms;
+
+    // Results of the last run.
+    std::vector<BatchResult> results;
+
+    // Number of cycles or frames each program runs for.
+    unsigned long cycles = 1000000;
+    unsigned long frames = 0;
+
+    // Number of worker threads, zero for one per hardware thread.
+    unsigned int threads = 0;
+
+    // Seed of the batch.
+    uint64_t seed = 0;
+
+    // Quirk set of each program.
+    QuirkConfig quirkConfig;
+};
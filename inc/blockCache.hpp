@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "chip8.hpp"
+
+// A straight-line sequence of instructions, ending at the first instruction
+// that may jump, call, skip or return. The instructions are kept decoded, so
+// that executing the block is a walk through their handlers.
+struct BasicBlock
+{
+    // Decoded instructions of the block, in execution order.
+    std::vector<Chip8::Instruction> instructions;
+
+    // First address of memory after the block.
+    unsigned short end = 0;
+
+    // False while the block has to be compiled, either because it never was
+    // or because the memory it was compiled from has been written.
+    bool valid = false;
+};
+
+// Counters kept by the basic block cache.
+struct BlockStatistics
+{
+    // Number of blocks executed.
+    unsigned long executed = 0;
+
+    // Number of instructions executed inside blocks.
+    unsigned long instructions = 0;
+
+    // Number of blocks compiled, including the ones compiled again.
+    unsigned long compiled = 0;
+
+    // Number of compiled blocks thrown away because their memory was written.
+    unsigned long invalidated = 0;
+
+    // Returns the fraction of the compiled blocks that were thrown away
+    inline double invalidationRate() const
+    {
+        return compiled > 0 ? static_cast<double>(invalidated) / compiled : 0.0;
+    }
+};
+
+// This class keeps the basic blocks compiled from the memory of a Chip8,
+// indexed by the address where they start.
+class BlockCache
+{
+public:
+    // Returns the block starting at address, compiling it from the memory of
+    // the interpreter if it is not valid.
+    const BasicBlock &getBlock(const Chip8 &chip8, unsigned short address);
+
+    // Throws away the blocks that overlap the count bytes of memory starting
+    // at index.
+    void invalidate(unsigned short index, unsigned short count);
+
+    // Counts the execution of a block that ran the given number of
+    // instructions
+    inline void countExecution(unsigned long instructions)
+    {
+        statistics.executed++;
+        statistics.instructions += instructions;
+    }
+
+    // Returns the counters of the cache
+    inline const BlockStatistics &getStatistics() const
+    {
+        return statistics;
+    }
+
+private:
+    // Compiles the block starting at address.
+    void compile(const Chip8 &chip8, unsigned short address, BasicBlock &block);
+
+    // Blocks indexed by their starting address.
+    std::array<BasicBlock, NUM_BYTES_MEMORY> blocks;
+
+    // Counters of the cache.
+    BlockStatistics statistics;
+};
@@ -1,7 +1,17 @@
 #pragma once
 
 #include <array>
+#include <bitset>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <vector>
+
+#include "pagedMemory.hpp"
+#include "random.hpp"
 
 // Define some error codes that the interpreter can return to main
 // and can use internally.
@@ -10,7 +20,60 @@ enum ErrorCode
     Ok,
     Error,
     FileOpenError,
-    NotEnoughMemory
+    NotEnoughMemory,
+    UnknownOpcodeError,
+    StackOverflowError,
+    StackUnderflowError,
+    // Fx0A found no key pressed, and has to be executed again
+    KeyWaitPending,
+    InvalidState
+};
+
+// Reasons for runCycles and runUntil to return.
+enum StopReason
+{
+    BudgetExhausted,
+    UnknownOpcode,
+    StackOverflow,
+    StackUnderflow,
+    WaitingOnKey,
+    Breakpoint,
+    ConditionMet
+};
+
+// Behaviours of some instructions that differ between the platforms Chip 8
+// programs were written for, as flags that combine into a quirk set. The
+// empty set keeps the behaviour this interpreter always had.
+enum Quirk : unsigned char
+{
+    // 8xy6 and 8xyE shift Vy into Vx, instead of shifting Vx in place
+    ShiftVyQuirk = 0x1,
+    // Fx55 and Fx65 leave I past the last register they store or read
+    IncrementIQuirk = 0x2,
+    // Bxnn jumps to xnn + Vx, instead of nnn + V0
+    JumpVxQuirk = 0x4,
+    // 8xy1, 8xy2 and 8xy3 clear VF
+    ResetVfQuirk = 0x8
+};
+
+// Number of different quirk sets.
+#define NUM_QUIRK_SETS 16
+
+// Quirk sets of the original COSMAC VIP interpreter and of SCHIP.
+#define COSMAC_QUIRKS (ShiftVyQuirk | IncrementIQuirk | ResetVfQuirk)
+#define SCHIP_QUIRKS JumpVxQuirk
+
+// Number of handler sets: one per quirk set in the classic mode, followed by
+// one per quirk set in the extended mode, whose handler sets have this bit.
+#define NUM_HANDLER_SETS (2 * NUM_QUIRK_SETS)
+#define EXTENDED_HANDLER_SET NUM_QUIRK_SETS
+
+// Outcome of runCycles and runUntil: why they returned, and the number of
+// instructions they executed.
+struct RunResult
+{
+    StopReason reason;
+    unsigned long cycles;
 };
 
 // Number of bytes in RAM memory
@@ -23,29 +86,445 @@ enum ErrorCode
 // Number of general purpose registers.
 #define NUM_REGISTERS 16
 
+static_assert(NUM_BYTES_MEMORY == NUM_MEMORY_PAGES * MEMORY_PAGE_SIZE,
+              "the pages of memory cover all of it");
+
 // Max number of adresses in the stack.
 #define SIZE_STACK 16
 
+// Number of keys of the keypad, 0 to F.
+#define NUM_KEYS 16
+
+// Number of frames per second. The timers are decremented once per frame.
+#define FRAME_RATE 60
+
+// Number of instructions executed in each frame unless configured otherwise,
+// which makes the interpreter run at 600 instructions per second.
+#define DEFAULT_INSTRUCTIONS_PER_FRAME 10
+
+// Width and height of the display, in pixels.
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+
+// Mask with one bit set per row of the display.
+#define ALL_DISPLAY_ROWS 0xffffffffu
+
+// Width and height of the display in the extended mode of SCHIP and XO-CHIP,
+// in pixels, and number of bit planes it is made of.
+#define EXTENDED_DISPLAY_WIDTH 128
+#define EXTENDED_DISPLAY_HEIGHT 64
+#define NUM_PLANES 4
+
+// Number of bytes of memory addressable by I in the extended mode.
+#define EXTENDED_MEMORY_SIZE 65536
+
+// Address of memory where the font is placed, and number of bytes of the
+// sprite of each of its characters.
+#define FONT_START 0x050
+#define FONT_CHARACTER_SIZE 5
+
+// Address of memory where the large font of the extended mode is placed, and
+// number of bytes of each of its characters.
+#define LARGE_FONT_START 0x0a0
+#define LARGE_FONT_CHARACTER_SIZE 10
+
+// Number of entries in the instruction dispatch table.
+#define DISPATCH_TABLE_SIZE 811
+
+// Max number of instructions in a basic block.
+#define MAX_BLOCK_LENGTH 32
+
+// A row of 128 pixels of a plane of the extended display, as two words. The
+// leftmost 64 pixels are in the first word, with the leftmost pixel in its
+// most significant bit. The compiler keeps a row in a vector register, so
+// that a row is drawn, masked and scrolled with a few vector operations.
+typedef uint64_t PlaneRow __attribute__((vector_size(16)));
+
+class BlockCache;
+class FrameCapture;
+class JitCompiler;
+class LockstepEngine;
+class Profiler;
+class QuirkConfig;
+struct BlockStatistics;
+
 // Definition of the interpreter's class
 class Chip8
 {
 
 public:
-    Chip8() = default;
-    ~Chip8() = default;
+    Chip8();
+    ~Chip8();
 
     // Initializes the memory and registers in the CPU.
     ErrorCode initialize();
 
+    // Seeds the generator used by RND, so that a run can be reproduced.
+    // initialize() seeds it from the random device of the system.
+    void seedRandom(uint64_t seed);
+
     // Loads the selected program into memory.
     ErrorCode loadProgram(const std::string &filename);
 
+    // Loads a program that is already in memory, without the debug dump.
+    ErrorCode loadProgram(const unsigned char *program, size_t size);
+
+    // Loads the selected program into memory, and selects the quirk set the
+    // configuration has for it.
+    ErrorCode loadProgram(const std::string &filename,
+                          const QuirkConfig &config);
+
+    // Selects the quirk set, which decides how the instructions that differ
+    // between platforms behave. Every set has its own handler table, built
+    // at compile time from handlers specialized for it, so that running a
+    // program costs the same whichever set it uses. The cached code is
+    // dropped, as it was decoded for the previous set. It is kept by
+    // initialize(), and the empty set is used until it is selected.
+    void setQuirks(unsigned char quirks);
+
+    // Returns the quirk set in use.
+    inline unsigned char getQuirks() const { return quirks; }
+
+    // Enables or disables the extended mode of SCHIP and XO-CHIP programs: a
+    // display of 128x64 pixels in up to four planes, with a low resolution
+    // mode where each pixel is 2x2, the instructions of SCHIP and XO-CHIP,
+    // and 64 KB of memory addressable by I. Jumps and calls only reach the
+    // first 4 KB, so code runs from them and the rest holds data. The JIT
+    // is bypassed and saved states are not available while it is enabled.
+    // It is kept by initialize(), and has to be enabled before loading a
+    // program bigger than the classic memory. Enabling it clears the
+    // extended display and memory, and loads the large font.
+    void setExtended(bool enabled);
+
+    // Returns true if the extended mode is enabled.
+    inline bool isExtended() const { return extended != nullptr; }
+
+    // Returns the handler set decode() selects the handlers from, which
+    // follows the quirk set and the extended mode.
+    inline unsigned char getHandlerSet() const
+    {
+        return quirks | (extended != nullptr ? EXTENDED_HANDLER_SET : 0);
+    }
+
+    // Enables or disables the error and debug messages printed to the
+    // standard output. They are enabled by default.
+    void setLogging(bool enabled) { logging = enabled; }
+
+    // Returns a hash of the memory, registers, timers and stack, so that the
+    // final states of two runs can be compared cheaply.
+    uint64_t hashState() const;
+
+    // Makes this interpreter a copy of source: its memory, registers, stack,
+    // timers, display, keys, random generator, frame counter, quirk set and
+    // extended mode. The pages of memory are shared until either interpreter
+    // writes to them, so that forking costs a copy of the page table and
+    // allocates nothing. The cached code of the pages that were already
+    // shared is kept, unless the handler set changes. The extended display
+    // and memory are copied whole.
+    void forkFrom(const Chip8 &source);
+
+    // Returns the number of pages of memory only this interpreter holds.
+    inline size_t getPrivatePages() const
+    {
+        return memory.getPrivatePages();
+    }
+
+    // Returns the size in bytes of a saved state.
+    static size_t getStateSize();
+
+    // Saves the memory, registers, stack, timers, keys, display, random
+    // generator, frame counter and quirk set into buffer, which must hold
+    // getStateSize() bytes. The state is versioned and checksummed, and only
+    // meant to be loaded on a machine with the same byte order. The extended
+    // mode cannot be saved, and returns Error.
+    ErrorCode saveState(unsigned char *buffer, size_t size) const;
+
+    // Saves the state into a new buffer, which is empty if it cannot be
+    // saved, or into a file.
+    std::vector<unsigned char> saveState() const;
+    ErrorCode saveState(const std::string &filename) const;
+
+    // Restores a state saved by saveState, returning InvalidState without
+    // changing anything if it is not one, and Error in the extended mode.
+    ErrorCode loadState(const unsigned char *buffer, size_t size);
+
+    // Restores a state from a file, which is mapped into memory instead of
+    // read.
+    ErrorCode loadState(const std::string &filename);
+
     // Emulates a cycle in the CPU.
     ErrorCode executeCycle();
 
     // Executes the provided instruction.
     ErrorCode executeInstruction(const unsigned short &instruction);
 
+    // Executes up to count instructions without returning to the caller in
+    // between, and returns why it stopped. An instruction that fails or waits
+    // on a key is not counted, and a breakpoint stops the run before the
+    // instruction at its address unless it is the first one of the run.
+    RunResult runCycles(unsigned long count);
+
+    // Executes instructions like runCycles until predicate returns true for
+    // the state of the interpreter, which is checked before each of them,
+    // or until budget instructions have been executed.
+    template <typename Predicate>
+    RunResult runUntil(Predicate predicate, unsigned long budget = ULONG_MAX)
+    {
+        RunResult result = {BudgetExhausted, 0};
+        while (result.cycles < budget)
+        {
+            if (predicate(static_cast<const Chip8 &>(*this)))
+            {
+                result.reason = ConditionMet;
+                return result;
+            }
+            if (result.cycles > 0 &&
+                breakpoints[registers.pc % NUM_BYTES_MEMORY])
+            {
+                result.reason = Breakpoint;
+                return result;
+            }
+            const ErrorCode error = step();
+            if (error != Ok)
+            {
+                result.reason = toStopReason(error);
+                return result;
+            }
+            result.cycles++;
+        }
+        return result;
+    }
+
+    // Sets or clears a breakpoint at an address, which stops runCycles and
+    // runUntil.
+    inline void setBreakpoint(unsigned short address, bool enabled = true)
+    {
+        breakpoints[address % NUM_BYTES_MEMORY] = enabled;
+    }
+
+    // Clears all the breakpoints.
+    inline void clearBreakpoints()
+    {
+        breakpoints.reset();
+    }
+
+    // Enables or disables skipping the iterations of idle loops that spin
+    // on the delay timer or on a key, which cannot change until runCycles
+    // returns. The interpreter ends in the same state either way. It is
+    // enabled by default, and never skips while profiling.
+    inline void setIdleSkipping(bool enabled) { idleSkipping = enabled; }
+
+    // Returns the number of instructions runCycles skipped in idle loops
+    // since the interpreter was initialized. They are counted as executed.
+    inline unsigned long getElidedCycles() const { return elidedCycles; }
+
+    // Presses or releases a key of the keypad.
+    inline void setKey(unsigned char key, bool pressed)
+    {
+        const uint16_t bit = 0x1 << (key % NUM_KEYS);
+        registers.keys = pressed ? registers.keys | bit : registers.keys & ~bit;
+    }
+
+    // Sets all the keys of the keypad at once, one bit per key.
+    inline void setKeys(uint16_t pressed)
+    {
+        registers.keys = pressed;
+    }
+
+    // Returns the keys of the keypad that are pressed, one bit per key.
+    inline uint16_t getKeys() const
+    {
+        return registers.keys;
+    }
+
+    // Returns true if a key of the keypad is pressed.
+    inline bool isKeyPressed(unsigned char key) const
+    {
+        return (registers.keys >> (key % NUM_KEYS) & 0x1) != 0;
+    }
+
+    // Emulates a frame: executes the instructions of a frame and then
+    // decrements the timers once. In real time mode, it also waits until the
+    // time of the frame is over. If run is provided, the instructions
+    // executed are added to its cycles, and its reason is set to the one the
+    // frame stopped for.
+    ErrorCode runFrame(RunResult *run = nullptr);
+
+    // Emulates the given number of frames, stopping at the first error, and
+    // updates run as runFrame does.
+    ErrorCode runFrames(unsigned long count, RunResult *run = nullptr);
+
+    // Decrements the delay and sound timers that are not zero yet, count
+    // times. It costs the same whatever the count, as the timers are only
+    // worked out when they are read.
+    inline void tickTimers(unsigned long count = 1)
+    {
+        registers.ticks += count;
+    }
+
+    // Sets the number of instructions executed in each frame.
+    inline void setInstructionsPerFrame(unsigned int instructions)
+    {
+        instructionsPerFrame = instructions;
+    }
+
+    // Returns the number of instructions executed in each frame.
+    inline unsigned int getInstructionsPerFrame() const
+    {
+        return instructionsPerFrame;
+    }
+
+    // Enables or disables the real time mode, in which frames are paced at
+    // FRAME_RATE. Frames run as fast as possible otherwise.
+    void setRealTime(bool enabled);
+
+    // Attaches a capture, which runFrame hands the display to at the end of
+    // every frame, or detaches it when capture is nullptr. The capture must
+    // outlive the interpreter or be detached first.
+    inline void setCapture(FrameCapture *capture) { this->capture = capture; }
+
+    // Returns the number of frames emulated since the interpreter was
+    // initialized.
+    inline unsigned long getFrames() const
+    {
+        return frames;
+    }
+
+    // The state read and written by almost every instruction: the
+    // registers, the timers, the stack and the keypad. It fills two cache
+    // lines of its own, apart from the memory, and is trivially copyable
+    // without any padding, so that it is cleared, copied and saved as a
+    // single block.
+    struct alignas(64) Registers
+    {
+        // Chip 8 has 16 general purpose 8 bit registers, named Vx.
+        std::array<unsigned char, NUM_REGISTERS> v;
+
+        // Delay and sound timers, kept as the number of ticks of the timers
+        // so far and the tick each of them reaches zero at. A tick only
+        // counts itself, and Fx15 and Fx18 set the tick a timer ends at.
+        uint64_t ticks;
+        uint64_t delayEnd;
+        uint64_t soundEnd;
+
+        // The stack is an array of values used to store addresses that the
+        // interpreter should return to after finishing the execution of a
+        // subroutine. Only 16 levels in the stack are allowed, so only 16
+        // subroutines can be nested at once.
+        std::array<unsigned short, SIZE_STACK> stack;
+
+        // Rows of the display changed by DRW or CLS since they were last
+        // taken.
+        uint32_t dirtyRows;
+
+        // I register, usually used to store memory addresses, so normally
+        // only the lowest 12 bits of it are going to be used.
+        unsigned short i;
+
+        // The Program Counter or PC is used to store the address that
+        // is currently being executed.
+        unsigned short pc;
+
+        // Keys of the keypad that are pressed, one bit per key.
+        uint16_t keys;
+
+        // The Stack Pointer or SP always points to the top of the stack.
+        unsigned char sp;
+
+        // Unused, and kept at zero.
+        std::array<unsigned char, 45> reserved;
+    };
+
+    // An instruction split into the fields the handlers operate on, together
+    // with the handler that implements it.
+    struct Instruction;
+    using InstructionHandler = ErrorCode (*)(Chip8 &, const Instruction &);
+    struct Instruction
+    {
+        InstructionHandler handler;
+        unsigned short opcode;
+        unsigned short nnn;
+        unsigned char x;
+        unsigned char y;
+        unsigned char n;
+        unsigned char kk;
+    };
+
+    // Decodes an opcode, selecting its handler from the given handler set
+    // through the dispatch tables. A quirk set is the handler set of the
+    // classic mode with those quirks.
+    static Instruction decode(unsigned short opcode, unsigned char handlerSet);
+
+    // Returns true if the instruction may continue anywhere other than at
+    // the next instruction, so that it has to end a basic block.
+    static bool endsBlock(const Instruction &instruction);
+
+    // Enables or disables the predecoded instruction cache. When enabled,
+    // every address of memory keeps the decoded form of the instruction
+    // starting there, so that executeCycle only decodes it the first time.
+    void setPredecode(bool enabled);
+
+    // Returns true if the predecoded instruction cache is enabled
+    inline bool isPredecodeEnabled() const
+    {
+        return decoded != nullptr;
+    }
+
+    // Enables or disables the basic block cache. When enabled, executeBlock
+    // runs a whole straight-line sequence of instructions per call.
+    void setBlockCache(bool enabled);
+
+    // Returns true if the basic block cache is enabled
+    inline bool isBlockCacheEnabled() const
+    {
+        return blocks != nullptr;
+    }
+
+    // Executes the basic block starting at the program counter, compiling
+    // it first if it is not in the cache. When the cache is disabled it
+    // executes a single cycle.
+    ErrorCode executeBlock();
+
+    // Returns the counters of the basic block cache, all of them zero when
+    // it is disabled.
+    BlockStatistics getBlockStatistics() const;
+
+    // Enables or disables the translation of basic blocks to native x86-64
+    // code. The JIT is only available when built with JIT=1, and enabling
+    // it fails otherwise or if no executable memory can be mapped.
+    ErrorCode setJit(bool enabled);
+
+    // Returns true if the JIT is enabled
+    bool isJitEnabled() const;
+
+    // Executes the basic block starting at the program counter as native
+    // code, translating it first if needed. When the JIT is disabled it
+    // executes the block through the basic block cache instead.
+    ErrorCode executeJit();
+
+    // Returns the counters of the JIT, all of them zero when it is disabled.
+    BlockStatistics getJitStatistics() const;
+
+    // Enables or disables the profiler, which counts the instructions
+    // executed by executeCycle and executeBlock by opcode class, by address
+    // and by depth of the stack. The JIT is bypassed while it is enabled.
+    // The profiler is only available when built with PROFILE=1, and enabling
+    // it fails otherwise.
+    ErrorCode setProfiling(bool enabled);
+
+    // Returns true if the profiler is enabled
+    inline bool isProfilingEnabled() const
+    {
+#ifdef CHIP8_PROFILE
+        return profiler != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // Returns the counters of the profiler, or nullptr when it is disabled.
+    const Profiler *getProfiler() const;
+
     // Writes an instruction into memory, starting at memoryIndex with the most
     // significant byte
     ErrorCode setInstructionInMemory(unsigned short memoryIndex,
@@ -55,7 +534,8 @@ public:
     // so this function should not be used to set a complete instruction
     inline void setMemory(const unsigned short index, const unsigned char value)
     {
-        memory[index] = value;
+        memory.write(index, value);
+        invalidateCode(index, 1);
     }
 
     // Get a byte from memory
@@ -67,114 +547,468 @@ public:
     // Sets a value to the register selected
     inline void setRegister(unsigned char regIndex, unsigned char regValue)
     {
-        v[regIndex] = regValue;
+        registers.v[regIndex] = regValue;
     }
 
     // Returns the value stored at a register
     inline unsigned char getRegister(unsigned char regIndex) const
     {
-        return v[regIndex];
+        return registers.v[regIndex];
     }
 
     // Sets the program counter
     inline void setPc(unsigned short inPc)
     {
-        pc = inPc;
+        registers.pc = inPc;
     }
 
     // Returns the current value of the program counter
     inline unsigned short getPc() const
     {
-        return pc;
+        return registers.pc;
     }
 
     // Sets the value of the stack pointer
     inline void setStackPointer(const unsigned char inSp)
     {
-        sp = inSp;
+        registers.sp = inSp;
     }
 
     // Gets the value of the stack pointer
     inline unsigned char getStackPointer() const
     {
-        return sp;
+        return registers.sp;
     }
 
     // Sets the complete stack
     inline void setStack(const std::array<unsigned short, SIZE_STACK> &inStack)
     {
-        stack = inStack;
+        registers.stack = inStack;
     }
 
     // Returns a reference to the complete stack
     inline const std::array<unsigned short, SIZE_STACK> &getStack() const
     {
-        return stack;
+        return registers.stack;
     }
 
     // Sets the I register
     inline void setI(const unsigned short inI)
     {
-        i = inI;
+        registers.i = inI;
     }
 
     // Returns the current value of the I register
     inline unsigned short getI() const
     {
-        return i;
+        return registers.i;
     }
 
     // Sets the delay timer register
     inline void setDelayTimer(const unsigned char inDtr)
     {
-        dtr = inDtr;
+        registers.delayEnd = registers.ticks + inDtr;
     }
 
     // Returns the value of the delay timer register
     inline unsigned char getDelayTimer() const
     {
-        return dtr;
+        return registers.delayEnd > registers.ticks
+                   ? registers.delayEnd - registers.ticks
+                   : 0;
     }
 
     // Sets the sound timer register
     inline void setSoundTimer(const unsigned char inStr)
     {
-        str = inStr;
+        registers.soundEnd = registers.ticks + inStr;
     }
 
     // Returns the value of the sound timer register
     inline unsigned char getSoundTimer() const
     {
-        return str;
+        return registers.soundEnd > registers.ticks
+                   ? registers.soundEnd - registers.ticks
+                   : 0;
     }
 
-private:
-    // The RAM memory.
-    std::array<unsigned char, NUM_BYTES_MEMORY> memory;
+    // Returns a row of the display, with the leftmost pixel in the most
+    // significant bit
+    inline uint64_t getDisplayRow(unsigned char row) const
+    {
+        return display[row];
+    }
+
+    // Returns the whole display, one row per word
+    inline const std::array<uint64_t, DISPLAY_HEIGHT> &getDisplay() const
+    {
+        return display;
+    }
+
+    // Returns true if the pixel at column x and row y is set
+    inline bool getPixel(unsigned char x, unsigned char y) const
+    {
+        return (display[y] >> (DISPLAY_WIDTH - 1 - x) & 0x1) != 0;
+    }
+
+    // Returns true if the extended display is in its high resolution mode.
+    inline bool isHighResolution() const
+    {
+        return extended != nullptr && extended->highResolution;
+    }
 
-    // Chip 8 has 16 general purpose 8 bit registers, named Vx.
-    std::array<unsigned char, NUM_REGISTERS> v;
+    // Returns the planes Dxyn, 00E0 and the scrolls act on in the extended
+    // mode, one bit per plane.
+    inline unsigned char getSelectedPlanes() const
+    {
+        return extended != nullptr ? extended->selectedPlanes : 0;
+    }
 
-    // I register, usually used to store memory addresses, so normally only
-    // the lowest 12 bits of it are going to be used.
-    unsigned short i;
+    // Returns a row of a plane of the extended display, which is only
+    // available in the extended mode. A pixel of the low resolution mode is
+    // drawn as 2x2 pixels.
+    inline PlaneRow getPlaneRow(unsigned char plane, unsigned char row) const
+    {
+        return extended->planes[plane % NUM_PLANES]
+                               [row % EXTENDED_DISPLAY_HEIGHT];
+    }
+
+    // Returns the pixel at column x and row y of the extended display, with
+    // one bit per plane, which is only available in the extended mode
+    inline unsigned char getPlanePixel(unsigned char x, unsigned char y) const
+    {
+        unsigned char pixel = 0;
+        for (unsigned char plane = 0; plane < NUM_PLANES; plane++)
+        {
+            const PlaneRow row = getPlaneRow(plane, y);
+            pixel |= (row[x / 64 % 2] >> (63 - x % 64) & 0x1) << plane;
+        }
+        return pixel;
+    }
 
-    // Delay timer register.
-    unsigned char dtr;
+    // Returns true if any row of the display changed since the dirty rows
+    // were last taken
+    inline bool isDisplayChanged() const
+    {
+        return registers.dirtyRows != 0;
+    }
 
-    // Sound timer register.
-    unsigned char str;
+    // Returns the rows of the display that changed since they were last
+    // taken, one bit per row with row 0 in the least significant bit. In the
+    // extended mode each bit stands for two rows of the extended display.
+    inline uint32_t getDirtyRows() const
+    {
+        return registers.dirtyRows;
+    }
 
-    // The Program Counter or PC is used to store the address that
-    // is currently being executed.
-    unsigned short pc;
+    // Returns the rows of the display that changed and clears them, so that
+    // a front end can call it once per frame and redraw only those rows
+    inline uint32_t takeDirtyRows()
+    {
+        const uint32_t rows = registers.dirtyRows;
+        registers.dirtyRows = 0;
+        return rows;
+    }
 
-    // The stack is an array of values used to store addresses that the
-    // interpreter should return to after finishing the execution of a
-    // subroutine. Only 16 levels in the stack are allowed, so only 16
-    // subroutines can be nested at once.
-    std::array<unsigned short, SIZE_STACK> stack;
+private:
+    // The JIT addresses the registers directly inside the interpreter, and
+    // the lockstep engine copies them in and out of its lanes.
+    friend class JitCompiler;
+    friend class LockstepEngine;
+
+    // Adapts a member handler to the plain function pointer stored in the
+    // dispatch tables, so that calling through the table costs one indirect
+    // call and no pointer-to-member adjustment.
+    template <ErrorCode (Chip8::*Handler)(const Instruction &)>
+    static ErrorCode dispatch(Chip8 &chip8, const Instruction &instruction)
+    {
+        return (chip8.*Handler)(instruction);
+    }
+
+    // Does the same for the instructions that skip the next one in the
+    // extended mode, where the instruction skipped may be the four bytes of
+    // F000 nnnn.
+    template <ErrorCode (Chip8::*Handler)(const Instruction &)>
+    static ErrorCode dispatchSkip(Chip8 &chip8, const Instruction &instruction)
+    {
+        const unsigned short skipped = chip8.registers.pc + 2;
+        const ErrorCode result = (chip8.*Handler)(instruction);
+        if (result == Ok && chip8.registers.pc == skipped + 2 &&
+            chip8.memory[skipped] == 0xf0 && chip8.memory[skipped + 1] == 0x00)
+        {
+            chip8.registers.pc += 2;
+        }
+        return result;
+    }
+
+    // Dispatch tables, generated at compile time. Every group of opcodes,
+    // selected by the most significant nibble, owns a slice of the handler
+    // table starting at its offset and keyed by the bits of its mask, so
+    // that the 0nnn, 8xyn, Exkk and Fxkk groups are keyed by their
+    // sub-opcode and decoding is a single lookup whatever the opcode. There
+    // is a handler table per handler set.
+    static const std::array<unsigned short, 16> groupMasks;
+    static const std::array<unsigned short, 16> groupOffsets;
+    static const std::array<std::array<InstructionHandler, DISPATCH_TABLE_SIZE>,
+                            NUM_HANDLER_SETS>
+        handlerTables;
+
+    // Builds the handler table of a handler set.
+    template <unsigned char Set>
+    static constexpr std::array<InstructionHandler, DISPATCH_TABLE_SIZE>
+    makeHandlerTable();
+
+    // Fetches, decodes and executes the next instruction, without printing
+    // anything.
+    ErrorCode step();
+
+    // Executes up to count instructions, checking the breakpoints only if
+    // there are any.
+    template <bool CheckBreakpoints>
+    RunResult run(unsigned long count);
+
+    // Returns the number of instructions of the loop starting at the PC if
+    // it busy-waits on the delay timer or on a key, and would keep doing so
+    // for as long as they do not change, or zero otherwise. The loops
+    // recognised are Fx07, 3xkk or 4xkk on Vx, and a jump back to Fx07, and
+    // Ex9E or ExA1, and a jump back to it.
+    unsigned int idleLoopLength() const;
+
+    // Skips the whole iterations of the idle loop at the PC that fit in
+    // budget instructions, and returns the number of instructions skipped.
+    unsigned long skipIdleLoop(unsigned long budget);
+
+    // Returns the reason to stop a run on an instruction that returned error.
+    static StopReason toStopReason(ErrorCode error);
+
+    // Returns the result of executing instructions as executeCycle does: Ok
+    // for an instruction waiting on a key, which is executed again on the
+    // next cycle, and Error, printing it, for any other failure.
+    ErrorCode reportResult(ErrorCode result) const;
+
+    // Drops the predecoded instructions and basic blocks that overlap the
+    // count bytes of memory starting at index, because they have just been
+    // written.
+    inline void invalidateCode(unsigned short index, unsigned short count)
+    {
+        if (decoded != nullptr)
+        {
+            invalidateDecoded(index, count);
+        }
+        if (blocks != nullptr)
+        {
+            invalidateBlocks(index, count);
+        }
+#ifdef CHIP8_JIT
+        if (jit != nullptr)
+        {
+            invalidateJit(index, count);
+        }
+#endif
+    }
+
+    // Reads and writes a byte of the memory addressable by I, which goes
+    // past the classic memory into the extended one in the extended mode.
+    inline unsigned char readData(unsigned short address) const
+    {
+        return address < NUM_BYTES_MEMORY
+                   ? memory[address]
+                   : extended->memory[address - NUM_BYTES_MEMORY];
+    }
+    inline void writeData(unsigned short address, unsigned char value)
+    {
+        if (address < NUM_BYTES_MEMORY)
+        {
+            setMemory(address, value);
+        }
+        else
+        {
+            extended->memory[address - NUM_BYTES_MEMORY] = value;
+        }
+    }
+
+    // Returns the number of bytes of the biggest program that can be loaded.
+    inline size_t getProgramCapacity() const
+    {
+        return (extended != nullptr ? EXTENDED_MEMORY_SIZE : NUM_BYTES_MEMORY) -
+               START_AVAILABLE_MEMORY;
+    }
+
+    // Copies a program that fits in memory to its start.
+    void storeProgram(const unsigned char *program, size_t size);
+
+    // Clears the extended display, memory and flags, selects the first plane
+    // and the low resolution, and loads the large font.
+    void resetExtended();
+
+    // Drops the predecoded instructions that overlap the written bytes.
+    void invalidateDecoded(unsigned short index, unsigned short count);
+
+    // Drops the basic blocks that overlap the written bytes.
+    void invalidateBlocks(unsigned short index, unsigned short count);
+
+    // Drops the native blocks that overlap the written bytes.
+    void invalidateJit(unsigned short index, unsigned short count);
+
+    // Instruction handlers, one per opcode. The handlers of the instructions
+    // that differ between platforms or in the extended mode take the handler
+    // set as a parameter.
+    template <unsigned char Set>
+    ErrorCode op00E0(const Instruction &instruction);
+    ErrorCode op00EE(const Instruction &instruction);
+    ErrorCode op1nnn(const Instruction &instruction);
+    ErrorCode op2nnn(const Instruction &instruction);
+    ErrorCode op3xkk(const Instruction &instruction);
+    ErrorCode op4xkk(const Instruction &instruction);
+    ErrorCode op5xy0(const Instruction &instruction);
+    ErrorCode op6xkk(const Instruction &instruction);
+    ErrorCode op7xkk(const Instruction &instruction);
+    ErrorCode op8xy0(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode op8xy1(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode op8xy2(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode op8xy3(const Instruction &instruction);
+    ErrorCode op8xy4(const Instruction &instruction);
+    ErrorCode op8xy5(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode op8xy6(const Instruction &instruction);
+    ErrorCode op8xy7(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode op8xyE(const Instruction &instruction);
+    ErrorCode opAnnn(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode opBnnn(const Instruction &instruction);
+    ErrorCode opCxkk(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode opDxyn(const Instruction &instruction);
+    ErrorCode opEx9E(const Instruction &instruction);
+    ErrorCode opExA1(const Instruction &instruction);
+    ErrorCode opFx07(const Instruction &instruction);
+    ErrorCode opFx0A(const Instruction &instruction);
+    ErrorCode opFx15(const Instruction &instruction);
+    ErrorCode opFx18(const Instruction &instruction);
+    ErrorCode opFx1E(const Instruction &instruction);
+    ErrorCode opFx29(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode opFx33(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode opFx55(const Instruction &instruction);
+    template <unsigned char Set>
+    ErrorCode opFx65(const Instruction &instruction);
+    ErrorCode opUnknown(const Instruction &instruction);
+
+    // Handlers of the instructions only found in the extended mode.
+    ErrorCode op00Cn(const Instruction &instruction);
+    ErrorCode op00Dn(const Instruction &instruction);
+    ErrorCode op00FB(const Instruction &instruction);
+    ErrorCode op00FC(const Instruction &instruction);
+    ErrorCode op00FD(const Instruction &instruction);
+    ErrorCode op00FE(const Instruction &instruction);
+    ErrorCode op00FF(const Instruction &instruction);
+    ErrorCode op5xy2(const Instruction &instruction);
+    ErrorCode op5xy3(const Instruction &instruction);
+    ErrorCode opF000(const Instruction &instruction);
+    ErrorCode opFn01(const Instruction &instruction);
+    ErrorCode opSound(const Instruction &instruction);
+    ErrorCode opFx30(const Instruction &instruction);
+    ErrorCode opFx75(const Instruction &instruction);
+    ErrorCode opFx85(const Instruction &instruction);
+
+    // Draws the sprite of Dxyn on the extended display, and returns true if
+    // it collided with any pixel.
+    bool drawExtended(const Instruction &instruction);
+
+    // Scrolls the selected planes down by count rows, or up if it is
+    // negative, or right by count pixels, or left if it is negative.
+    void scrollVertically(int count);
+    void scrollHorizontally(int count);
+
+    // The registers, the timers, the stack and the keypad, first in the
+    // interpreter so that they take its first two cache lines.
+    Registers registers;
+
+    // The RAM memory, in pages shared with other interpreters until they
+    // are written.
+    PagedMemory memory;
+
+    // The monochrome display, one row of 64 pixels per word. The leftmost
+    // pixel of a row is its most significant bit, so a sprite is drawn with
+    // a shift and an XOR per row.
+    std::array<uint64_t, DISPLAY_HEIGHT> display;
+
+    // Addresses that stop runCycles and runUntil before executing them.
+    std::bitset<NUM_BYTES_MEMORY> breakpoints;
+
+    // Frame scheduling: instructions per frame, frames emulated, and the
+    // time the next frame is due at when running in real time.
+    unsigned int instructionsPerFrame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    unsigned long frames = 0;
+    bool realTime = false;
+    std::chrono::steady_clock::time_point nextFrame;
+
+    // Capture every frame is handed to once it is over, if any. It is not
+    // owned by the interpreter.
+    FrameCapture *capture = nullptr;
+
+    // Idle loops: whether they are skipped, whether the last jump may have
+    // closed one, and the instructions skipped.
+    bool idleSkipping = true;
+    bool idleJump = false;
+    unsigned long elidedCycles = 0;
+
+    // Generator of the random numbers used by RND.
+    Random random;
+
+    // Quirk set in use.
+    unsigned char quirks = 0;
+
+    // State of the extended mode: the planes of the display, the memory
+    // addressable by I past the classic memory, the flags Fx75 and Fx85 save
+    // the registers to, the planes selected by Fn01 and the resolution.
+    struct Extended
+    {
+        std::array<std::array<PlaneRow, EXTENDED_DISPLAY_HEIGHT>, NUM_PLANES>
+            planes;
+        std::array<unsigned char, EXTENDED_MEMORY_SIZE - NUM_BYTES_MEMORY>
+            memory;
+        std::array<unsigned char, NUM_REGISTERS> flags;
+        unsigned char selectedPlanes;
+        bool highResolution;
+    };
+
+    // It is only allocated while the extended mode is enabled.
+    std::unique_ptr<Extended> extended;
+
+    // Whether messages are printed to the standard output.
+    bool logging = true;
+
+    // Predecoded shadow of the memory, holding the instruction that starts
+    // at each address. An entry without a handler has to be decoded again.
+    // It is only allocated while the cache is enabled.
+    std::unique_ptr<std::array<Instruction, NUM_BYTES_MEMORY>> decoded;
+
+    // Cache of the basic blocks compiled from memory. It is only allocated
+    // while the cache is enabled.
+    std::unique_ptr<BlockCache> blocks;
+
+#ifdef CHIP8_PROFILE
+    // Counters of the instructions executed. It is only allocated while
+    // profiling is enabled.
+    std::unique_ptr<Profiler> profiler;
+#endif
+
+#ifdef CHIP8_JIT
+    // Native code generated from memory. It is only allocated while the JIT
+    // is enabled.
+    std::unique_ptr<JitCompiler> jit;
+#endif
+};
 
-    // The Stack Pointer or SP always points to the top of the stack.
-    unsigned char sp;
-};
\ No newline at end of file
+static_assert(sizeof(Chip8::Registers) == 128,
+              "the registers fill two cache lines");
+static_assert(std::is_trivially_copyable<Chip8::Registers>::value &&
+                  std::has_unique_object_representations<
+                      Chip8::Registers>::value,
+              "the registers are copied as raw bytes, without padding");
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Max number of bytes of the score read from memory.
+#define FORK_MAX_SCORE_BYTES 8
+
+// Outcome of running one fork.
+struct ForkResult
+{
+    // Hash of the state of the fork when its frames were over.
+    uint64_t stateHash = 0;
+
+    // Score read from memory when its frames were over.
+    uint64_t score = 0;
+
+    // Number of frames the fork emulated.
+    unsigned long frames = 0;
+
+    // Ok if all the frames were emulated, or Error if an instruction could
+    // not be executed.
+    ErrorCode error = Ok;
+
+    // Display of the fork when its frames were over.
+    std::array<uint64_t, DISPLAY_HEIGHT> display{};
+};
+
+// Counters of the last exploration of a fork pool.
+struct ForkStatistics
+{
+    // Number of forks run, and of frames emulated by all of them.
+    unsigned long forks = 0;
+    unsigned long frames = 0;
+
+    // Number of times a worker took forks from another one.
+    unsigned long steals = 0;
+
+    // Wall time of the exploration, and time the workers spent on it added
+    // up, in seconds.
+    double seconds = 0.0;
+    double workerSeconds = 0.0;
+
+    // Returns the forks run per second of wall time
+    inline double forksPerSecond() const
+    {
+        return seconds > 0.0 ? forks / seconds : 0.0;
+    }
+
+    // Returns the forks run per second of each worker
+    inline double forksPerCoreSecond() const
+    {
+        return workerSeconds > 0.0 ? forks / workerSeconds : 0.0;
+    }
+};
+
+// This class explores the states reachable from an interpreter, as search
+// agents do: it forks one interpreter per sequence of inputs, runs each fork
+// for a number of frames, and returns the state hash, score and display each
+// one ended with. The forks are spread over a pool of threads that is kept
+// between explorations. Every worker starts with an even share of the forks
+// and, once it runs out, steals half of the forks left to another one.
+// Workers reuse their interpreter for every fork, which shares the pages of
+// memory of the source until it writes to them, so that forking does not
+// allocate.
+class ForkPool
+{
+public:
+    // Creates a pool with the given number of workers, one of them being
+    // the thread calling explore. Zero uses one per hardware thread.
+    explicit ForkPool(unsigned int threads = 0);
+    ~ForkPool();
+
+    ForkPool(const ForkPool &) = delete;
+    ForkPool &operator=(const ForkPool &) = delete;
+
+    // Reads the score as the unsigned big endian number in the size bytes
+    // of memory starting at address. A size of zero reports no score.
+    void setScore(unsigned short address, unsigned char size);
+
+    // Forks source once per sequence of inputs and emulates frames frames
+    // on each fork, pressing in every frame the keys of the matching entry
+    // of its sequence, one bit per key. A sequence shorter than frames keeps
+    // its last keys pressed until the end, and an empty one keeps the keys
+    // of the source. Returns a result per sequence in the same order. The
+    // source is only read, and must not change until the exploration is
+    // over.
+    const std::vector<ForkResult> &
+    explore(const Chip8 &source,
+            const std::vector<std::vector<uint16_t>> &inputs,
+            unsigned long frames);
+
+    // Returns the counters of the last exploration.
+    inline const ForkStatistics &getStatistics() const { return statistics; }
+
+    // Returns the number of workers.
+    inline unsigned int getThreads() const { return workers.size(); }
+
+private:
+    // A worker: its interpreter, and the forks it still has to run as the
+    // half-open range of indices [begin, end) packed in one word, begin in
+    // the high half, so that it can be shrunk from either end atomically.
+    struct alignas(64) Worker
+    {
+        std::atomic<uint64_t> range{0};
+        Chip8 chip8;
+        unsigned long steals = 0;
+        double seconds = 0.0;
+    };
+
+    // Runs the forks of the current exploration on a worker until there are
+    // none left.
+    void work(size_t self);
+
+    // Takes the next fork of the worker, returning false if it has none.
+    static bool take(Worker &worker, size_t &index);
+
+    // Moves half of the forks of another worker to this one and takes the
+    // first of them, returning false if no worker has any left.
+    bool steal(size_t thief, size_t &index);
+
+    // Runs a fork of the source on an interpreter.
+    void runFork(Chip8 &chip8, size_t index);
+
+    // Waits for explorations to run them, on the threads of the pool.
+    void loop(size_t index);
+
+    // Workers, the first of them being the thread calling explore.
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // Exploration being run, and results of the last one.
+    const Chip8 *source = nullptr;
+    const std::vector<std::vector<uint16_t>> *inputs = nullptr;
+    unsigned long frames = 0;
+    std::vector<ForkResult> results;
+    ForkStatistics statistics;
+
+    // Location of the score in memory.
+    unsigned short scoreAddress = 0;
+    unsigned char scoreSize = 0;
+
+    // Synchronization of the threads of the pool: the number of the
+    // current exploration, the threads still running it, and whether the
+    // pool is being destroyed.
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    unsigned long generation = 0;
+    unsigned int running = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chip8.hpp"
+#include "frameScaler.hpp"
+
+// Number of frames the queue of a capture holds unless configured otherwise,
+// about 17 seconds of emulation.
+#define CAPTURE_QUEUE_FRAMES 1024
+
+// Time the writer of a capture sleeps for when it finds the queue empty, in
+// microseconds.
+#define CAPTURE_POLL_MICROSECONDS 1000
+
+// Formats of the stream a capture writes.
+enum CaptureFormat
+{
+    // YUV4MPEG2, with full range 4:4:4 planes at FRAME_RATE frames per
+    // second, tagged XCOLORRANGE=FULL. A frame followed by copies of itself
+    // is written once, and its FRAME header carries the number of copies as
+    // XREPEAT=n, unless the repeat tags are disabled. XREPEAT is not part of
+    // the format, and other readers play such a stream shorter.
+    Y4mFormat,
+    // The RGBA pixels of every frame one after the other, with no header.
+    // There is nowhere to mark a repeat, so copies are written in full.
+    RawFormat
+};
+
+// Counters of a capture. Each of them is updated by one thread, and can be
+// read from any while the capture runs.
+struct CaptureStatistics
+{
+    // Number of frames queued, and how many of them were repeat markers.
+    unsigned long captured = 0;
+    unsigned long repeated = 0;
+
+    // Number of frames lost because the queue was full, or because their
+    // display had another size than the first frame.
+    unsigned long dropped = 0;
+
+    // Number of frames written to the stream, counting the repeats, and
+    // bytes written.
+    unsigned long written = 0;
+    unsigned long bytes = 0;
+};
+
+// This class records the frames of an interpreter into a video stream
+// without slowing it down: capture copies the display into a lock-free
+// single producer, single consumer ring and returns at once, and a
+// background thread drains the ring, expands the frames with a FrameScaler
+// and writes them to a file, a named pipe or the standard output. A frame
+// equal to the previous one is queued as a repeat marker, with no pixels. A
+// frame that finds the ring full is dropped and counted, so the emulation
+// never waits on the disk.
+class FrameCapture
+{
+public:
+    // Creates a capture whose ring holds the given number of frames.
+    explicit FrameCapture(size_t frames = CAPTURE_QUEUE_FRAMES);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // Sets the factor the frames are scaled by, and their colours. They
+    // apply to the next stream opened.
+    inline void setScale(unsigned int scale) { scaler.setScale(scale); }
+    inline void setColors(uint32_t foreground, uint32_t background)
+    {
+        scaler.setColors(foreground, background);
+    }
+
+    // Sets whether a Y4M stream writes a frame and its copies once, with
+    // XREPEAT=n, or every copy in full as the raw format does. It applies
+    // to the next stream opened.
+    inline void setRepeatTags(bool enabled) { repeatTags = enabled; }
+
+    // Opens the stream in the given format and starts the writer. A
+    // filename of "-" writes to the standard output. Fails if the file
+    // cannot be opened or a stream is already open.
+    ErrorCode open(const std::string &filename, CaptureFormat format);
+
+    // Stops the writer once it has written the frames left in the ring, and
+    // closes the stream. Returns Error if any write failed.
+    ErrorCode close();
+
+    // Returns true if a stream is open.
+    inline bool isOpen() const { return writer.joinable(); }
+
+    // Queues the display of the interpreter, which is what runFrame does at
+    // the end of every frame when the capture is attached to it. Returns
+    // false if the frame was dropped or no stream is open. Only one thread
+    // may capture frames.
+    bool capture(const Chip8 &chip8);
+
+    // Returns the counters of the current or last stream.
+    CaptureStatistics getStatistics() const;
+
+private:
+    // A frame of the ring: the display, with the planes combined in the
+    // extended mode, or a repeat of the previous frame.
+    struct Frame
+    {
+        std::array<uint64_t, 2 * EXTENDED_DISPLAY_HEIGHT> display;
+        bool repeat;
+    };
+
+    // Drains the ring until the capture is closed, on the writer thread.
+    void loop();
+
+    // Expands a frame into the bytes of the stream.
+    void convert(const Frame &frame);
+
+    // Writes the last frame converted and its repeats.
+    void flush();
+
+    // Writes bytes to the stream, remembering if it failed.
+    void write(const void *data, size_t size);
+
+    // Ring of frames. The producer only writes tail and the consumer only
+    // writes head, which count the frames pushed and popped since the
+    // stream was opened and are kept on their own cache lines.
+    std::vector<Frame> ring;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<bool> stopping{false};
+
+    // State of the producer: the size of the frames of the stream, set by
+    // the first one, and the last frame queued.
+    unsigned int width = 0;
+    unsigned int height = 0;
+    std::array<uint64_t, 2 * EXTENDED_DISPLAY_HEIGHT> last;
+
+    // Counters, each written by the producer or by the writer.
+    std::atomic<unsigned long> captured{0};
+    std::atomic<unsigned long> repeated{0};
+    std::atomic<unsigned long> dropped{0};
+    std::atomic<unsigned long> written{0};
+    std::atomic<unsigned long> bytes{0};
+
+    // State of the writer: the stream, the scaler, the bytes of the last
+    // frame converted and the number of repeats of it still to write.
+    CaptureFormat format = Y4mFormat;
+    bool repeatTags = true;
+    std::ofstream file;
+    std::ostream *stream = nullptr;
+    bool failed = false;
+    bool started = false;
+    FrameScaler scaler;
+    std::vector<uint32_t> pixels;
+    std::vector<unsigned char> converted;
+    unsigned long repeats = 0;
+    std::thread writer;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Largest factor the display can be scaled by.
+#define MAX_SCALE 32
+
+// Colours the display is drawn with unless configured otherwise: opaque
+// white on opaque black.
+#define DEFAULT_FOREGROUND 0xffffffffu
+#define DEFAULT_BACKGROUND 0xff000000u
+
+// Implementations of the expansion of the display into pixels.
+enum ScalerKernel
+{
+    // One pixel at a time, with plain integer code.
+    ScalarKernel,
+    // Eight pixels at a time, with vectors the compiler maps to AVX2 or SSE2
+    // registers depending on the target.
+    VectorKernel
+};
+
+// Eight pixels of the output, as one vector.
+typedef uint32_t PixelBlock __attribute__((vector_size(32)));
+
+// This class expands the display of an interpreter, one bit per pixel, into
+// an image of 32 bit pixels scaled by an integer factor, as a front end or a
+// capture needs it. A pixel holds the red, green, blue and alpha channels
+// from its least to its most significant byte, so the bytes of the image are
+// in RGBA order on a little endian machine, and a grey level repeated in the
+// three colour channels gives a greyscale image.
+//
+// The vector kernel turns each byte of a row, scaled, into eight pixels with
+// a lookup of the mask of its bits and a blend of the two colours, and then
+// copies the row into the rest of the rows it is scaled to. With phosphor
+// decay, a pixel that is turned off fades into the background over the
+// following frames instead of disappearing at once, which hides the flicker
+// of programs that erase and redraw their sprites every frame.
+class FrameScaler
+{
+public:
+    explicit FrameScaler(unsigned int scale = 1);
+
+    // Sets the factor the display is scaled by, from 1 to MAX_SCALE.
+    void setScale(unsigned int scale);
+
+    // Returns the factor the display is scaled by.
+    inline unsigned int getScale() const { return scale; }
+
+    // Sets the colours of the pixels that are set and of those that are not.
+    void setColors(uint32_t foreground, uint32_t background);
+
+    // Sets the fraction of its brightness, in 256ths, a pixel that is turned
+    // off keeps on each frame. Zero disables the decay, and is the default.
+    void setDecay(unsigned char decay);
+
+    // Selects the kernel, the vector one by default. Both write the same
+    // pixels.
+    inline void setKernel(ScalerKernel kernel) { this->kernel = kernel; }
+
+    // Forgets the brightness of the pixels, so that the next frame is drawn
+    // without anything fading from the previous ones.
+    void reset();
+
+    // Returns the width and height in pixels of the image of the display of
+    // an interpreter, which is bigger in the extended mode.
+    unsigned int getWidth(const Chip8 &chip8) const;
+    unsigned int getHeight(const Chip8 &chip8) const;
+
+    // Expands the display of an interpreter into pixels, which must hold
+    // getWidth(chip8) * getHeight(chip8) of them, row after row. In the
+    // extended mode a pixel is set if it is set in any plane. Only the rows
+    // of the display selected by rows are written, in the same format as the
+    // dirty rows of the interpreter, unless the decay is enabled and every
+    // row is written as it fades.
+    void expand(const Chip8 &chip8, uint32_t *pixels,
+                uint32_t rows = ALL_DISPLAY_ROWS);
+
+    // Does the same for a display of the given size, whose width is 64 or
+    // 128, with a row of pixels every width / 64 words and the leftmost pixel
+    // in the most significant bit of its first word.
+    void expand(const uint64_t *display, unsigned int width,
+                unsigned int height, uint32_t *pixels,
+                uint32_t rows = ALL_DISPLAY_ROWS);
+
+private:
+    // Writes the scaled rows of a row of the display, with each kernel or
+    // with the brightness of its pixels.
+    void expandRowScalar(const uint64_t *row, unsigned int width,
+                         uint32_t *pixels);
+    void expandRowVector(const uint64_t *row, unsigned int width,
+                         uint32_t *pixels);
+    void expandRowDecay(const uint64_t *row, unsigned int width,
+                        unsigned char *levels, uint32_t *pixels);
+
+    // Fills the palette with the colour of every brightness, blending the
+    // background into the foreground.
+    void updatePalette();
+
+    // Factor the display is scaled by, and the kernel expanding it.
+    unsigned int scale;
+    ScalerKernel kernel = VectorKernel;
+
+    // Colours, and the same colours in every pixel of a block.
+    uint32_t foreground = DEFAULT_FOREGROUND;
+    uint32_t background = DEFAULT_BACKGROUND;
+    PixelBlock foregroundBlock;
+    PixelBlock backgroundBlock;
+
+    // Brightness kept per frame, the colour of each brightness, and the
+    // brightness of every pixel of the display, from 0 to 255.
+    unsigned char decay = 0;
+    std::array<uint32_t, 256> palette;
+    std::vector<unsigned char> brightness;
+
+    // A row of the display scaled horizontally, one bit per pixel with the
+    // leftmost pixel in the most significant bit of the first byte.
+    std::vector<unsigned char> scaledRow;
+
+    // Rows of the extended display, combining the planes.
+    std::array<uint64_t, 2 * EXTENDED_DISPLAY_HEIGHT> combined;
+};
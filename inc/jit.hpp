@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+
+#include "blockCache.hpp"
+#include "chip8.hpp"
+
+// Size in bytes of the executable buffer holding the generated code.
+#define JIT_BUFFER_SIZE (1 << 20)
+
+// Native code of a basic block. It runs the block on the interpreter it
+// receives and returns the ErrorCode of the last instruction executed.
+using JitFunction = int (*)(Chip8 *chip8);
+
+// This class translates the basic blocks in the memory of a Chip8 to x86-64
+// code, placed in a buffer of executable memory. The code keeps the address
+// of the interpreter in rbx and operates on its registers in place, so the
+// interpreter itself is the pinned state of the guest. Instructions without
+// a translation are executed by calling back into executeInstruction.
+class JitCompiler
+{
+public:
+    JitCompiler();
+    ~JitCompiler();
+
+    // Returns true if the executable buffer could be mapped
+    inline bool isReady() const
+    {
+        return buffer != nullptr;
+    }
+
+    // Returns the native code of the block starting at address, translating
+    // it if it is not valid. Returns nullptr if there is no block there.
+    JitFunction getBlock(const Chip8 &chip8, unsigned short address);
+
+    // Throws away the blocks that overlap the count bytes of memory starting
+    // at index.
+    void invalidate(unsigned short index, unsigned short count);
+
+    // Counts the execution of a block. The generated code counts the
+    // instructions executed by itself.
+    inline void countExecution()
+    {
+        statistics.executed++;
+    }
+
+    // Returns the counters of the JIT
+    inline const BlockStatistics &getStatistics() const
+    {
+        return statistics;
+    }
+
+private:
+    // A translated block.
+    struct JitBlock
+    {
+        JitFunction code = nullptr;
+        unsigned short end = 0;
+        bool valid = false;
+    };
+
+    // Translates the block starting at address.
+    void compile(const Chip8 &chip8, unsigned short address, JitBlock &block);
+
+    // Throws away all the blocks so that the buffer can be reused.
+    void flush();
+
+    // Makes the buffer executable, or writable otherwise. Returns false if
+    // its protection could not be changed.
+    bool setExecutable(bool enabled);
+
+    // Blocks indexed by their starting address.
+    std::array<JitBlock, NUM_BYTES_MEMORY> blocks;
+
+    // Buffer of code, number of bytes of it already used, and whether it is
+    // executable or writable at the moment.
+    unsigned char *buffer = nullptr;
+    size_t used = 0;
+    bool executable = false;
+
+    // Counters of the JIT.
+    BlockStatistics statistics;
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Number of lanes held by each vector of the engine. The compiler maps the
+// vectors to AVX2 or SSE registers, depending on the target.
+#define LANE_BLOCK 32
+
+// Groups smaller than this number of lanes are considered diverged, and the
+// rest of the step is executed one lane at a time.
+#define MIN_GROUP_SIZE 4
+
+// The value of a byte register and of a word register in LANE_BLOCK lanes,
+// and the mask used to select some of those lanes.
+typedef unsigned char LaneBytes __attribute__((vector_size(LANE_BLOCK)));
+typedef unsigned short LaneWords
+    __attribute__((vector_size(2 * LANE_BLOCK)));
+typedef signed char LaneMask __attribute__((vector_size(LANE_BLOCK)));
+
+// Counters kept by the lockstep engine.
+struct LockstepStatistics
+{
+    // Number of lanes of the engine.
+    unsigned long lanes = 0;
+
+    // Number of steps executed.
+    unsigned long steps = 0;
+
+    // Number of instructions executed, adding up all the lanes.
+    unsigned long instructions = 0;
+
+    // Number of instructions executed by the vector operations.
+    unsigned long vectorInstructions = 0;
+
+    // Number of groups of lanes issued, each of them running one instruction
+    // at the same PC. A lane executed on its own counts as a group.
+    unsigned long groups = 0;
+
+    // Returns the average fraction of the lanes that executed together
+    inline double occupancy() const
+    {
+        return groups > 0 ? static_cast<double>(instructions) /
+                                (static_cast<double>(groups) * lanes)
+                          : 0.0;
+    }
+};
+
+// This class runs many copies of the same program in lockstep. The registers
+// of all the copies are laid out as structures of arrays, one lane per copy,
+// so that lanes sharing the same PC execute an instruction together with
+// vector operations. Instructions without a vector form, and lanes that have
+// diverged from the rest, are executed one lane at a time. The Chip8 that
+// backs each lane keeps its memory and executes the instructions the engine
+// does not implement. That includes CLS and DRW, so the display of each lane
+// stays in its interpreter rather than in the lanes.
+class LockstepEngine
+{
+public:
+    explicit LockstepEngine(size_t lanes);
+    ~LockstepEngine();
+
+    // Initializes every lane and loads the same program into all of them.
+    ErrorCode loadProgram(const unsigned char *program, size_t size);
+
+    // Selects the quirk set of every lane. The vector forms of the
+    // instructions that differ between platforms follow it as the
+    // interpreter does.
+    void setQuirks(unsigned char quirks);
+
+    // Seeds the generator used by RND in every lane, each lane with a
+    // different seed derived from the one provided.
+    void seedRandom(uint64_t seed);
+
+    // Executes one instruction in every lane that is still running, and
+    // returns the number of instructions executed.
+    unsigned long step();
+
+    // Executes the given number of steps, or less if all the lanes stop.
+    // Returns the number of instructions executed.
+    unsigned long run(unsigned long steps);
+
+    // Emulates the given number of frames, as runFrames does on each lane:
+    // executes the steps of a frame and then decrements the delay and sound
+    // timers of the running lanes that are not zero yet. Returns the number
+    // of instructions executed.
+    unsigned long runFrames(unsigned long count);
+
+    // Sets the number of steps executed in each frame.
+    inline void setInstructionsPerFrame(unsigned int instructions)
+    {
+        instructionsPerFrame = instructions;
+    }
+
+    // Returns the number of frames emulated since the program was loaded.
+    inline unsigned long getFrames() const { return frames; }
+
+    // Returns the number of lanes.
+    inline size_t getLanes() const { return lanes; }
+
+    // Returns true if the lane has not stopped on an error.
+    bool isRunning(size_t lane) const;
+
+    // Returns the error the lane stopped on, or Ok if it is still running.
+    inline ErrorCode getError(size_t lane) const { return errors[lane]; }
+
+    // Sets a register of a lane, so that lanes can start from different
+    // inputs.
+    void setRegister(size_t lane, unsigned char index, unsigned char value);
+
+    // Returns the interpreter backing a lane, with the registers of the lane
+    // copied into it.
+    const Chip8 &getLane(size_t lane);
+
+    // Returns the counters of the engine
+    inline const LockstepStatistics &getStatistics() const
+    {
+        return statistics;
+    }
+
+private:
+    // Executes the instruction at the PC of leader in all the pending lanes
+    // that share its PC. Returns the number of lanes executed.
+    size_t executeGroup(size_t leader);
+
+    // Executes an instruction with vector operations in the lanes of a block
+    // selected by mask. Returns false if the instruction has no vector form.
+    bool executeVector(const Chip8::Instruction &in, size_t block,
+                       const LaneMask &mask);
+
+    // Executes an instruction that reads or writes the memory or the random
+    // generator in the lanes of a block selected by mask, one lane at a time
+    // but without copying the registers to the interpreters. Returns false
+    // for any other instruction.
+    bool executeLanes(const Chip8::Instruction &in, size_t block,
+                      const LaneMask &mask);
+
+    // Executes the next instruction of a lane through its interpreter,
+    // fetching it from the memory of the lane.
+    void executeLane(size_t lane);
+
+    // Copies the registers of a lane to its interpreter and back.
+    void storeLane(size_t lane);
+    void loadLane(size_t lane);
+
+    // Stops a lane on an error.
+    void stopLane(size_t lane, ErrorCode error);
+
+    // Decrements the timers of the running lanes that are not zero yet.
+    void tickTimers();
+
+    // Number of lanes and of vector blocks holding them.
+    size_t lanes;
+    size_t blocks;
+
+    // Registers of all the lanes, LANE_BLOCK lanes per element.
+    std::array<std::vector<LaneBytes>, NUM_REGISTERS> v;
+    std::vector<LaneWords> i;
+    std::vector<LaneWords> pc;
+    std::vector<LaneBytes> sp;
+    std::vector<LaneBytes> dtr;
+    std::vector<LaneBytes> str;
+    std::array<std::vector<LaneWords>, SIZE_STACK> stack;
+
+    // Lanes that are still running, and lanes that have not executed their
+    // instruction yet in the current step.
+    std::vector<LaneMask> running;
+    std::vector<LaneMask> pending;
+
+    // Error each lane stopped on.
+    std::vector<ErrorCode> errors;
+
+    // Interpreter backing each lane.
+    std::unique_ptr<Chip8[]> machines;
+
+    // Quirk set of all the lanes.
+    unsigned char quirks = 0;
+
+    // Steps executed in each frame, and frames emulated.
+    unsigned int instructionsPerFrame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    unsigned long frames = 0;
+
+    // Addresses of memory written by any lane since the program was loaded.
+    // Outside of them every lane holds the same code.
+    std::array<bool, NUM_BYTES_MEMORY> written;
+
+    // Counters of the engine.
+    LockstepStatistics statistics;
+};
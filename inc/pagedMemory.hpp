@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Number of bytes in each page of memory, and number of pages. Addresses
+// wrap around at the end of the last page.
+#define MEMORY_PAGE_SIZE 256
+#define NUM_MEMORY_PAGES 16
+
+// The contents of a page of memory.
+using MemoryPage = std::array<unsigned char, MEMORY_PAGE_SIZE>;
+
+// This class keeps the memory of an interpreter as a table of pages that may
+// be shared with other memories. Copying a memory copies the table and
+// shares all the pages, and a shared page is copied the first time it is
+// written. Pages loaded with load() are also shared with every memory that
+// loaded the same contents, such as the font and the program of every
+// interpreter running the same program, so that many interpreters only hold
+// the pages they write to.
+class PagedMemory
+{
+public:
+    // Creates a memory where every byte is zero.
+    PagedMemory();
+
+    // Returns the byte at address
+    inline unsigned char operator[](unsigned short address) const
+    {
+        return (*pages[address / MEMORY_PAGE_SIZE % NUM_MEMORY_PAGES])
+            [address % MEMORY_PAGE_SIZE];
+    }
+
+    // Writes the byte at address, copying its page first if it is shared
+    inline void write(unsigned short address, unsigned char value)
+    {
+        writablePage(address / MEMORY_PAGE_SIZE % NUM_MEMORY_PAGES)
+            [address % MEMORY_PAGE_SIZE] = value;
+    }
+
+    // Copies size bytes starting at address to output.
+    void read(unsigned short address, unsigned char *output,
+              size_t size) const;
+
+    // Copies size bytes from input starting at address. Pages whose
+    // contents do not change are not written, so they stay shared.
+    void write(unsigned short address, const unsigned char *input,
+               size_t size);
+
+    // Copies size bytes from input starting at address, and shares the
+    // pages they fall on with any other memory that loaded the same
+    // contents.
+    void load(unsigned short address, const unsigned char *input,
+              size_t size);
+
+    // Sets every byte to zero, sharing all the pages.
+    void clear();
+
+    // Hashes the contents of the memory with Utils::hash, as if it was
+    // contiguous.
+    uint64_t hash(uint64_t seed = 0xcbf29ce484222325ull) const;
+
+    // Returns the number of pages only this memory holds, which is what it
+    // adds to the resident memory of the process.
+    size_t getPrivatePages() const;
+
+    // Returns the pages that are not shared with other, one bit per page.
+    // The pages that are shared have the same contents in both memories.
+    uint16_t getDifferentPages(const PagedMemory &other) const;
+
+private:
+    // Returns a page that only this memory holds, copying it first if it is
+    // shared.
+    inline MemoryPage &writablePage(size_t index)
+    {
+        if ((privatePages >> index & 0x1) == 0 || pages[index].use_count() != 1)
+        {
+            makePrivate(index);
+        }
+        return *pages[index];
+    }
+
+    // Replaces a page by a copy that only this memory holds.
+    void makePrivate(size_t index);
+
+    // Table of pages.
+    std::array<std::shared_ptr<MemoryPage>, NUM_MEMORY_PAGES> pages;
+
+    // Pages this memory copied to write them, one bit per page. Only they
+    // can be written in place, and only while no copy of the memory shares
+    // them. Loaded pages never are, so that their contents stay the ones
+    // other memories look them up by.
+    uint16_t privatePages = 0;
+};
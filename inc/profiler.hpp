@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Max number of entries listed in each table of the text report.
+#define PROFILE_REPORT_ENTRIES 10
+
+// Number of different values of the stack pointer.
+#define PROFILE_DEPTHS 256
+
+// This class counts the instructions executed by an interpreter by opcode,
+// by address and by depth of the stack, and the backward jumps that close
+// the loops of the program. The interpreter only records into it when built
+// with PROFILE=1 and while profiling is enabled.
+class Profiler
+{
+public:
+    // A loop, identified by the address a backward jump lands on.
+    struct Loop
+    {
+        unsigned short head;
+        unsigned short end;
+        unsigned long count;
+    };
+
+    // Records the execution of opcode at address, with the stack pointer at
+    // depth, after which execution continues at next.
+    inline void record(unsigned short address, unsigned short opcode,
+                       unsigned char depth, unsigned short next)
+    {
+        instructions++;
+        opcodes[opcode]++;
+        addresses[address]++;
+        lastOpcodes[address] = opcode;
+        depths[depth]++;
+
+        // Only jumps close loops. Calls and returns to lower addresses do not
+        if (next < address && (opcode >> 12 == 0x1 || opcode >> 12 == 0xb))
+        {
+            loopCounts[next]++;
+            loopEnds[next] = std::max(loopEnds[next], address);
+        }
+    }
+
+    // Clears all the counters.
+    void reset();
+
+    // Returns the number of instructions recorded.
+    inline unsigned long getInstructions() const { return instructions; }
+
+    // Returns the number of times the instruction at address was executed.
+    inline unsigned long getAddressCount(unsigned short address) const
+    {
+        return addresses[address];
+    }
+
+    // Returns the number of instructions executed with the stack pointer at
+    // depth.
+    inline unsigned long getDepthCount(unsigned char depth) const
+    {
+        return depths[depth];
+    }
+
+    // Returns the instructions executed by opcode class, such as 8xy4 or
+    // Fx1E, the most executed first.
+    std::vector<std::pair<std::string, unsigned long>> getOpcodeClasses() const;
+
+    // Returns the loops found, the most repeated first.
+    std::vector<Loop> getLoops() const;
+
+    // Returns the deepest stack pointer seen, and the average one.
+    unsigned char getMaxDepth() const;
+    double getAverageDepth() const;
+
+    // Writes a human readable report, with the most relevant entries of each
+    // table.
+    void writeReport(std::ostream &output) const;
+
+    // Writes all the counters as JSON.
+    void writeJson(std::ostream &output) const;
+
+private:
+    // Returns the class of an opcode, with its operands as letters
+    static std::string opcodeClass(unsigned short opcode);
+
+    // Number of instructions recorded.
+    unsigned long instructions = 0;
+
+    // Instructions executed by opcode.
+    std::array<unsigned long, 0x10000> opcodes{};
+
+    // Instructions executed by address, and the last opcode seen there.
+    std::array<unsigned long, NUM_BYTES_MEMORY> addresses{};
+    std::array<unsigned short, NUM_BYTES_MEMORY> lastOpcodes{};
+
+    // Instructions executed by value of the stack pointer.
+    std::array<unsigned long, PROFILE_DEPTHS> depths{};
+
+    // Backward jumps by target address, and the highest address they were
+    // taken from.
+    std::array<unsigned long, NUM_BYTES_MEMORY> loopCounts{};
+    std::array<unsigned short, NUM_BYTES_MEMORY> loopEnds{};
+};
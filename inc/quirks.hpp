@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "chip8.hpp"
+
+// This class holds the quirk set each program needs, by the name of its
+// file. It is read from a text file with a line per program: the name of
+// the file without its directory, followed by a preset or by the names of
+// the quirks, separated by spaces. Empty lines and text after a # are
+// ignored. For example:
+//
+//     # Program   Quirks
+//     BLITZ       cosmac
+//     CAR         shift-vy increment-i
+//
+// The presets are none, cosmac and schip, and the quirks shift-vy,
+// increment-i, jump-vx and reset-vf. A program without a line uses the
+// default quirk set, which a line for * changes.
+class QuirkConfig
+{
+public:
+    // Reads the quirk sets from a file, adding them to the ones already
+    // held. Returns FileOpenError if it cannot be read, and Error if a line
+    // names an unknown quirk, in which case the lines before it are kept.
+    ErrorCode load(const std::string &filename);
+
+    // Sets the quirk set of the program with the given file name.
+    void set(const std::string &program, unsigned char quirks);
+
+    // Sets the quirk set of the programs without one.
+    inline void setDefault(unsigned char quirks) { fallback = quirks; }
+
+    // Returns the quirk set of the program at path, looked up by the name of
+    // its file.
+    unsigned char find(const std::string &path) const;
+
+    // Reads a preset or the name of a quirk, adding its quirks to quirks.
+    // Returns false if the name is not known.
+    static bool parse(const std::string &name, unsigned char &quirks);
+
+private:
+    // Quirk sets by file name, and the one of the rest of the programs.
+    std::unordered_map<std::string, unsigned char> programs;
+    unsigned char fallback = 0;
+};
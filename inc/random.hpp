@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Small and fast pseudo random number generator, xoshiro128**. It is kept
+// by the interpreter and seeded once, so that drawing a number costs a few
+// arithmetic operations and runs can be reproduced from their seed.
+class Random
+{
+public:
+    // Seeds the generator, expanding the seed to the whole state with
+    // splitmix64
+    inline void seed(uint64_t value)
+    {
+        for (size_t index = 0; index < 4; index += 2)
+        {
+            value += 0x9e3779b97f4a7c15;
+            uint64_t mixed = value;
+            mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9;
+            mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111eb;
+            mixed = mixed ^ (mixed >> 31);
+            state[index] = static_cast<uint32_t>(mixed);
+            state[index + 1] = static_cast<uint32_t>(mixed >> 32);
+        }
+    }
+
+    // Returns the next random number
+    inline uint32_t next()
+    {
+        const uint32_t result = rotateLeft(state[1] * 5, 7) * 9;
+        const uint32_t shifted = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= shifted;
+        state[3] = rotateLeft(state[3], 11);
+        return result;
+    }
+
+private:
+    static inline uint32_t rotateLeft(uint32_t value, int bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    uint32_t state[4];
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Number of seconds of history kept unless configured otherwise.
+#define REWIND_DEFAULT_SECONDS 60
+
+// Number of frames between two keyframes unless configured otherwise.
+#define REWIND_DEFAULT_KEYFRAME_INTERVAL 60
+
+// This class keeps the last frames of a Chip8 in a ring buffer, so that the
+// interpreter can be taken back to any of them. Every few frames a keyframe
+// keeps a whole saved state. The frames in between keep the XOR of their
+// state against the keyframe before them, with its runs of zeros encoded by
+// length, which is a few bytes for most frames. Restoring a frame decodes a
+// single delta whatever its age, and rewinding drops the frames after it.
+class Rewind
+{
+public:
+    // Keeps up to frames frames, with a keyframe every keyframeInterval
+    // frames. A longer interval keeps less memory, but each delta grows with
+    // the distance to its keyframe.
+    explicit Rewind(
+        unsigned long frames = REWIND_DEFAULT_SECONDS * FRAME_RATE,
+        unsigned int keyframeInterval = REWIND_DEFAULT_KEYFRAME_INTERVAL);
+
+    // Records the current state of the interpreter as the newest frame,
+    // dropping the oldest one if the buffer is full. Returns the error of
+    // saveState, without recording anything, if the state cannot be saved.
+    ErrorCode record(const Chip8 &chip8);
+
+    // Restores the state recorded frames frames before the newest one, and
+    // drops the frames recorded after it. Zero restores the newest frame.
+    // Returns Error without changing anything if it is not kept anymore.
+    ErrorCode rewind(Chip8 &chip8, unsigned long frames);
+
+    // Drops all the frames.
+    void clear();
+
+    // Returns the number of frames that can be restored.
+    inline unsigned long getFrames() const { return count; }
+
+    // Returns the number of bytes held by the recorded frames.
+    size_t getMemoryUsage() const;
+
+private:
+    // A recorded frame: a saved state if it is a keyframe, or its delta
+    // against its keyframe otherwise.
+    struct Frame
+    {
+        std::vector<unsigned char> data;
+        unsigned long keyframe = 0;
+    };
+
+    // Returns the frame recorded with the given absolute number
+    inline Frame &frameAt(unsigned long number)
+    {
+        return ring[number % ring.size()];
+    }
+
+    // Encodes the XOR of state and keyframe into delta.
+    static void encode(const std::vector<unsigned char> &state,
+                       const std::vector<unsigned char> &keyframe,
+                       std::vector<unsigned char> &delta);
+
+    // Applies a delta to state, which holds its keyframe.
+    static void decode(const std::vector<unsigned char> &delta,
+                       std::vector<unsigned char> &state);
+
+    // Recorded frames, indexed by their absolute number.
+    std::vector<Frame> ring;
+
+    // Number of frames between keyframes.
+    unsigned int keyframeInterval;
+
+    // Absolute number of the next frame recorded, and number of frames kept
+    // before it.
+    unsigned long next = 0;
+    unsigned long count = 0;
+
+    // Absolute number of the keyframe the next deltas are encoded against,
+    // and its saved state.
+    unsigned long keyframe = 0;
+    std::vector<unsigned char> keyframeState;
+
+    // Scratch buffer for the state being recorded or restored.
+    std::vector<unsigned char> state;
+};
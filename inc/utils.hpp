@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
 #include <string>
 
 // This class provides general logging and debugging utilities
@@ -9,6 +13,15 @@ public:
     // Prints any value in hexadecimal human readable form
     template <typename T>
     static void printHexNumber(const std::string &description, T number);
+
+    // Hashes a block of bytes with FNV-1a. The result of a previous call can
+    // be passed as the seed to hash several blocks together.
+    static uint64_t hash(const void *data, size_t size,
+                         uint64_t seed = 0xcbf29ce484222325ull);
+
+    // Hashes a block of bytes eight at a time, which is several times faster
+    // than hash for blocks of kilobytes, such as saved states.
+    static uint64_t checksum(const void *data, size_t size);
 };
 
 template <typename T>
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Number of words of the observation of each environment: the display, one
+// row of pixels per word with the leftmost pixel in the most significant bit.
+#define OBSERVATION_WORDS DISPLAY_HEIGHT
+
+// Max number of bytes of the score read from memory.
+#define ENV_MAX_SCORE_BYTES 8
+
+// This class runs many interpreters as a vector of environments for
+// reinforcement learning, in the style of Gym: reset() starts every
+// environment on the program with its own seed, and step() presses the keys
+// chosen for each environment and emulates a number of frames on all of
+// them. The environments are split in even slices between a pool of threads
+// that is kept between steps.
+//
+// Observations are written into a contiguous buffer owned by the caller,
+// with OBSERVATION_WORDS words per environment. Each step only writes the
+// rows of the display that changed, so the buffer has to be left as the
+// environment wrote it between steps. Stepping does not allocate, other than
+// to copy a page of memory the first time an environment writes to it after
+// being reset.
+class VectorEnv
+{
+public:
+    // Creates count environments that write their observations into
+    // observations, which must hold count * OBSERVATION_WORDS words. Zero
+    // threads uses one per hardware thread.
+    VectorEnv(size_t count, uint64_t *observations, unsigned int threads = 0);
+    ~VectorEnv();
+
+    VectorEnv(const VectorEnv &) = delete;
+    VectorEnv &operator=(const VectorEnv &) = delete;
+
+    // Reads the program the environments run from a file or a buffer. It is
+    // loaded on the next reset.
+    ErrorCode loadProgram(const std::string &filename);
+    ErrorCode loadProgram(const unsigned char *program, size_t size);
+
+    // Sets the number of frames emulated on each step, one by default.
+    inline void setFrameSkip(unsigned int frames) { frameSkip = frames; }
+
+    // Sets the number of instructions emulated in each frame.
+    inline void setInstructionsPerFrame(unsigned int instructions)
+    {
+        instructionsPerFrame = instructions;
+    }
+
+    // Reads the score of each environment as the unsigned big endian number
+    // in the size bytes of memory starting at address. The reward of a step
+    // is the change of the score. A size of zero gives no rewards.
+    void setScore(unsigned short address, unsigned char size);
+
+    // Initializes every environment, seeds it with the matching entry of
+    // seeds, loads the program and writes the whole observation.
+    ErrorCode reset(const uint64_t *seeds);
+
+    // Does the same for a single environment.
+    ErrorCode reset(size_t index, uint64_t seed);
+
+    // Presses in every environment the keys of the matching entry of
+    // actions, one bit per key, and emulates the frames of a step. An
+    // environment where an instruction cannot be executed is done, and is
+    // not stepped again until it is reset.
+    void step(const uint16_t *actions);
+
+    // Returns the reward of each environment in the last step.
+    inline const int64_t *getRewards() const { return rewards.data(); }
+
+    // Returns whether each environment is done, one byte per environment.
+    inline const unsigned char *getDone() const { return done.data(); }
+
+    // Returns the number of environments.
+    inline size_t size() const { return machines.size(); }
+
+    // Returns the interpreter of an environment.
+    inline const Chip8 &getMachine(size_t index) const
+    {
+        return *machines[index];
+    }
+
+    // Returns the number of threads stepping the environments.
+    inline unsigned int getThreads() const { return threads.size() + 1; }
+
+private:
+    // Steps the environments in the slice of a thread.
+    void stepSlice(size_t slice);
+
+    // Writes the rows of the display of an environment that changed since
+    // they were last written.
+    void writeObservation(size_t index);
+
+    // Returns the score of an environment.
+    uint64_t readScore(size_t index) const;
+
+    // Waits for steps to run them, on the threads of the pool.
+    void loop(size_t slice);
+
+    // Interpreters of the environments, and their observations.
+    std::vector<std::unique_ptr<Chip8>> machines;
+    uint64_t *observations;
+
+    // Program loaded on reset.
+    std::vector<unsigned char> program;
+
+    // Outputs of the last step, and the score each environment had.
+    std::vector<int64_t> rewards;
+    std::vector<unsigned char> done;
+    std::vector<uint64_t> scores;
+
+    // Frames per step and instructions per frame.
+    unsigned int frameSkip = 1;
+    unsigned int instructionsPerFrame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+
+    // Location of the score in memory.
+    unsigned short scoreAddress = 0;
+    unsigned char scoreSize = 0;
+
+    // Actions of the step being run.
+    const uint16_t *actions = nullptr;
+
+    // Threads of the pool, besides the one calling step, and their
+    // synchronization: the number of the current step, the threads still
+    // running it, and whether the pool is being destroyed.
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    unsigned long generation = 0;
+    unsigned int running = 0;
+    bool stopping = false;
+};
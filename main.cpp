@@ -1,9 +1,584 @@
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
 
+#include "batchRunner.hpp"
 #include "chip8.hpp"
+#include "forkPool.hpp"
+#include "frameCapture.hpp"
+#include "lockstep.hpp"
+#include "profiler.hpp"
+#include "quirks.hpp"
+#include "random.hpp"
+#include "vectorEnv.hpp"
 
-int main(void)
+// Draws the rows of the display selected by rows in the terminal, moving the
+// cursor to each of them so that the rest of the terminal is left untouched.
+static void drawRows(const Chip8 &chip8, uint32_t rows)
 {
+    std::string output;
+    for (unsigned char row = 0; row < DISPLAY_HEIGHT; row++)
+    {
+        if ((rows >> row & 0x1) == 0)
+        {
+            continue;
+        }
+        output += "\033[" + std::to_string(row + 1) + ";1H";
+        for (unsigned char column = 0; column < DISPLAY_WIDTH; column++)
+        {
+            output += chip8.getPixel(column, row) ? "#" : " ";
+        }
+    }
+    output += "\033[" + std::to_string(DISPLAY_HEIGHT + 1) + ";1H";
+    std::cout << output << std::flush;
+}
+
+// Does the same for the extended display, where each row selected stands
+// for two rows of pixels drawn as one line of half blocks. A pixel is lit
+// if it is set in any plane.
+static void drawExtendedRows(const Chip8 &chip8, uint32_t rows)
+{
+    const char *blocks[] = {" ", "\u2580", "\u2584", "\u2588"};
+    std::string output;
+    for (unsigned char line = 0; line < EXTENDED_DISPLAY_HEIGHT / 2; line++)
+    {
+        if ((rows >> line & 0x1) == 0)
+        {
+            continue;
+        }
+        output += "\033[" + std::to_string(line + 1) + ";1H";
+        for (unsigned char column = 0; column < EXTENDED_DISPLAY_WIDTH;
+             column++)
+        {
+            const bool top = chip8.getPlanePixel(column, 2 * line) != 0;
+            const bool bottom = chip8.getPlanePixel(column, 2 * line + 1) != 0;
+            output += blocks[top | bottom << 1];
+        }
+    }
+    output += "\033[" + std::to_string(EXTENDED_DISPLAY_HEIGHT / 2 + 1) +
+              ";1H";
+    std::cout << output << std::flush;
+}
+
+// Options shared by the headless modes. Each mode sets the defaults of the
+// ones it uses before parsing its arguments.
+struct Options
+{
+    unsigned long cycles = 0;
+    unsigned long frames = 0;
+    unsigned int threads = 0;
+    uint64_t seed = 0;
+};
+
+// Reads the value of a numeric option into value, and moves index past it,
+// if the argument at index is the option. Throws if the value is not a
+// number.
+template <typename Value>
+static bool readOption(int argc, char *argv[], int &index, const char *name,
+                       Value &value, int base = 10)
+{
+    if (std::string(argv[index]) != name || index + 1 >= argc)
+    {
+        return false;
+    }
+    value = static_cast<Value>(std::stoull(argv[++index], nullptr, base));
+    return true;
+}
+
+// Parses the arguments of a mode from the first one after the mode itself.
+// The shared options are read into options, and any other argument is
+// handed to parseOther with its index, which it moves past the values it
+// reads. Returns false if parseOther does, or if a numeric option is not a
+// number.
+template <typename Parser>
+static bool parseOptions(int argc, char *argv[], int first, Options &options,
+                         Parser parseOther)
+{
+    try
+    {
+        for (int index = first; index < argc; index++)
+        {
+            if (!readOption(argc, argv, index, "--cycles", options.cycles) &&
+                !readOption(argc, argv, index, "--frames", options.frames) &&
+                !readOption(argc, argv, index, "--threads", options.threads) &&
+                !readOption(argc, argv, index, "--seed", options.seed, 0) &&
+                !parseOther(index))
+            {
+                return false;
+            }
+        }
+    }
+    catch (const std::exception &exception)
+    {
+        std::cout << "Error: invalid numeric option" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Runs the programs in the command line headless, and writes their results
+// to the standard output or to the selected file.
+static int runBatch(int argc, char *argv[])
+{
+    BatchRunner runner;
+    Options options;
+    options.cycles = 1000000;
+    std::string output;
+    const bool parsed = parseOptions(
+        argc, argv, 2, options,
+        [&](int &index)
+        {
+            const std::string argument = argv[index];
+            if (argument == "--output" && index + 1 < argc)
+            {
+                output = argv[++index];
+            }
+            else if (argument == "--quirks" && index + 1 < argc)
+            {
+                QuirkConfig quirks;
+                if (quirks.load(argv[++index]) != Ok)
+                {
+                    return false;
+                }
+                runner.setQuirkConfig(quirks);
+            }
+            else if (runner.addPath(argument) != Ok)
+            {
+                std::cout << "Error: " << argument
+                          << " is not a file or a directory" << std::endl;
+                return false;
+            }
+            return true;
+        });
+    if (!parsed)
+    {
+        return -1;
+    }
+
+    runner.setCycles(options.cycles);
+    runner.setFrames(options.frames);
+    runner.setThreads(options.threads);
+    runner.setSeed(options.seed);
+    runner.run();
+    if (output.empty())
+    {
+        runner.writeResults(std::cout);
+        return 0;
+    }
+
+    std::ofstream file(output);
+    if (!file.is_open())
+    {
+        std::cout << "Error opening file " << output << std::endl;
+        return -1;
+    }
+    runner.writeResults(file);
+    return 0;
+}
+
+// Runs many copies of one program in lockstep, and reports the throughput
+// and the lane occupancy of the engine.
+static int runLockstep(int argc, char *argv[])
+{
+    size_t lanes = 1024;
+    Options options;
+    options.cycles = 10000;
+    std::string filename;
+    if (!parseOptions(argc, argv, 2, options,
+                      [&](int &index)
+                      {
+                          if (!readOption(argc, argv, index, "--lanes", lanes))
+                          {
+                              filename = argv[index];
+                          }
+                          return true;
+                      }))
+    {
+        return -1;
+    }
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "Error opening file " << filename << std::endl;
+        return -1;
+    }
+    const std::vector<unsigned char> program(
+        (std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+
+    LockstepEngine engine(lanes);
+    if (engine.loadProgram(program.data(), program.size()) != Ok)
+    {
+        std::cout << "Error: program " + filename +
+                         " could not be loaded to memory"
+                  << std::endl;
+        return -1;
+    }
+    engine.seedRandom(options.seed);
+
+    const auto start = std::chrono::steady_clock::now();
+    engine.run(options.cycles);
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    const LockstepStatistics &statistics = engine.getStatistics();
+    std::cout << "Lanes: " << lanes << std::endl;
+    std::cout << "Steps: " << statistics.steps << std::endl;
+    std::cout << "Instructions: " << statistics.instructions << std::endl;
+    std::cout << "Instructions per second: "
+              << statistics.instructions / seconds << std::endl;
+    std::cout << "Lane occupancy: " << statistics.occupancy() << std::endl;
+    std::cout << "Vectorized instructions: "
+              << (statistics.instructions > 0
+                      ? static_cast<double>(statistics.vectorInstructions) /
+                            statistics.instructions
+                      : 0.0)
+              << std::endl;
+    return 0;
+}
+
+// Forks a program once per random sequence of inputs, runs the forks for a
+// number of frames on a pool of threads, and reports the throughput.
+static int runExplore(int argc, char *argv[])
+{
+    size_t forks = 4096;
+    unsigned long warmup = 60;
+    Options options;
+    options.frames = 60;
+    std::string filename;
+    if (!parseOptions(argc, argv, 2, options,
+                      [&](int &index)
+                      {
+                          if (!readOption(argc, argv, index, "--forks",
+                                          forks) &&
+                              !readOption(argc, argv, index, "--warmup",
+                                          warmup))
+                          {
+                              filename = argv[index];
+                          }
+                          return true;
+                      }))
+    {
+        return -1;
+    }
+
+    // The forks start from the state reached after the warmup frames
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.seedRandom(options.seed);
+    if (chip8.loadProgram(filename) != Ok)
+    {
+        std::cout << "Error: program " + filename +
+                         " could not be loaded to memory"
+                  << std::endl;
+        return -1;
+    }
+    chip8.runFrames(warmup);
+
+    // Each fork presses a random key, or none, in every frame
+    Random random;
+    random.seed(options.seed);
+    std::vector<std::vector<uint16_t>> inputs(forks);
+    for (std::vector<uint16_t> &sequence : inputs)
+    {
+        sequence.resize(options.frames);
+        for (uint16_t &keys : sequence)
+        {
+            const uint32_t key = random.next() % (NUM_KEYS + 1);
+            keys = key < NUM_KEYS ? 0x1 << key : 0x0000;
+        }
+    }
+
+    ForkPool pool(options.threads);
+    pool.explore(chip8, inputs, options.frames);
+    const ForkStatistics &statistics = pool.getStatistics();
+    std::cout << "Threads: " << pool.getThreads() << std::endl;
+    std::cout << "Forks: " << statistics.forks << std::endl;
+    std::cout << "Frames: " << statistics.frames << std::endl;
+    std::cout << "Steals: " << statistics.steals << std::endl;
+    std::cout << "Forks per second: " << statistics.forksPerSecond()
+              << std::endl;
+    std::cout << "Forks per second per core: "
+              << statistics.forksPerCoreSecond() << std::endl;
+    return 0;
+}
+
+// Steps many environments running one program with random actions, and
+// reports the environment frames emulated per second.
+static int runEnv(int argc, char *argv[])
+{
+    size_t envs = 1024;
+    unsigned long steps = 1000;
+    Options options;
+    std::string filename;
+    if (!parseOptions(argc, argv, 2, options,
+                      [&](int &index)
+                      {
+                          if (!readOption(argc, argv, index, "--envs", envs) &&
+                              !readOption(argc, argv, index, "--steps", steps))
+                          {
+                              filename = argv[index];
+                          }
+                          return true;
+                      }))
+    {
+        return -1;
+    }
+
+    std::vector<uint64_t> observations(envs * OBSERVATION_WORDS);
+    VectorEnv env(envs, observations.data(), options.threads);
+    if (env.loadProgram(filename) != Ok)
+    {
+        return -1;
+    }
+    std::vector<uint64_t> seeds(envs);
+    for (size_t index = 0; index < envs; index++)
+    {
+        seeds[index] = options.seed + index;
+    }
+    if (env.reset(seeds.data()) != Ok)
+    {
+        std::cout << "Error: program " + filename +
+                         " could not be loaded to memory"
+                  << std::endl;
+        return -1;
+    }
+
+    // Every environment presses a random key, or none, on each step
+    Random random;
+    random.seed(options.seed);
+    std::vector<uint16_t> actions(envs);
+    double seconds = 0.0;
+    for (unsigned long step = 0; step < steps; step++)
+    {
+        for (uint16_t &keys : actions)
+        {
+            const uint32_t key = random.next() % (NUM_KEYS + 1);
+            keys = key < NUM_KEYS ? 0x1 << key : 0x0000;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        env.step(actions.data());
+        seconds += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    }
+
+    std::cout << "Threads: " << env.getThreads() << std::endl;
+    std::cout << "Environments: " << envs << std::endl;
+    std::cout << "Steps: " << steps << std::endl;
+    std::cout << "Frames per second: " << envs * steps / seconds
+              << std::endl;
+    return 0;
+}
+
+// Runs a program with the profiler enabled, and prints its report when the
+// run ends.
+static int runProfile(int argc, char *argv[])
+{
+    Options options;
+    options.cycles = 1000000;
+    std::string json;
+    std::string filename;
+    if (!parseOptions(argc, argv, 2, options,
+                      [&](int &index)
+                      {
+                          const std::string argument = argv[index];
+                          if (argument == "--json" && index + 1 < argc)
+                          {
+                              json = argv[++index];
+                          }
+                          else
+                          {
+                              filename = argument;
+                          }
+                          return true;
+                      }))
+    {
+        return -1;
+    }
+
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    if (chip8.setProfiling(true) != Ok)
+    {
+        std::cout << "Error: the profiler is not available, build with "
+                     "PROFILE=1"
+                  << std::endl;
+        return -1;
+    }
+    if (chip8.loadProgram(filename) != Ok)
+    {
+        std::cout << "Error: program " + filename +
+                         " could not be loaded to memory"
+                  << std::endl;
+        return -1;
+    }
+
+    // Run until the cycles are over or an instruction stops the program
+    chip8.setPredecode(true);
+    const RunResult result = chip8.runCycles(options.cycles);
+    if (result.reason != BudgetExhausted)
+    {
+        std::cout << "Program stopped at cycle " << result.cycles << std::endl;
+    }
+
+    chip8.getProfiler()->writeReport(std::cout);
+    if (!json.empty())
+    {
+        std::ofstream file(json);
+        if (!file.is_open())
+        {
+            std::cout << "Error opening file " << json << std::endl;
+            return -1;
+        }
+        chip8.getProfiler()->writeJson(file);
+    }
+    return 0;
+}
+
+// Runs a program headless for a number of frames, recording them to a
+// video stream, and reports the frames written and dropped.
+static int runRecord(int argc, char *argv[])
+{
+    Options options;
+    options.frames = 600;
+    unsigned int scale = 1;
+    CaptureFormat format = Y4mFormat;
+    bool repeatTags = true;
+    bool realTime = false;
+    bool extended = false;
+    std::string output = "capture.y4m";
+    std::string filename;
+    const bool parsed = parseOptions(
+        argc, argv, 2, options,
+        [&](int &index)
+        {
+            const std::string argument = argv[index];
+            if (argument == "--output" && index + 1 < argc)
+            {
+                output = argv[++index];
+            }
+            else if (argument == "--raw")
+            {
+                format = RawFormat;
+            }
+            else if (argument == "--no-xrepeat")
+            {
+                repeatTags = false;
+            }
+            else if (argument == "--realtime")
+            {
+                realTime = true;
+            }
+            else if (argument == "--extended")
+            {
+                extended = true;
+            }
+            else if (!readOption(argc, argv, index, "--scale", scale))
+            {
+                filename = argument;
+            }
+            return true;
+        });
+    if (!parsed)
+    {
+        return -1;
+    }
+
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.setExtended(extended);
+    chip8.initialize();
+    if (chip8.loadProgram(filename) != Ok)
+    {
+        std::cout << "Error: program " + filename +
+                         " could not be loaded to memory"
+                  << std::endl;
+        return -1;
+    }
+
+    FrameCapture capture;
+    capture.setScale(scale);
+    capture.setRepeatTags(repeatTags);
+    if (capture.open(output, format) != Ok)
+    {
+        return -1;
+    }
+    chip8.setCapture(&capture);
+    chip8.setPredecode(true);
+    chip8.setRealTime(realTime);
+    const ErrorCode error = chip8.runFrames(options.frames);
+    chip8.setCapture(nullptr);
+    if (capture.close() != Ok)
+    {
+        std::cout << "Error writing to " << output << std::endl;
+        return -1;
+    }
+    if (error != Ok)
+    {
+        std::cout << "Program stopped at frame " << chip8.getFrames()
+                  << std::endl;
+    }
+
+    // The report goes to the standard error when the video goes to the
+    // standard output
+    const CaptureStatistics statistics = capture.getStatistics();
+    std::ostream &report = output == "-" ? std::cerr : std::cout;
+    report << "Frames captured: " << statistics.captured << std::endl;
+    report << "Frames repeated: " << statistics.repeated << std::endl;
+    report << "Frames dropped: " << statistics.dropped << std::endl;
+    report << "Frames written: " << statistics.written << std::endl;
+    report << "Bytes written: " << statistics.bytes << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // Usage: chip8 [--ipf N] [--quirks FILE] [--extended] [program]
+    //        chip8 --batch [--cycles N] [--frames N] [--threads T]
+    //              [--seed S] [--output FILE] [--quirks FILE]
+    //              <programs or directories...>
+    //        chip8 --lockstep [--lanes N] [--cycles N] [--seed S] <program>
+    //        chip8 --explore [--forks N] [--frames N] [--warmup N]
+    //              [--threads T] [--seed S] <program>
+    //        chip8 --env [--envs N] [--steps N] [--threads T] [--seed S]
+    //              <program>
+    //        chip8 --profile [--cycles N] [--json FILE] <program>
+    //        chip8 --record [--frames N] [--scale N] [--output FILE]
+    //              [--raw] [--no-xrepeat] [--realtime] [--extended]
+    //              <program>
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+    {
+        return runBatch(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--lockstep")
+    {
+        return runLockstep(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--explore")
+    {
+        return runExplore(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--env")
+    {
+        return runEnv(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--profile")
+    {
+        return runProfile(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--record")
+    {
+        return runRecord(argc, argv);
+    }
+
     // Create a new instance of the chip 8 interpreter and initialize it
     Chip8 chip8;
     if (chip8.initialize() != Ok)
@@ -20,9 +595,42 @@ int main(void)
 
     // TODO: initialize the graphics
 
-    // Load the program to the interpreter memory
+    // Select the program, the instructions executed in each frame, the
+    // quirks of the programs and the extended mode
     std::string filename = "./games/15PUZZLE";
-    if (chip8.loadProgram(filename) != Ok)
+    QuirkConfig quirks;
+    unsigned int instructions = chip8.getInstructionsPerFrame();
+    Options options;
+    const bool parsed = parseOptions(
+        argc, argv, 1, options,
+        [&](int &index)
+        {
+            const std::string argument = argv[index];
+            if (argument == "--quirks" && index + 1 < argc)
+            {
+                if (quirks.load(argv[++index]) != Ok)
+                {
+                    return false;
+                }
+            }
+            else if (argument == "--extended")
+            {
+                chip8.setExtended(true);
+            }
+            else if (!readOption(argc, argv, index, "--ipf", instructions))
+            {
+                filename = argument;
+            }
+            return true;
+        });
+    if (!parsed)
+    {
+        return -1;
+    }
+    chip8.setInstructionsPerFrame(instructions);
+
+    // Load the program to the interpreter memory
+    if (chip8.loadProgram(filename, quirks) != Ok)
     {
         std::cout << "Error: program " + filename +
                          " could not be loaded to memory"
@@ -35,19 +643,30 @@ int main(void)
                   << std::endl;
     }
 
-    // Loop forever
+    // Loop forever, on a clear terminal where the display is drawn
     std::cout << "Beginning execution..." << std::endl;
+    std::cout << "\033[2J" << std::flush;
+    chip8.setRealTime(true);
     while (true)
     {
-        // Execute the next cycle in the chip 8 interpreter
-        if (chip8.executeCycle() != Ok)
+        // Execute the next frame in the chip 8 interpreter
+        if (chip8.runFrame() != Ok)
         {
             std::cout << "Error: cycle execution went wrong" << std::endl;
             std::cout << "Error: quitting the application now" << std::endl;
             return -1;
         }
 
-        // TODO: update the display if necessary
+        // Update the display if necessary, redrawing only the rows that
+        // changed during the frame
+        if (chip8.isDisplayChanged() && chip8.isExtended())
+        {
+            drawExtendedRows(chip8, chip8.takeDirtyRows());
+        }
+        else if (chip8.isDisplayChanged())
+        {
+            drawRows(chip8, chip8.takeDirtyRows());
+        }
     }
 
     return 0;
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <thread>
+
+#include "batchRunner.hpp"
+#include "utils.hpp"
+
+namespace
+{
+// Returns the name of an error in the results
+const char *errorName(ErrorCode error)
+{
+    switch (error)
+    {
+    case Ok:
+        return "ok";
+    case Error:
+        return "error";
+    case FileOpenError:
+        return "file_open_error";
+    case NotEnoughMemory:
+        return "not_enough_memory";
+    case UnknownOpcodeError:
+        return "unknown_opcode";
+    case StackOverflowError:
+        return "stack_overflow";
+    case StackUnderflowError:
+        return "stack_underflow";
+    case KeyWaitPending:
+        return "waiting_on_key";
+    case InvalidState:
+        return "invalid_state";
+    }
+    return "error";
+}
+
+// Returns the name of the reason a program stopped in the results
+const char *reasonName(StopReason reason)
+{
+    switch (reason)
+    {
+    case BudgetExhausted:
+        return "ok";
+    case UnknownOpcode:
+        return "unknown_opcode";
+    case StackOverflow:
+        return "stack_overflow";
+    case StackUnderflow:
+        return "stack_underflow";
+    case WaitingOnKey:
+        return "waiting_on_key";
+    case Breakpoint:
+        return "breakpoint";
+    case ConditionMet:
+        return "condition_met";
+    }
+    return "error";
+}
+} // namespace
+
+ErrorCode BatchRunner::addPath(const std::string &path)
+{
+    std::error_code error;
+    if (std::filesystem::is_directory(path, error))
+    {
+        // Add the files in a stable order, so that results can be compared
+        // between runs
+        std::vector<std::string> files;
+        for (const auto &entry :
+             std::filesystem::directory_iterator(path, error))
+        {
+            if (entry.is_regular_file())
+            {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        roms.insert(roms.end(), files.begin(), files.end());
+        return Ok;
+    }
+    if (std::filesystem::is_regular_file(path, error))
+    {
+        roms.push_back(path);
+        return Ok;
+    }
+    return FileOpenError;
+}
+
+const std::vector<BatchResult> &BatchRunner::run()
+{
+    results.assign(roms.size(), BatchResult());
+    for (size_t index = 0; index < roms.size(); index++)
+    {
+        results[index].rom = roms[index];
+    }
+
+    unsigned int workers =
+        threads > 0 ? threads : std::thread::hardware_concurrency();
+    workers = std::max(1u, std::min<unsigned int>(workers, roms.size()));
+
+    // Each worker keeps an interpreter of its own and takes the next program
+    // until there are none left. Results are written to separate slots, so
+    // no locking is needed.
+    std::atomic<size_t> next(0);
+    auto worker = [this, &next]()
+    {
+        Chip8 chip8;
+        chip8.setLogging(false);
+        chip8.setPredecode(true);
+        for (size_t index = next++; index < results.size(); index = next++)
+        {
+            runProgram(chip8, results[index]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int index = 1; index < workers; index++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : pool)
+    {
+        thread.join();
+    }
+
+    return results;
+}
+
+void BatchRunner::runProgram(Chip8 &chip8, BatchResult &result) const
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    chip8.initialize();
+    chip8.seedRandom(Utils::hash(result.rom.data(), result.rom.size(), seed));
+    chip8.setQuirks(quirkConfig.find(result.rom));
+
+    std::ifstream file(result.rom, std::ios::binary);
+    const std::vector<unsigned char> program(
+        (std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+    if (!file.is_open())
+    {
+        result.error = FileOpenError;
+    }
+    else
+    {
+        result.error = chip8.loadProgram(program.data(), program.size());
+    }
+
+    if (result.error == Ok && frames > 0)
+    {
+        // Only the reason of a frame that failed stops the run
+        RunResult run = {BudgetExhausted, 0};
+        if (chip8.runFrames(frames, &run) == Ok)
+        {
+            run.reason = BudgetExhausted;
+        }
+        result.reason = run.reason;
+        result.cycles = run.cycles;
+        result.frames = chip8.getFrames();
+    }
+    else if (result.error == Ok)
+    {
+        const RunResult run = chip8.runCycles(cycles);
+        result.reason = run.reason;
+        result.cycles = run.cycles;
+    }
+
+    result.pc = chip8.getPc();
+    result.stateHash = chip8.hashState();
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+}
+
+void BatchRunner::writeResults(std::ostream &output) const
+{
+    // A program that could be loaded reports why it stopped
+    std::ios_base::fmtflags f(output.flags());
+    output << "rom,cycles,frames,error,pc,state_hash,seconds" << std::endl;
+    for (const BatchResult &result : results)
+    {
+        output << result.rom << "," << std::dec << result.cycles << ","
+               << result.frames << ","
+               << (result.error != Ok ? errorName(result.error)
+                                      : reasonName(result.reason))
+               << ",0x" << std::hex
+               << std::setfill('0') << std::setw(4) << result.pc << ",0x"
+               << std::setw(16) << result.stateHash << "," << std::dec
+               << std::fixed << std::setprecision(6) << result.seconds
+               << std::endl;
+    }
+    output.flags(f);
+}
@@ -0,0 +1,56 @@
+#include "blockCache.hpp"
+
+const BasicBlock &BlockCache::getBlock(const Chip8 &chip8,
+                                       unsigned short address)
+{
+    BasicBlock &block = blocks[address];
+    if (!block.valid)
+    {
+        compile(chip8, address, block);
+    }
+    return block;
+}
+
+void BlockCache::invalidate(unsigned short index, unsigned short count)
+{
+    // Only blocks starting less than a whole block before the written bytes
+    // can overlap them
+    const unsigned short maxBlockBytes = 2 * MAX_BLOCK_LENGTH;
+    const unsigned short first =
+        index > maxBlockBytes ? index - maxBlockBytes : 0;
+    for (unsigned short address = first;
+         address < index + count && address < NUM_BYTES_MEMORY; address++)
+    {
+        BasicBlock &block = blocks[address];
+        if (block.valid && block.end > index)
+        {
+            block.valid = false;
+            statistics.invalidated++;
+        }
+    }
+}
+
+void BlockCache::compile(const Chip8 &chip8, unsigned short address,
+                         BasicBlock &block)
+{
+    // Decode instructions until one of them ends the block, the block is
+    // full or the end of memory is reached
+    block.instructions.clear();
+    while (block.instructions.size() < MAX_BLOCK_LENGTH &&
+           address + 1 < NUM_BYTES_MEMORY)
+    {
+        const Chip8::Instruction instruction = Chip8::decode(
+            chip8.getMemory(address) << 8 | chip8.getMemory(address + 1),
+            chip8.getHandlerSet());
+        block.instructions.push_back(instruction);
+        address += 2;
+        if (Chip8::endsBlock(instruction))
+        {
+            break;
+        }
+    }
+
+    block.end = address;
+    block.valid = true;
+    statistics.compiled++;
+}
@@ -1,53 +1,198 @@
-#include <climits>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
-#include <functional>
 #include <iostream>
 #include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
 
+#include "blockCache.hpp"
 #include "chip8.hpp"
+#include "frameCapture.hpp"
+#include "jit.hpp"
+#include "profiler.hpp"
+#include "quirks.hpp"
 #include "utils.hpp"
 
-ErrorCode Chip8::initialize()
+namespace
+{
+// Sprites of the hexadecimal digits, 0 to F, that Fx29 points I to.
+const std::array<unsigned char, 16 * FONT_CHARACTER_SIZE> font = {
+    0xf0, 0x90, 0x90, 0x90, 0xf0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xf0, 0x10, 0xf0, 0x80, 0xf0, // 2
+    0xf0, 0x10, 0xf0, 0x10, 0xf0, // 3
+    0x90, 0x90, 0xf0, 0x10, 0x10, // 4
+    0xf0, 0x80, 0xf0, 0x10, 0xf0, // 5
+    0xf0, 0x80, 0xf0, 0x90, 0xf0, // 6
+    0xf0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xf0, 0x90, 0xf0, 0x90, 0xf0, // 8
+    0xf0, 0x90, 0xf0, 0x10, 0xf0, // 9
+    0xf0, 0x90, 0xf0, 0x90, 0x90, // A
+    0xe0, 0x90, 0xe0, 0x90, 0xe0, // B
+    0xf0, 0x80, 0x80, 0x80, 0xf0, // C
+    0xe0, 0x90, 0x90, 0x90, 0xe0, // D
+    0xf0, 0x80, 0xf0, 0x80, 0xf0, // E
+    0xf0, 0x80, 0xf0, 0x80, 0x80  // F
+};
+
+// Sprites of the large hexadecimal digits of the extended mode, 8x10 pixels,
+// that Fx30 points I to.
+const std::array<unsigned char, 16 * LARGE_FONT_CHARACTER_SIZE> largeFont = {
+    0xff, 0xff, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xff, 0xff, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xff, 0xff, // 1
+    0xff, 0xff, 0x03, 0x03, 0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, // 2
+    0xff, 0xff, 0x03, 0x03, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, // 3
+    0xc3, 0xc3, 0xc3, 0xc3, 0xff, 0xff, 0x03, 0x03, 0x03, 0x03, // 4
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, // 5
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, // 6
+    0xff, 0xff, 0x03, 0x03, 0x06, 0x0c, 0x18, 0x18, 0x18, 0x18, // 7
+    0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, // 8
+    0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, // 9
+    0x7e, 0xff, 0xc3, 0xc3, 0xc3, 0xff, 0xff, 0xc3, 0xc3, 0xc3, // A
+    0xfc, 0xfc, 0xc3, 0xc3, 0xfc, 0xfc, 0xc3, 0xc3, 0xfc, 0xfc, // B
+    0x3c, 0xff, 0xc3, 0xc0, 0xc0, 0xc0, 0xc0, 0xc3, 0xff, 0x3c, // C
+    0xfc, 0xfe, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xfe, 0xfc, // D
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, // E
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc0, 0xc0, 0xc0, 0xc0  // F
+};
+
+static_assert(LARGE_FONT_START + largeFont.size() <= START_AVAILABLE_MEMORY,
+              "the large font fits in the memory reserved to the interpreter");
+
+// Shifts a row of an extended plane right or left by count pixels, which
+// takes two vector shifts and the shuffle that carries the bits crossing
+// from one word to the other.
+inline PlaneRow shiftRight(PlaneRow row, unsigned int count)
 {
-    // Memory
-    for (size_t i = 0; i < NUM_BYTES_MEMORY; i++)
+    const PlaneRow zero = {0, 0};
+    if (count >= 64)
+    {
+        return __builtin_shuffle(row, zero, PlaneRow{2, 0}) >> (count - 64);
+    }
+    if (count == 0)
     {
-        memory[i] = 0x00;
+        return row;
     }
+    return row >> count |
+           __builtin_shuffle(row, zero, PlaneRow{2, 0}) << (64 - count);
+}
 
-    // General purpose registers
-    for (size_t i = 0; i < NUM_REGISTERS; i++)
+inline PlaneRow shiftLeft(PlaneRow row, unsigned int count)
+{
+    const PlaneRow zero = {0, 0};
+    if (count >= 64)
+    {
+        return __builtin_shuffle(row, zero, PlaneRow{1, 2}) << (count - 64);
+    }
+    if (count == 0)
     {
-        v[i] = 0x00;
+        return row;
     }
+    return row << count |
+           __builtin_shuffle(row, zero, PlaneRow{1, 2}) >> (64 - count);
+}
+
+// Doubles every pixel of a sprite row of up to 16 pixels in the low 16 bits,
+// for the low resolution of the extended display.
+inline uint32_t doublePixels(uint32_t bits)
+{
+    bits = (bits | bits << 8) & 0x00ff00ffu;
+    bits = (bits | bits << 4) & 0x0f0f0f0fu;
+    bits = (bits | bits << 2) & 0x33333333u;
+    bits = (bits | bits << 1) & 0x55555555u;
+    return bits | bits << 1;
+}
+
+// Identifies a saved state, and the version of its layout. Increase the
+// version whenever the layout of SavedState changes.
+const char STATE_MAGIC[4] = {'C', '8', 'S', 'T'};
+const uint32_t STATE_VERSION = 5;
 
-    // The stack.
-    for (size_t i = 0; i < SIZE_STACK; i++)
+// Header of a saved state, followed by the state itself.
+struct StateHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved;
+    uint64_t checksum;
+};
+
+// Layout of a saved state, with the largest fields first and the registers
+// on a cache line boundary so that there is no padding between them.
+struct SavedState
+{
+    std::array<unsigned char, NUM_BYTES_MEMORY> memory;
+    std::array<uint64_t, DISPLAY_HEIGHT> display;
+    Chip8::Registers registers;
+    uint64_t frames;
+    Random random;
+    uint64_t quirks;
+    std::array<uint64_t, 4> reserved;
+};
+static_assert(std::is_trivially_copyable<SavedState>::value &&
+                  std::has_unique_object_representations<SavedState>::value,
+              "a saved state is copied as raw bytes, without padding");
+} // namespace
+
+Chip8::Chip8() = default;
+
+Chip8::~Chip8() = default;
+
+ErrorCode Chip8::initialize()
+{
+    // Memory, with the font in the area reserved to the interpreter
+    memory.clear();
+    memory.load(FONT_START, font.data(), font.size());
+    if (extended != nullptr)
     {
-        stack[i] = 0x0000;
+        resetExtended();
     }
 
-    // Other registers.
-    i = 0x0000;
-    dtr = 0x00;
-    str = 0x00;
-    pc = START_AVAILABLE_MEMORY;
-    sp = 0x00;
+    // Display, which has to be drawn whole by a front end
+    display.fill(0);
+    frames = 0;
+    elidedCycles = 0;
+    idleJump = false;
+
+    // Registers, stack and keys, all of them zero except for the PC
+    std::memset(&registers, 0, sizeof(registers));
+    registers.pc = START_AVAILABLE_MEMORY;
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+
+    // Seed the generator of random numbers once for the whole run
+    std::random_device device;
+    random.seed(static_cast<uint64_t>(device()) << 32 | device());
+
+    invalidateCode(0, NUM_BYTES_MEMORY);
 
     return Ok;
 }
 
+void Chip8::seedRandom(uint64_t seed)
+{
+    random.seed(seed);
+}
+
 ErrorCode Chip8::loadProgram(const std::string &filename)
 {
     // Check the size of the file does not exceed the interpreter memory
     size_t fileSizeBytes = std::filesystem::file_size(filename);
-    if (fileSizeBytes > NUM_BYTES_MEMORY - START_AVAILABLE_MEMORY)
+    if (fileSizeBytes > getProgramCapacity())
     {
-        std::cout
-            << "Error: the program file is too big to be loaded inside the "
-               "interpreter's memory"
-            << std::endl;
+        if (logging)
+        {
+            std::cout
+                << "Error: the program file is too big to be loaded inside "
+                   "the interpreter's memory"
+                << std::endl;
+        }
         return NotEnoughMemory;
     }
 
@@ -56,272 +201,1696 @@ ErrorCode Chip8::loadProgram(const std::string &filename)
     inputFile.open(filename, std::ios::binary | std::ios::in);
     if (!inputFile.is_open())
     {
-        std::cout << "Error opening file " << filename << std::endl;
+        if (logging)
+        {
+            std::cout << "Error opening file " << filename << std::endl;
+        }
         return FileOpenError;
     }
 
     // Read the file contents into memory.
-    inputFile.read((char *)&memory[START_AVAILABLE_MEMORY], fileSizeBytes);
+    std::vector<unsigned char> program(fileSizeBytes);
+    inputFile.read(reinterpret_cast<char *>(program.data()), fileSizeBytes);
+    storeProgram(program.data(), program.size());
 
     // Debug the memory contents.
-    std::cout << "Current contents of the interpreter's memory:" << std::endl;
-    for (size_t i = START_AVAILABLE_MEMORY;
-         i < START_AVAILABLE_MEMORY + fileSizeBytes; i = i + 2)
+    if (logging)
     {
-        Utils::printHexNumber(
-            "Position " + std::to_string(i),
-            *(reinterpret_cast<unsigned short *>(&memory[i])));
+        std::cout << "Current contents of the interpreter's memory:"
+                  << std::endl;
+        for (size_t address = START_AVAILABLE_MEMORY;
+             address < START_AVAILABLE_MEMORY + fileSizeBytes;
+             address = address + 2)
+        {
+            Utils::printHexNumber(
+                "Position " + std::to_string(address),
+                static_cast<unsigned short>(readData(address) |
+                                            readData(address + 1) << 8));
+        }
     }
 
     return Ok;
 }
 
-ErrorCode Chip8::executeCycle()
+ErrorCode Chip8::loadProgram(const std::string &filename,
+                             const QuirkConfig &config)
 {
-    // Get the new opcode from memory
-    unsigned short opcode = memory[pc] << 8 | memory[pc + 1];
+    setQuirks(config.find(filename));
+    return loadProgram(filename);
+}
 
-    // Execute instruction
-    if (executeInstruction(opcode) != Ok)
+void Chip8::setQuirks(unsigned char quirks)
+{
+    if (quirks % NUM_QUIRK_SETS != this->quirks)
     {
-        std::cout << "Error: instruction could not be executed" << std::endl;
-        return Error;
+        this->quirks = quirks % NUM_QUIRK_SETS;
+        invalidateCode(0, NUM_BYTES_MEMORY);
+    }
+}
+
+void Chip8::setExtended(bool enabled)
+{
+    if (enabled == (extended != nullptr))
+    {
+        return;
+    }
+    if (enabled)
+    {
+        extended = std::make_unique<Extended>();
+        resetExtended();
+    }
+    else
+    {
+        extended.reset();
+    }
+
+    // The code was decoded for the other mode, and the display to draw
+    // changes
+    invalidateCode(0, NUM_BYTES_MEMORY);
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+}
+
+void Chip8::resetExtended()
+{
+    for (auto &plane : extended->planes)
+    {
+        plane.fill(PlaneRow{0, 0});
+    }
+    extended->memory.fill(0);
+    extended->flags.fill(0);
+    extended->selectedPlanes = 0x1;
+    extended->highResolution = false;
+    memory.load(LARGE_FONT_START, largeFont.data(), largeFont.size());
+}
+
+void Chip8::storeProgram(const unsigned char *program, size_t size)
+{
+    // The part of the program past the classic memory goes to the extended
+    // one
+    const size_t classic =
+        std::min<size_t>(size, NUM_BYTES_MEMORY - START_AVAILABLE_MEMORY);
+    memory.load(START_AVAILABLE_MEMORY, program, classic);
+    invalidateCode(START_AVAILABLE_MEMORY, classic);
+    if (size > classic)
+    {
+        std::copy(program + classic, program + size, extended->memory.begin());
+    }
+}
+
+ErrorCode Chip8::loadProgram(const unsigned char *program, size_t size)
+{
+    // Check the size of the program does not exceed the interpreter memory
+    if (size > getProgramCapacity())
+    {
+        if (logging)
+        {
+            std::cout << "Error: the program is too big to be loaded inside "
+                         "the interpreter's memory"
+                      << std::endl;
+        }
+        return NotEnoughMemory;
     }
 
+    // Copy the program into memory.
+    storeProgram(program, size);
+
     return Ok;
 }
 
-ErrorCode Chip8::executeInstruction(const unsigned short &instruction)
+ErrorCode Chip8::step()
 {
-    // Get the indices of the x and y register indices involved from opcode
-    // TODO: remove this from here, maybe move math to a sub function
-    unsigned char xRegister = instruction >> 8 & 0x0f;
-    unsigned char yRegister = instruction >> 4 & 0x0f;
+#ifdef CHIP8_PROFILE
+    const unsigned short address = registers.pc;
+    const unsigned short fetched =
+        memory[registers.pc] << 8 | memory[registers.pc + 1];
+    const unsigned char depth = registers.sp;
+#endif
 
-    // Select the operation and perform it
-    if (instruction == 0x00ee)
+    ErrorCode result;
+    if (decoded != nullptr)
     {
-        // 00EE - RET.
-        // Return from a subroutine
-        pc = stack[sp];
-        sp--;
+        // Decode the instruction only if it is not in the cache yet. The pc
+        // wraps around at the end of memory, as the memory itself does.
+        Instruction &instruction = (*decoded)[registers.pc % NUM_BYTES_MEMORY];
+        if (instruction.handler == nullptr)
+        {
+            instruction =
+                decode(memory[registers.pc] << 8 | memory[registers.pc + 1],
+                       getHandlerSet());
+        }
+        result = instruction.handler(*this, instruction);
+    }
+    else
+    {
+        // Get the new opcode from memory
+        unsigned short opcode =
+            memory[registers.pc] << 8 | memory[registers.pc + 1];
+        result = executeInstruction(opcode);
     }
-    else if (instruction >> 12 == 0x1)
+
+#ifdef CHIP8_PROFILE
+    if (profiler != nullptr && result == Ok)
     {
-        // 1nnn - JP addr
-        // Jump to location nnn.
-        pc = instruction & 0x0fff;
+        profiler->record(address, fetched, depth, registers.pc);
     }
-    else if (instruction >> 12 == 0x2)
+#endif
+
+    return result;
+}
+
+ErrorCode Chip8::executeCycle()
+{
+    const ErrorCode result = step();
+    return result == Ok ? Ok : reportResult(result);
+}
+
+ErrorCode Chip8::reportResult(ErrorCode result) const
+{
+    if (result == Ok || result == KeyWaitPending)
     {
-        // 2nnn - CALL addr
-        // Call subroutine at nnn.
-        sp++;
-        stack[sp] = pc;
-        pc = instruction & 0xfff;
+        return Ok;
     }
-    else if (instruction >> 12 == 0x3)
+
+    // The instruction could not be executed
+    if (logging)
     {
-        // 3xkk - SE Vx, byte
-        // Skip next instruction if Vx = kk.
-        unsigned char registerIndex = (instruction >> 8) & 0x0f;
-        const size_t step = v[registerIndex] == (instruction & 0xff) ? 4 : 2;
-        pc += step;
+        std::cout << "Error: instruction could not be executed" << std::endl;
     }
-    else if (instruction >> 12 == 0x4)
+    return Error;
+}
+
+RunResult Chip8::runCycles(unsigned long count)
+{
+    return breakpoints.none() ? run<false>(count) : run<true>(count);
+}
+
+template <bool CheckBreakpoints>
+RunResult Chip8::run(unsigned long count)
+{
+    RunResult result = {BudgetExhausted, 0};
+    while (result.cycles < count)
     {
-        // 4xkk - SNE Vx, byte
-        // Skip next instruction if Vx != kk.
-        unsigned char registerIndex = (instruction >> 8) & 0x0f;
-        const size_t step = v[registerIndex] != (instruction & 0xff) ? 4 : 2;
-        pc += step;
+        // The pc wraps around as the memory does
+        if (CheckBreakpoints && result.cycles > 0 &&
+            breakpoints[registers.pc % NUM_BYTES_MEMORY])
+        {
+            result.reason = Breakpoint;
+            return result;
+        }
+        const ErrorCode error = step();
+        if (error != Ok)
+        {
+            result.reason = toStopReason(error);
+            return result;
+        }
+        result.cycles++;
+
+        // Nothing changes while the program spins, so the iterations left
+        // before the budget runs out are skipped. A breakpoint may be inside
+        // the loop, so they are only skipped when there is none.
+        if (!CheckBreakpoints && idleJump)
+        {
+            idleJump = false;
+            result.cycles += skipIdleLoop(count - result.cycles);
+        }
     }
-    else if (instruction >> 12 == 0x5)
+    return result;
+}
+
+unsigned int Chip8::idleLoopLength() const
+{
+    const unsigned short pc = registers.pc;
+    if (pc + 6 > NUM_BYTES_MEMORY)
     {
-        // 5xy0 - SE Vx, Vy
-        // Skip next instruction if Vx = Vy.
-        unsigned char registerIndex1 = (instruction >> 8) & 0xf;
-        unsigned char registerIndex2 = (instruction >> 4) & 0xf;
-        const size_t step = v[registerIndex1] == v[registerIndex2] ? 4 : 2;
-        pc += step;
+        return 0;
     }
-    else if (instruction >> 12 == 0x6)
+    const unsigned short first = memory[pc] << 8 | memory[pc + 1];
+    const unsigned short second = memory[pc + 2] << 8 | memory[pc + 3];
+    const unsigned short third = memory[pc + 4] << 8 | memory[pc + 5];
+    const unsigned short jump = 0x1000 | pc;
+    const unsigned char x = first >> 8 & 0x0f;
+
+    // Ex9E or ExA1, and a jump back to it, spin while the key does not
+    // change
+    if (second == jump && (first & 0xf0ff) == 0xe09e)
     {
-        // 6xkk - LD Vx, byte
-        // Set Vx = kk
-        v[(instruction >> 8) & 0xf] = (instruction & 0xff);
-        pc += 2;
+        return isKeyPressed(registers.v[x]) ? 0 : 2;
     }
-    else if (instruction >> 12 == 0x7)
+    if (second == jump && (first & 0xf0ff) == 0xe0a1)
     {
-        // 7xkk - ADD Vx, byte
-        // Set Vx = Vx + kk
-        const unsigned char index = (instruction >> 8) & 0xf;
-        v[index] = v[index] + (instruction & 0xff);
-        pc += 2;
+        return isKeyPressed(registers.v[x]) ? 2 : 0;
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x0))
+
+    // Fx07, 3xkk or 4xkk on the same register, and a jump back to Fx07, spin
+    // while the delay timer does not change
+    if (third == jump && (first & 0xf0ff) == 0xf007 &&
+        (second >> 8 & 0x0f) == x)
     {
-        // 8xy0 - LD Vx, Vy
-        // Set Vx = Vy.
-        v[(instruction >> 8) & 0xf] = v[(instruction >> 4) & 0xf];
-        pc += 2;
+        const unsigned char kk = second & 0xff;
+        if (second >> 12 == 0x3)
+        {
+            return getDelayTimer() != kk ? 3 : 0;
+        }
+        if (second >> 12 == 0x4)
+        {
+            return getDelayTimer() == kk ? 3 : 0;
+        }
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x1))
+    return 0;
+}
+
+unsigned long Chip8::skipIdleLoop(unsigned long budget)
+{
+    if (!idleSkipping || isProfilingEnabled())
     {
-        // OR operation
-        v[xRegister] = v[xRegister] | v[yRegister];
-        pc += 2;
+        return 0;
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x2))
+    const unsigned int length = idleLoopLength();
+    if (length == 0 || budget < length)
     {
-        // AND operation
-        v[xRegister] = v[xRegister] & v[yRegister];
-        pc += 2;
+        return 0;
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x3))
+
+    // Leave the program where the whole iterations would, with Vx holding
+    // the delay timer after a loop on it
+    if (length == 3)
     {
-        // XOR operation
-        v[xRegister] = v[xRegister] ^ v[yRegister];
-        pc += 2;
+        registers.v[memory[registers.pc] & 0x0f] = getDelayTimer();
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x4))
+    const unsigned long skipped = budget - budget % length;
+    elidedCycles += skipped;
+    return skipped;
+}
+
+StopReason Chip8::toStopReason(ErrorCode error)
+{
+    switch (error)
     {
-        // ADD operation
-        unsigned short sum = v[xRegister] + v[yRegister];
-        v[xRegister] = sum & 0xff;
-        v[0xf] = ((sum >> 8) > 0x0) ? 0x1 : 0x0;
-        pc += 2;
+    case StackOverflowError:
+        return StackOverflow;
+    case StackUnderflowError:
+        return StackUnderflow;
+    case KeyWaitPending:
+        return WaitingOnKey;
+    default:
+        // The handlers fail on nothing else
+        return UnknownOpcode;
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x5))
+}
+
+ErrorCode Chip8::runFrame(RunResult *run)
+{
+    // A frame waiting on a key or stopped at a breakpoint is over early, and
+    // the rest of its instructions are not executed
+    const RunResult result = runCycles(instructionsPerFrame);
+    if (run != nullptr)
     {
-        // SUB operation
-        v[0xf] = v[xRegister] > v[yRegister] ? 0x1 : 0x0;
-        v[xRegister] = v[xRegister] - v[yRegister];
-        pc += 2;
+        run->cycles += result.cycles;
+        run->reason = result.reason;
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x6))
+    if (result.reason != BudgetExhausted && result.reason != WaitingOnKey &&
+        result.reason != Breakpoint)
     {
-        // SHR operation
-        v[0xf] = (v[xRegister] & 0x1) == 0x1 ? 0x1 : 0x0;
-        v[xRegister] = v[xRegister] >> 1;
-        pc += 2;
+        if (logging)
+        {
+            std::cout << "Error: instruction could not be executed"
+                      << std::endl;
+        }
+        return Error;
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0x7))
+    tickTimers();
+    frames++;
+    if (capture != nullptr)
     {
-        // SUBN operation
-        v[0xf] = v[yRegister] > v[xRegister] ? 0x1 : 0x0;
-        v[xRegister] = v[yRegister] - v[xRegister];
-        pc += 2;
+        capture->capture(*this);
     }
-    else if ((instruction >> 12 == 0x8) && ((instruction & 0xf) == 0xe))
+
+    // Wait for the time of the frame to be over. A frame that is late by
+    // more than a frame does not make the following ones run faster to catch
+    // up.
+    if (realTime)
     {
-        // SHL operation
-        v[0xf] = (v[xRegister] >> 7) == 0x1 ? 0x1 : 0x0;
-        v[xRegister] = v[xRegister] << 1;
-        pc += 2;
+        const std::chrono::nanoseconds period(1000000000 / FRAME_RATE);
+        nextFrame += period;
+        const auto now = std::chrono::steady_clock::now();
+        if (nextFrame < now - period)
+        {
+            nextFrame = now;
+        }
+        std::this_thread::sleep_until(nextFrame);
     }
-    else if ((instruction >> 12) == 0xa)
+    return Ok;
+}
+
+ErrorCode Chip8::runFrames(unsigned long count, RunResult *run)
+{
+    for (unsigned long frame = 0; frame < count; frame++)
     {
-        // Annn - LD I, addr
-        // Set I = nnn
-        i = instruction & 0xfff;
-        pc += 2;
+        if (runFrame(run) != Ok)
+        {
+            return Error;
+        }
     }
-    else if ((instruction >> 12) == 0xb)
+    return Ok;
+}
+
+void Chip8::setRealTime(bool enabled)
+{
+    realTime = enabled;
+    nextFrame = std::chrono::steady_clock::now();
+}
+
+constexpr std::array<unsigned short, 16> Chip8::groupMasks = {
+    0x00ff, 0x0000, 0x0000, 0x0000, 0x0000, 0x000f, 0x0000, 0x0000,
+    0x000f, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x00ff, 0x00ff};
+
+constexpr std::array<unsigned short, 16> Chip8::groupOffsets = [] {
+    std::array<unsigned short, 16> offsets{};
+    unsigned short offset = 0;
+    for (size_t group = 0; group < 16; group++)
     {
-        // Bnnn - JP V0, addr
-        // Jump to location nnn + V0
-        pc = v[0x0] + (instruction & 0xfff);
+        offsets[group] = offset;
+        offset += groupMasks[group] + 1;
     }
-    else if ((instruction >> 12) == 0xc)
+    return offsets;
+}();
+
+template <unsigned char Set>
+constexpr std::array<Chip8::InstructionHandler, DISPATCH_TABLE_SIZE>
+Chip8::makeHandlerTable()
+{
+    std::array<InstructionHandler, DISPATCH_TABLE_SIZE> table{};
+    for (size_t index = 0; index < table.size(); index++)
     {
-        // Create a function that can generate randomly distributed
-        // unsigned chars
-        std::random_device r;
-        std::seed_seq seed{r(), r(), r(), r(), r(), r(), r(), r()};
-        auto rand = std::bind(std::uniform_int_distribution<>(0, UCHAR_MAX),
-                              std::mt19937(seed));
+        table[index] = &dispatch<&Chip8::opUnknown>;
+    }
 
-        // Cxkk - RND Vx, byte
-        // Set Vx = random byte AND kk.
-        const unsigned char index = (instruction >> 8) & 0xf;
-        v[index] = static_cast<unsigned char>(rand()) & (instruction & 0xff);
+    // Places a handler at the entry of the given opcode
+    auto set = [&table](unsigned short opcode, InstructionHandler handler) {
+        const unsigned short group = opcode >> 12;
+        table[groupOffsets[group] + (opcode & groupMasks[group])] = handler;
+    };
+
+    set(0x00e0, &dispatch<&Chip8::op00E0<Set>>);
+    set(0x00ee, &dispatch<&Chip8::op00EE>);
+    set(0x1000, &dispatch<&Chip8::op1nnn>);
+    set(0x2000, &dispatch<&Chip8::op2nnn>);
+    set(0x3000, &dispatch<&Chip8::op3xkk>);
+    set(0x4000, &dispatch<&Chip8::op4xkk>);
+    for (unsigned short n = 0x0; n <= 0xf; n++)
+    {
+        // The classic mode does not look at the last nibble of 5xy0
+        set(0x5000 | n, &dispatch<&Chip8::op5xy0>);
     }
-    else if ((instruction >> 12) == 0xf && (instruction & 0xff) == 0x07)
+    set(0x6000, &dispatch<&Chip8::op6xkk>);
+    set(0x7000, &dispatch<&Chip8::op7xkk>);
+    set(0x8000, &dispatch<&Chip8::op8xy0>);
+    set(0x8001, &dispatch<&Chip8::op8xy1<Set>>);
+    set(0x8002, &dispatch<&Chip8::op8xy2<Set>>);
+    set(0x8003, &dispatch<&Chip8::op8xy3<Set>>);
+    set(0x8004, &dispatch<&Chip8::op8xy4>);
+    set(0x8005, &dispatch<&Chip8::op8xy5>);
+    set(0x8006, &dispatch<&Chip8::op8xy6<Set>>);
+    set(0x8007, &dispatch<&Chip8::op8xy7>);
+    set(0x800e, &dispatch<&Chip8::op8xyE<Set>>);
+    set(0xa000, &dispatch<&Chip8::opAnnn>);
+    set(0xb000, &dispatch<&Chip8::opBnnn<Set>>);
+    set(0xc000, &dispatch<&Chip8::opCxkk>);
+    set(0xd000, &dispatch<&Chip8::opDxyn<Set>>);
+    set(0xe09e, &dispatch<&Chip8::opEx9E>);
+    set(0xe0a1, &dispatch<&Chip8::opExA1>);
+    set(0xf007, &dispatch<&Chip8::opFx07>);
+    set(0xf00a, &dispatch<&Chip8::opFx0A>);
+    set(0xf015, &dispatch<&Chip8::opFx15>);
+    set(0xf018, &dispatch<&Chip8::opFx18>);
+    set(0xf01e, &dispatch<&Chip8::opFx1E>);
+    set(0xf029, &dispatch<&Chip8::opFx29>);
+    set(0xf033, &dispatch<&Chip8::opFx33<Set>>);
+    set(0xf055, &dispatch<&Chip8::opFx55<Set>>);
+    set(0xf065, &dispatch<&Chip8::opFx65<Set>>);
+    if constexpr ((Set & EXTENDED_HANDLER_SET) != 0)
     {
-        // Fx07 - LD Vx, DT
-        // Set Vx = delay timer value.
-        v[(instruction >> 8) & 0xf] = dtr;
-        pc += 2;
+        // The extended mode adds the instructions of SCHIP and XO-CHIP, and
+        // skips over the whole of F000 nnnn
+        for (unsigned short n = 0x0; n <= 0xf; n++)
+        {
+            set(0x00c0 | n, &dispatch<&Chip8::op00Cn>);
+            set(0x00d0 | n, &dispatch<&Chip8::op00Dn>);
+            set(0x5000 | n, &dispatch<&Chip8::opUnknown>);
+        }
+        set(0x00fb, &dispatch<&Chip8::op00FB>);
+        set(0x00fc, &dispatch<&Chip8::op00FC>);
+        set(0x00fd, &dispatch<&Chip8::op00FD>);
+        set(0x00fe, &dispatch<&Chip8::op00FE>);
+        set(0x00ff, &dispatch<&Chip8::op00FF>);
+        set(0x3000, &dispatchSkip<&Chip8::op3xkk>);
+        set(0x4000, &dispatchSkip<&Chip8::op4xkk>);
+        set(0x5000, &dispatchSkip<&Chip8::op5xy0>);
+        set(0x5002, &dispatch<&Chip8::op5xy2>);
+        set(0x5003, &dispatch<&Chip8::op5xy3>);
+        set(0xe09e, &dispatchSkip<&Chip8::opEx9E>);
+        set(0xe0a1, &dispatchSkip<&Chip8::opExA1>);
+        set(0xf000, &dispatch<&Chip8::opF000>);
+        set(0xf001, &dispatch<&Chip8::opFn01>);
+        set(0xf002, &dispatch<&Chip8::opSound>);
+        set(0xf030, &dispatch<&Chip8::opFx30>);
+        set(0xf03a, &dispatch<&Chip8::opSound>);
+        set(0xf075, &dispatch<&Chip8::opFx75>);
+        set(0xf085, &dispatch<&Chip8::opFx85>);
     }
-    else if ((instruction >> 12) == 0xf && (instruction & 0xff) == 0x15)
+    return table;
+}
+
+constexpr std::array<std::array<Chip8::InstructionHandler, DISPATCH_TABLE_SIZE>,
+                     NUM_HANDLER_SETS>
+    Chip8::handlerTables = {
+        makeHandlerTable<0x00>(), makeHandlerTable<0x01>(),
+        makeHandlerTable<0x02>(), makeHandlerTable<0x03>(),
+        makeHandlerTable<0x04>(), makeHandlerTable<0x05>(),
+        makeHandlerTable<0x06>(), makeHandlerTable<0x07>(),
+        makeHandlerTable<0x08>(), makeHandlerTable<0x09>(),
+        makeHandlerTable<0x0a>(), makeHandlerTable<0x0b>(),
+        makeHandlerTable<0x0c>(), makeHandlerTable<0x0d>(),
+        makeHandlerTable<0x0e>(), makeHandlerTable<0x0f>(),
+        makeHandlerTable<0x10>(), makeHandlerTable<0x11>(),
+        makeHandlerTable<0x12>(), makeHandlerTable<0x13>(),
+        makeHandlerTable<0x14>(), makeHandlerTable<0x15>(),
+        makeHandlerTable<0x16>(), makeHandlerTable<0x17>(),
+        makeHandlerTable<0x18>(), makeHandlerTable<0x19>(),
+        makeHandlerTable<0x1a>(), makeHandlerTable<0x1b>(),
+        makeHandlerTable<0x1c>(), makeHandlerTable<0x1d>(),
+        makeHandlerTable<0x1e>(), makeHandlerTable<0x1f>()};
+
+Chip8::Instruction Chip8::decode(unsigned short opcode,
+                                 unsigned char handlerSet)
+{
+    // The handler tables must hold exactly the slices of all the groups
+    static_assert(groupOffsets[15] + groupMasks[15] + 1 ==
+                  handlerTables[0].size());
+
+    Instruction instruction;
+    instruction.opcode = opcode;
+    instruction.nnn = opcode & 0x0fff;
+    instruction.x = opcode >> 8 & 0x0f;
+    instruction.y = opcode >> 4 & 0x0f;
+    instruction.n = opcode & 0x0f;
+    instruction.kk = opcode & 0xff;
+
+    // Select the handler from the slice of the instruction's group. The only
+    // system instructions are 00E0 and 00EE, and those of the extended mode,
+    // so the 0nnn group is keyed by its low byte and any other value of its
+    // x nibble is not recognised.
+    const unsigned short group = opcode >> 12;
+    instruction.handler =
+        handlerTables[handlerSet % NUM_HANDLER_SETS]
+                     [groupOffsets[group] + (opcode & groupMasks[group])];
+    if (group == 0x0 && instruction.x != 0x0)
     {
-        // Fx15 - LD DT, Vx
-        // Set delay timer = Vx.
-        dtr = v[(instruction >> 8) & 0xf];
-        pc += 2;
+        instruction.handler = &dispatch<&Chip8::opUnknown>;
     }
-    else if ((instruction >> 12) == 0xf && (instruction & 0xff) == 0x18)
+
+    return instruction;
+}
+
+bool Chip8::endsBlock(const Instruction &instruction)
+{
+    switch (instruction.opcode >> 12)
     {
-        // Fx18 - LD ST, Vx
-        // Set sound timer = Vx.
-        str = v[(instruction >> 8) & 0xf];
-        pc += 2;
+    case 0x0:
+        // 00EE, and not 00E0
+        return instruction.opcode == 0x00ee ||
+               instruction.handler == &dispatch<&Chip8::opUnknown>;
+    case 0x1: // 1nnn
+    case 0x2: // 2nnn
+    case 0x3: // 3xkk
+    case 0x4: // 4xkk
+    case 0x5: // 5xy0
+    case 0xb: // Bnnn
+    case 0xe: // Ex9E, ExA1
+        return true;
+    case 0xf:
+        // Fx0A stays on itself while no key is pressed, and F000 is followed
+        // by the address it loads
+        return instruction.kk == 0x0a || instruction.opcode == 0xf000 ||
+               instruction.handler == &dispatch<&Chip8::opUnknown>;
+    default:
+        // An instruction that is not recognised stops the execution
+        return instruction.handler == &dispatch<&Chip8::opUnknown>;
     }
-    else if ((instruction >> 12) == 0xf && (instruction & 0xff) == 0x1e)
+}
+
+ErrorCode Chip8::executeInstruction(const unsigned short &instruction)
+{
+    const Instruction decoded = decode(instruction, getHandlerSet());
+    return decoded.handler(*this, decoded);
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::op00E0(const Instruction &instruction)
+{
+    // 00E0 - CLS
+    // Clear the display, or its selected planes in the extended mode.
+    if constexpr ((Set & EXTENDED_HANDLER_SET) != 0)
     {
-        // Fx1E - ADD I, Vx
-        // Set I = I + Vx.
-        i = i + v[(instruction >> 8) & 0xf];
-        pc += 2;
+        for (unsigned char plane = 0; plane < NUM_PLANES; plane++)
+        {
+            if ((extended->selectedPlanes >> plane & 0x1) != 0)
+            {
+                extended->planes[plane].fill(PlaneRow{0, 0});
+            }
+        }
+        registers.dirtyRows = ALL_DISPLAY_ROWS;
+        registers.pc += 2;
+        return Ok;
     }
-    else if ((instruction >> 12) == 0xf && (instruction & 0xff) == 0x33)
+    for (unsigned char row = 0; row < DISPLAY_HEIGHT; row++)
     {
-        // Fx33 - LD B, Vx
-        // Store BCD representation of Vx in memory locations I, I+1, and I+2.
-        unsigned char value = v[(instruction >> 8) & 0xf];
-        memory[i] = value / 100;
-        memory[i + 1] = (value / 10) % 10;
-        memory[i + 2] = value % 10;
-        pc += 2;
+        registers.dirtyRows |= static_cast<uint32_t>(display[row] != 0) << row;
     }
-    else if ((instruction >> 12) == 0xf && (instruction & 0xff) == 0x55)
+    display.fill(0);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op00EE(const Instruction &instruction)
+{
+    // 00EE - RET.
+    // Return from a subroutine
+    if (registers.sp == 0)
     {
-        // Fx55 - LD [I], Vx
-        // Store registers V0 through Vx in memory starting at location I.
-        const unsigned char indexMax = (instruction >> 8) & 0xf;
-        for (unsigned char index = 0; index <= indexMax; index++)
+        if (logging)
         {
-            memory[i + index] = v[index];
+            std::cout << "Error: return with an empty stack" << std::endl;
         }
-        pc += 2;
+        return StackUnderflowError;
     }
-    else if ((instruction >> 12) == 0xf && (instruction & 0xff) == 0x65)
+    registers.pc = registers.stack[registers.sp];
+    registers.sp--;
+    return Ok;
+}
+
+ErrorCode Chip8::op1nnn(const Instruction &instruction)
+{
+    // 1nnn - JP addr
+    // Jump to location nnn. A jump a few bytes back may close an idle loop,
+    // which runCycles looks for.
+    idleJump = instruction.nnn < registers.pc &&
+               registers.pc - instruction.nnn <= 4;
+    registers.pc = instruction.nnn;
+    return Ok;
+}
+
+ErrorCode Chip8::op2nnn(const Instruction &instruction)
+{
+    // 2nnn - CALL addr
+    // Call subroutine at nnn.
+    if (registers.sp + 1 >= SIZE_STACK)
     {
-        // Fx65 - LD Vx, [I]
-        // Read registers V0 through Vx from memory starting at location I.
-        const unsigned char indexMax = (instruction >> 8) & 0xf;
-        for (unsigned char index = 0; index <= indexMax; index++)
+        if (logging)
         {
-            v[index] = memory[i + index];
+            std::cout << "Error: call with a full stack" << std::endl;
         }
-        pc += 2;
+        return StackOverflowError;
     }
-    else
+    registers.sp++;
+    registers.stack[registers.sp] = registers.pc;
+    registers.pc = instruction.nnn;
+    return Ok;
+}
+
+ErrorCode Chip8::op3xkk(const Instruction &instruction)
+{
+    // 3xkk - SE Vx, byte
+    // Skip next instruction if Vx = kk.
+    const size_t step = registers.v[instruction.x] == instruction.kk ? 4 : 2;
+    registers.pc += step;
+    return Ok;
+}
+
+ErrorCode Chip8::op4xkk(const Instruction &instruction)
+{
+    // 4xkk - SNE Vx, byte
+    // Skip next instruction if Vx != kk.
+    const size_t step = registers.v[instruction.x] != instruction.kk ? 4 : 2;
+    registers.pc += step;
+    return Ok;
+}
+
+ErrorCode Chip8::op5xy0(const Instruction &instruction)
+{
+    // 5xy0 - SE Vx, Vy
+    // Skip next instruction if Vx = Vy.
+    const size_t step =
+        registers.v[instruction.x] == registers.v[instruction.y] ? 4 : 2;
+    registers.pc += step;
+    return Ok;
+}
+
+ErrorCode Chip8::op6xkk(const Instruction &instruction)
+{
+    // 6xkk - LD Vx, byte
+    // Set Vx = kk
+    registers.v[instruction.x] = instruction.kk;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op7xkk(const Instruction &instruction)
+{
+    // 7xkk - ADD Vx, byte
+    // Set Vx = Vx + kk
+    registers.v[instruction.x] = registers.v[instruction.x] + instruction.kk;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op8xy0(const Instruction &instruction)
+{
+    // 8xy0 - LD Vx, Vy
+    // Set Vx = Vy.
+    registers.v[instruction.x] = registers.v[instruction.y];
+    registers.pc += 2;
+    return Ok;
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::op8xy1(const Instruction &instruction)
+{
+    // OR operation
+    registers.v[instruction.x] =
+        registers.v[instruction.x] | registers.v[instruction.y];
+    if constexpr ((Set & ResetVfQuirk) != 0)
     {
-        std::cout << "Error: the instruction was not recognised" << std::endl;
-        Utils::printHexNumber("Instruction not recognised: ", instruction);
-        return Error;
+        registers.v[0xf] = 0x0;
     }
+    registers.pc += 2;
+    return Ok;
+}
 
+template <unsigned char Set>
+ErrorCode Chip8::op8xy2(const Instruction &instruction)
+{
+    // AND operation
+    registers.v[instruction.x] =
+        registers.v[instruction.x] & registers.v[instruction.y];
+    if constexpr ((Set & ResetVfQuirk) != 0)
+    {
+        registers.v[0xf] = 0x0;
+    }
+    registers.pc += 2;
     return Ok;
 }
 
-ErrorCode Chip8::setInstructionInMemory(unsigned short memoryIndex,
-                                        unsigned short instruction)
+template <unsigned char Set>
+ErrorCode Chip8::op8xy3(const Instruction &instruction)
+{
+    // XOR operation
+    registers.v[instruction.x] =
+        registers.v[instruction.x] ^ registers.v[instruction.y];
+    if constexpr ((Set & ResetVfQuirk) != 0)
+    {
+        registers.v[0xf] = 0x0;
+    }
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op8xy4(const Instruction &instruction)
+{
+    // ADD operation
+    unsigned short sum =
+        registers.v[instruction.x] + registers.v[instruction.y];
+    registers.v[instruction.x] = sum & 0xff;
+    registers.v[0xf] = ((sum >> 8) > 0x0) ? 0x1 : 0x0;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op8xy5(const Instruction &instruction)
+{
+    // SUB operation
+    registers.v[0xf] =
+        registers.v[instruction.x] > registers.v[instruction.y] ? 0x1 : 0x0;
+    registers.v[instruction.x] =
+        registers.v[instruction.x] - registers.v[instruction.y];
+    registers.pc += 2;
+    return Ok;
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::op8xy6(const Instruction &instruction)
+{
+    // SHR operation, of Vy on the COSMAC VIP
+    const unsigned char source =
+        (Set & ShiftVyQuirk) != 0 ? instruction.y : instruction.x;
+    registers.v[0xf] = (registers.v[source] & 0x1) == 0x1 ? 0x1 : 0x0;
+    registers.v[instruction.x] = registers.v[source] >> 1;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op8xy7(const Instruction &instruction)
+{
+    // SUBN operation
+    registers.v[0xf] =
+        registers.v[instruction.y] > registers.v[instruction.x] ? 0x1 : 0x0;
+    registers.v[instruction.x] =
+        registers.v[instruction.y] - registers.v[instruction.x];
+    registers.pc += 2;
+    return Ok;
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::op8xyE(const Instruction &instruction)
+{
+    // SHL operation, of Vy on the COSMAC VIP
+    const unsigned char source =
+        (Set & ShiftVyQuirk) != 0 ? instruction.y : instruction.x;
+    registers.v[0xf] = (registers.v[source] >> 7) == 0x1 ? 0x1 : 0x0;
+    registers.v[instruction.x] = registers.v[source] << 1;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opAnnn(const Instruction &instruction)
+{
+    // Annn - LD I, addr
+    // Set I = nnn
+    registers.i = instruction.nnn;
+    registers.pc += 2;
+    return Ok;
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::opBnnn(const Instruction &instruction)
+{
+    // Bnnn - JP V0, addr
+    // Jump to location nnn + V0, or to xnn + Vx on SCHIP
+    registers.pc =
+        registers.v[(Set & JumpVxQuirk) != 0 ? instruction.x : 0x0] +
+        instruction.nnn;
+    return Ok;
+}
+
+ErrorCode Chip8::opCxkk(const Instruction &instruction)
 {
-    memory[memoryIndex] = instruction >> 8;
-    memory[memoryIndex + 1] = instruction & 0xff;
+    // Cxkk - RND Vx, byte
+    // Set Vx = random byte AND kk.
+    registers.v[instruction.x] =
+        static_cast<unsigned char>(random.next() >> 24) & instruction.kk;
+    registers.pc += 2;
     return Ok;
-}
\ No newline at end of file
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::opDxyn(const Instruction &instruction)
+{
+    // Dxyn - DRW Vx, Vy, nibble
+    // Display the n-byte sprite starting at memory location I at (Vx, Vy),
+    // set VF = collision. The position wraps around the display, and the
+    // parts of the sprite past its right and bottom edges are clipped.
+    if constexpr ((Set & EXTENDED_HANDLER_SET) != 0)
+    {
+        registers.v[0xf] = drawExtended(instruction) ? 0x1 : 0x0;
+        registers.pc += 2;
+        return Ok;
+    }
+    const unsigned char x = registers.v[instruction.x] % DISPLAY_WIDTH;
+    const unsigned char y = registers.v[instruction.y] % DISPLAY_HEIGHT;
+    const unsigned char rows =
+        std::min<unsigned char>(instruction.n, DISPLAY_HEIGHT - y);
+    uint64_t collision = 0;
+    for (unsigned char row = 0; row < rows; row++)
+    {
+        // Move the byte of the sprite to the left of the row and then to its
+        // column, which drops the pixels past the right edge
+        const uint64_t sprite =
+            static_cast<uint64_t>(
+                memory[(registers.i + row) % NUM_BYTES_MEMORY])
+                << (DISPLAY_WIDTH - 8) >>
+            x;
+        collision |= display[y + row] & sprite;
+        display[y + row] ^= sprite;
+        registers.dirtyRows |= static_cast<uint32_t>(sprite != 0) << (y + row);
+    }
+    registers.v[0xf] = collision != 0 ? 0x1 : 0x0;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opEx9E(const Instruction &instruction)
+{
+    // Ex9E - SKP Vx
+    // Skip next instruction if key with the value of Vx is pressed.
+    registers.pc += isKeyPressed(registers.v[instruction.x]) ? 4 : 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opExA1(const Instruction &instruction)
+{
+    // ExA1 - SKNP Vx
+    // Skip next instruction if key with the value of Vx is not pressed.
+    registers.pc += isKeyPressed(registers.v[instruction.x]) ? 2 : 4;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx07(const Instruction &instruction)
+{
+    // Fx07 - LD Vx, DT
+    // Set Vx = delay timer value.
+    registers.v[instruction.x] = getDelayTimer();
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx0A(const Instruction &instruction)
+{
+    // Fx0A - LD Vx, K
+    // Wait for a key press, store the value of the key in Vx. The PC stays
+    // on the instruction until a key is pressed.
+    if (registers.keys == 0)
+    {
+        return KeyWaitPending;
+    }
+    registers.v[instruction.x] = __builtin_ctz(registers.keys);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx15(const Instruction &instruction)
+{
+    // Fx15 - LD DT, Vx
+    // Set delay timer = Vx.
+    setDelayTimer(registers.v[instruction.x]);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx18(const Instruction &instruction)
+{
+    // Fx18 - LD ST, Vx
+    // Set sound timer = Vx.
+    setSoundTimer(registers.v[instruction.x]);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx1E(const Instruction &instruction)
+{
+    // Fx1E - ADD I, Vx
+    // Set I = I + Vx.
+    registers.i = registers.i + registers.v[instruction.x];
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx29(const Instruction &instruction)
+{
+    // Fx29 - LD F, Vx
+    // Set I = location of sprite for digit Vx.
+    registers.i = FONT_START +
+                  (registers.v[instruction.x] & 0x0f) * FONT_CHARACTER_SIZE;
+    registers.pc += 2;
+    return Ok;
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::opFx33(const Instruction &instruction)
+{
+    // Fx33 - LD B, Vx
+    // Store BCD representation of Vx in memory locations I, I+1, and I+2.
+    unsigned char value = registers.v[instruction.x];
+    if constexpr ((Set & EXTENDED_HANDLER_SET) != 0)
+    {
+        writeData(registers.i, value / 100);
+        writeData(registers.i + 1, (value / 10) % 10);
+        writeData(registers.i + 2, value % 10);
+        registers.pc += 2;
+        return Ok;
+    }
+    memory.write(registers.i, value / 100);
+    memory.write(registers.i + 1, (value / 10) % 10);
+    memory.write(registers.i + 2, value % 10);
+    invalidateCode(registers.i, 3);
+    registers.pc += 2;
+    return Ok;
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::opFx55(const Instruction &instruction)
+{
+    // Fx55 - LD [I], Vx
+    // Store registers V0 through Vx in memory starting at location I.
+    if constexpr ((Set & EXTENDED_HANDLER_SET) != 0)
+    {
+        for (unsigned char index = 0; index <= instruction.x; index++)
+        {
+            writeData(registers.i + index, registers.v[index]);
+        }
+    }
+    else
+    {
+        memory.write(registers.i, registers.v.data(), instruction.x + 1);
+        invalidateCode(registers.i, instruction.x + 1);
+    }
+    if constexpr ((Set & IncrementIQuirk) != 0)
+    {
+        registers.i += instruction.x + 1;
+    }
+    registers.pc += 2;
+    return Ok;
+}
+
+template <unsigned char Set>
+ErrorCode Chip8::opFx65(const Instruction &instruction)
+{
+    // Fx65 - LD Vx, [I]
+    // Read registers V0 through Vx from memory starting at location I.
+    for (unsigned char index = 0; index <= instruction.x; index++)
+    {
+        registers.v[index] = (Set & EXTENDED_HANDLER_SET) != 0
+                                 ? readData(registers.i + index)
+                                 : memory[registers.i + index];
+    }
+    if constexpr ((Set & IncrementIQuirk) != 0)
+    {
+        registers.i += instruction.x + 1;
+    }
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opUnknown(const Instruction &instruction)
+{
+    if (logging)
+    {
+        std::cout << "Error: the instruction was not recognised" << std::endl;
+        Utils::printHexNumber("Instruction not recognised: ",
+                              instruction.opcode);
+    }
+    return UnknownOpcodeError;
+}
+
+ErrorCode Chip8::op00Cn(const Instruction &instruction)
+{
+    // 00Cn - SCD nibble
+    // Scroll the selected planes down by n rows.
+    scrollVertically(instruction.n);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op00Dn(const Instruction &instruction)
+{
+    // 00Dn - SCU nibble
+    // Scroll the selected planes up by n rows.
+    scrollVertically(-instruction.n);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op00FB(const Instruction &instruction)
+{
+    // 00FB - SCR
+    // Scroll the selected planes right by 4 pixels.
+    scrollHorizontally(4);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op00FC(const Instruction &instruction)
+{
+    // 00FC - SCL
+    // Scroll the selected planes left by 4 pixels.
+    scrollHorizontally(-4);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op00FD(const Instruction &instruction)
+{
+    // 00FD - EXIT
+    // Stop the program, which stays on this instruction from then on.
+    return Ok;
+}
+
+ErrorCode Chip8::op00FE(const Instruction &instruction)
+{
+    // 00FE - LOW
+    // Select the low resolution, clearing the display.
+    extended->highResolution = false;
+    for (auto &plane : extended->planes)
+    {
+        plane.fill(PlaneRow{0, 0});
+    }
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op00FF(const Instruction &instruction)
+{
+    // 00FF - HIGH
+    // Select the high resolution, clearing the display.
+    extended->highResolution = true;
+    for (auto &plane : extended->planes)
+    {
+        plane.fill(PlaneRow{0, 0});
+    }
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op5xy2(const Instruction &instruction)
+{
+    // 5xy2 - SAVE Vx - Vy
+    // Store registers Vx through Vy, in either order, in memory starting at
+    // location I, without changing I.
+    const int step = instruction.x <= instruction.y ? 1 : -1;
+    const int count = std::abs(instruction.y - instruction.x) + 1;
+    for (int index = 0; index < count; index++)
+    {
+        writeData(registers.i + index,
+                  registers.v[instruction.x + index * step]);
+    }
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::op5xy3(const Instruction &instruction)
+{
+    // 5xy3 - LOAD Vx - Vy
+    // Read registers Vx through Vy, in either order, from memory starting at
+    // location I, without changing I.
+    const int step = instruction.x <= instruction.y ? 1 : -1;
+    const int count = std::abs(instruction.y - instruction.x) + 1;
+    for (int index = 0; index < count; index++)
+    {
+        registers.v[instruction.x + index * step] =
+            readData(registers.i + index);
+    }
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opF000(const Instruction &instruction)
+{
+    // F000 nnnn - LD I, long addr
+    // Set I = the 16 bit address that follows the instruction.
+    registers.i = memory[registers.pc + 2] << 8 | memory[registers.pc + 3];
+    registers.pc += 4;
+    return Ok;
+}
+
+ErrorCode Chip8::opFn01(const Instruction &instruction)
+{
+    // Fn01 - PLANE n
+    // Select the planes drawn, cleared and scrolled, one bit per plane.
+    extended->selectedPlanes = instruction.x & ((0x1 << NUM_PLANES) - 1);
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opSound(const Instruction &instruction)
+{
+    // F002 - AUDIO and Fx3A - PITCH Vx
+    // Load the audio pattern or set its pitch, which are ignored as there is
+    // no audio.
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx30(const Instruction &instruction)
+{
+    // Fx30 - LD HF, Vx
+    // Set I = location of large sprite for digit Vx.
+    registers.i = LARGE_FONT_START + (registers.v[instruction.x] & 0x0f) *
+                                         LARGE_FONT_CHARACTER_SIZE;
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx75(const Instruction &instruction)
+{
+    // Fx75 - LD R, Vx
+    // Store registers V0 through Vx in the flags.
+    std::copy(registers.v.begin(), registers.v.begin() + instruction.x + 1,
+              extended->flags.begin());
+    registers.pc += 2;
+    return Ok;
+}
+
+ErrorCode Chip8::opFx85(const Instruction &instruction)
+{
+    // Fx85 - LD Vx, R
+    // Read registers V0 through Vx from the flags.
+    std::copy(extended->flags.begin(),
+              extended->flags.begin() + instruction.x + 1,
+              registers.v.begin());
+    registers.pc += 2;
+    return Ok;
+}
+
+bool Chip8::drawExtended(const Instruction &instruction)
+{
+    // A pixel of the low resolution is drawn as 2x2 pixels, so the rows of
+    // the planes are as wide whatever the resolution
+    const unsigned int scale = extended->highResolution ? 1 : 2;
+    const unsigned int width = EXTENDED_DISPLAY_WIDTH / scale;
+    const unsigned int height = EXTENDED_DISPLAY_HEIGHT / scale;
+    const unsigned int x = registers.v[instruction.x] % width;
+    const unsigned int y = registers.v[instruction.y] % height;
+
+    // Dxy0 draws a sprite of 16x16 pixels, two bytes per row, and every
+    // selected plane takes its own sprite from the bytes that follow
+    const bool large = instruction.n == 0;
+    const unsigned int bytesPerRow = large ? 2 : 1;
+    const unsigned int spriteRows = large ? 16 : instruction.n;
+    const unsigned int rows = std::min(spriteRows, height - y);
+    unsigned short address = registers.i;
+    PlaneRow collision = {0, 0};
+    for (unsigned char plane = 0; plane < NUM_PLANES; plane++)
+    {
+        if ((extended->selectedPlanes >> plane & 0x1) == 0)
+        {
+            continue;
+        }
+        for (unsigned int row = 0; row < rows; row++)
+        {
+            // Move the pixels of the row of the sprite to the left of a row
+            // of the plane and then to their column, which drops the pixels
+            // past the right edge
+            const unsigned short offset = address + row * bytesPerRow;
+            uint32_t bits = readData(offset) << 8;
+            if (large)
+            {
+                bits |= readData(offset + 1);
+            }
+            bits = scale == 2 ? doublePixels(bits) : bits << 16;
+            const PlaneRow sprite = shiftRight(
+                PlaneRow{static_cast<uint64_t>(bits) << 32, 0}, x * scale);
+
+            // Blend the row into the plane, twice in the low resolution
+            for (unsigned int copy = 0; copy < scale; copy++)
+            {
+                const unsigned int target = (y + row) * scale + copy;
+                PlaneRow &pixels = extended->planes[plane][target];
+                collision |= pixels & sprite;
+                pixels ^= sprite;
+                registers.dirtyRows |=
+                    static_cast<uint32_t>(sprite[0] != 0 || sprite[1] != 0)
+                    << (target / 2);
+            }
+        }
+        address += spriteRows * bytesPerRow;
+    }
+    return (collision[0] | collision[1]) != 0;
+}
+
+void Chip8::scrollVertically(int count)
+{
+    // The rows are moved whole, and the ones scrolled in are cleared
+    const int shift = extended->highResolution ? count : 2 * count;
+    for (unsigned char plane = 0; plane < NUM_PLANES; plane++)
+    {
+        if ((extended->selectedPlanes >> plane & 0x1) == 0)
+        {
+            continue;
+        }
+        auto &rows = extended->planes[plane];
+        if (shift > 0)
+        {
+            std::copy_backward(rows.begin(), rows.end() - shift, rows.end());
+            std::fill(rows.begin(), rows.begin() + shift, PlaneRow{0, 0});
+        }
+        else if (shift < 0)
+        {
+            std::copy(rows.begin() - shift, rows.end(), rows.begin());
+            std::fill(rows.end() + shift, rows.end(), PlaneRow{0, 0});
+        }
+    }
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+}
+
+void Chip8::scrollHorizontally(int count)
+{
+    const unsigned int shift =
+        (extended->highResolution ? 1 : 2) * std::abs(count);
+    for (unsigned char plane = 0; plane < NUM_PLANES; plane++)
+    {
+        if ((extended->selectedPlanes >> plane & 0x1) == 0)
+        {
+            continue;
+        }
+        for (PlaneRow &row : extended->planes[plane])
+        {
+            row = count > 0 ? shiftRight(row, shift) : shiftLeft(row, shift);
+        }
+    }
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+}
+
+ErrorCode Chip8::setInstructionInMemory(unsigned short memoryIndex,
+                                        unsigned short instruction)
+{
+    memory.write(memoryIndex, instruction >> 8);
+    memory.write(memoryIndex + 1, instruction & 0xff);
+    invalidateCode(memoryIndex, 2);
+    return Ok;
+}
+
+void Chip8::setPredecode(bool enabled)
+{
+    if (!enabled)
+    {
+        decoded.reset();
+    }
+    else if (decoded == nullptr)
+    {
+        // Start with every entry pending to be decoded
+        decoded = std::make_unique<std::array<Instruction, NUM_BYTES_MEMORY>>();
+        invalidateDecoded(0, NUM_BYTES_MEMORY);
+    }
+}
+void Chip8::invalidateDecoded(unsigned short index, unsigned short count)
+{
+    // The instruction starting one byte before also reads the first byte
+    const unsigned short first = index > 0 ? index - 1 : 0;
+    for (unsigned short entry = first;
+         entry < index + count && entry < NUM_BYTES_MEMORY; entry++)
+    {
+        (*decoded)[entry].handler = nullptr;
+    }
+}
+
+void Chip8::setBlockCache(bool enabled)
+{
+    if (!enabled)
+    {
+        blocks.reset();
+    }
+    else if (blocks == nullptr)
+    {
+        blocks = std::make_unique<BlockCache>();
+    }
+}
+
+ErrorCode Chip8::executeBlock()
+{
+    if (blocks == nullptr)
+    {
+        return executeCycle();
+    }
+
+    // A block can only be empty at the very end of memory. The pc wraps
+    // around at the end of memory, as the memory itself does.
+    const BasicBlock &block =
+        blocks->getBlock(*this, registers.pc % NUM_BYTES_MEMORY);
+    if (block.instructions.empty())
+    {
+        return executeCycle();
+    }
+
+    // Execute the instructions of the block one after the other, as long as
+    // each one continues at the next one and the block is not overwritten
+    unsigned long executed = 0;
+    ErrorCode result = Ok;
+    for (const Instruction &instruction : block.instructions)
+    {
+#ifdef CHIP8_PROFILE
+        const unsigned short address = registers.pc;
+        const unsigned char depth = registers.sp;
+#endif
+        const unsigned short next = registers.pc + 2;
+        result = instruction.handler(*this, instruction);
+        if (result != Ok)
+        {
+            break;
+        }
+#ifdef CHIP8_PROFILE
+        if (profiler != nullptr)
+        {
+            profiler->record(address, instruction.opcode, depth, registers.pc);
+        }
+#endif
+        executed++;
+        if (registers.pc != next || !block.valid)
+        {
+            break;
+        }
+    }
+    blocks->countExecution(executed);
+
+    return reportResult(result);
+}
+
+BlockStatistics Chip8::getBlockStatistics() const
+{
+    return blocks != nullptr ? blocks->getStatistics() : BlockStatistics();
+}
+
+void Chip8::invalidateBlocks(unsigned short index, unsigned short count)
+{
+    blocks->invalidate(index, count);
+}
+
+ErrorCode Chip8::setJit(bool enabled)
+{
+#ifdef CHIP8_JIT
+    if (!enabled)
+    {
+        jit.reset();
+    }
+    else if (jit == nullptr)
+    {
+        // The JIT cannot work without a buffer to place the code in
+        jit = std::make_unique<JitCompiler>();
+        if (!jit->isReady())
+        {
+            if (logging)
+            {
+                std::cout
+                    << "Error: could not map executable memory for the JIT"
+                    << std::endl;
+            }
+            jit.reset();
+            return Error;
+        }
+    }
+    return Ok;
+#else
+    if (enabled)
+    {
+        if (logging)
+        {
+            std::cout << "Error: the JIT is not available, build with JIT=1"
+                      << std::endl;
+        }
+        return Error;
+    }
+    return Ok;
+#endif
+}
+
+bool Chip8::isJitEnabled() const
+{
+#ifdef CHIP8_JIT
+    return jit != nullptr;
+#else
+    return false;
+#endif
+}
+
+ErrorCode Chip8::executeJit()
+{
+#ifdef CHIP8_JIT
+    // The native code cannot report each instruction to the profiler, and
+    // only knows the classic mode
+    if (jit != nullptr && !isProfilingEnabled() && extended == nullptr)
+    {
+        const JitFunction code = jit->getBlock(*this, registers.pc);
+        if (code != nullptr)
+        {
+            jit->countExecution();
+            return reportResult(static_cast<ErrorCode>(code(this)));
+        }
+    }
+#endif
+    return executeBlock();
+}
+
+BlockStatistics Chip8::getJitStatistics() const
+{
+#ifdef CHIP8_JIT
+    if (jit != nullptr)
+    {
+        return jit->getStatistics();
+    }
+#endif
+    return BlockStatistics();
+}
+
+void Chip8::invalidateJit(unsigned short index, unsigned short count)
+{
+#ifdef CHIP8_JIT
+    jit->invalidate(index, count);
+#endif
+}
+
+uint64_t Chip8::hashState() const
+{
+    uint64_t hash = memory.hash();
+    hash = Utils::hash(registers.v.data(), registers.v.size(), hash);
+    hash = Utils::hash(registers.stack.data(),
+                       registers.stack.size() * sizeof(registers.stack[0]),
+                       hash);
+    hash = Utils::hash(&registers.i, sizeof(registers.i), hash);
+    hash = Utils::hash(&registers.pc, sizeof(registers.pc), hash);
+    hash = Utils::hash(&registers.sp, sizeof(registers.sp), hash);
+    const unsigned char timers[] = {getDelayTimer(), getSoundTimer()};
+    hash = Utils::hash(timers, sizeof(timers), hash);
+    hash = Utils::hash(display.data(), sizeof(display), hash);
+    if (extended != nullptr)
+    {
+        hash = Utils::hash(extended->planes.data(), sizeof(extended->planes),
+                           hash);
+        hash = Utils::hash(extended->memory.data(), extended->memory.size(),
+                           hash);
+        hash = Utils::hash(extended->flags.data(), extended->flags.size(),
+                           hash);
+        const unsigned char mode[] = {extended->selectedPlanes,
+                                      extended->highResolution};
+        hash = Utils::hash(mode, sizeof(mode), hash);
+    }
+    return hash;
+}
+
+ErrorCode Chip8::setProfiling(bool enabled)
+{
+#ifdef CHIP8_PROFILE
+    if (!enabled)
+    {
+        profiler.reset();
+    }
+    else if (profiler == nullptr)
+    {
+        profiler = std::make_unique<Profiler>();
+    }
+    return Ok;
+#else
+    if (enabled)
+    {
+        if (logging)
+        {
+            std::cout
+                << "Error: the profiler is not available, build with PROFILE=1"
+                << std::endl;
+        }
+        return Error;
+    }
+    return Ok;
+#endif
+}
+
+const Profiler *Chip8::getProfiler() const
+{
+#ifdef CHIP8_PROFILE
+    return profiler.get();
+#else
+    return nullptr;
+#endif
+}
+
+void Chip8::forkFrom(const Chip8 &source)
+{
+    // Only the pages that are not shared with the source may hold code the
+    // caches were not built from
+    const uint16_t changedPages =
+        getHandlerSet() == source.getHandlerSet()
+            ? memory.getDifferentPages(source.memory)
+            : (1u << NUM_MEMORY_PAGES) - 1;
+    quirks = source.quirks;
+    if (source.extended == nullptr)
+    {
+        extended.reset();
+    }
+    else if (extended == nullptr)
+    {
+        extended = std::make_unique<Extended>(*source.extended);
+    }
+    else
+    {
+        *extended = *source.extended;
+    }
+    memory = source.memory;
+    registers = source.registers;
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+    display = source.display;
+    random = source.random;
+    frames = source.frames;
+
+    for (unsigned short page = 0; page < NUM_MEMORY_PAGES; page++)
+    {
+        if ((changedPages >> page & 0x1) != 0)
+        {
+            invalidateCode(page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+        }
+    }
+}
+
+size_t Chip8::getStateSize()
+{
+    return sizeof(StateHeader) + sizeof(SavedState);
+}
+
+ErrorCode Chip8::saveState(unsigned char *buffer, size_t size) const
+{
+    if (size < getStateSize())
+    {
+        return NotEnoughMemory;
+    }
+    if (extended != nullptr)
+    {
+        if (logging)
+        {
+            std::cout << "Error: the extended mode cannot be saved"
+                      << std::endl;
+        }
+        return Error;
+    }
+
+    // Gather the state and copy it after its header in one go
+    SavedState state;
+    memory.read(0, state.memory.data(), state.memory.size());
+    state.display = display;
+    state.frames = frames;
+    state.quirks = quirks;
+    state.reserved.fill(0);
+    state.random = random;
+    state.registers = registers;
+
+    StateHeader header;
+    std::memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+    header.version = STATE_VERSION;
+    header.size = sizeof(SavedState);
+    header.reserved = 0;
+    header.checksum = Utils::checksum(&state, sizeof(state));
+    std::memcpy(buffer, &header, sizeof(header));
+    std::memcpy(buffer + sizeof(header), &state, sizeof(state));
+    return Ok;
+}
+
+std::vector<unsigned char> Chip8::saveState() const
+{
+    std::vector<unsigned char> buffer(getStateSize());
+    if (saveState(buffer.data(), buffer.size()) != Ok)
+    {
+        buffer.clear();
+    }
+    return buffer;
+}
+
+ErrorCode Chip8::saveState(const std::string &filename) const
+{
+    const std::vector<unsigned char> buffer = saveState();
+    if (buffer.empty())
+    {
+        return Error;
+    }
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        if (logging)
+        {
+            std::cout << "Error opening file " << filename << std::endl;
+        }
+        return FileOpenError;
+    }
+    file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+    return file.good() ? Ok : FileOpenError;
+}
+
+ErrorCode Chip8::loadState(const unsigned char *buffer, size_t size)
+{
+    // Check the header before touching anything
+    StateHeader header;
+    if (extended != nullptr)
+    {
+        if (logging)
+        {
+            std::cout << "Error: the extended mode cannot be restored"
+                      << std::endl;
+        }
+        return Error;
+    }
+    if (size < getStateSize())
+    {
+        return InvalidState;
+    }
+    std::memcpy(&header, buffer, sizeof(header));
+    if (std::memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != STATE_VERSION || header.size != sizeof(SavedState))
+    {
+        if (logging)
+        {
+            std::cout << "Error: the state has an unknown format" << std::endl;
+        }
+        return InvalidState;
+    }
+    SavedState state;
+    std::memcpy(&state, buffer + sizeof(header), sizeof(state));
+    if (Utils::checksum(&state, sizeof(state)) != header.checksum)
+    {
+        if (logging)
+        {
+            std::cout << "Error: the state is corrupted" << std::endl;
+        }
+        return InvalidState;
+    }
+
+    memory.write(0, state.memory.data(), state.memory.size());
+    display = state.display;
+    frames = state.frames;
+    random = state.random;
+    registers = state.registers;
+
+    // The code in memory, its handler set and the whole display may have
+    // changed
+    quirks = state.quirks % NUM_QUIRK_SETS;
+    invalidateCode(0, NUM_BYTES_MEMORY);
+    registers.dirtyRows = ALL_DISPLAY_ROWS;
+    return Ok;
+}
+
+ErrorCode Chip8::loadState(const std::string &filename)
+{
+    const int file = open(filename.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        if (logging)
+        {
+            std::cout << "Error opening file " << filename << std::endl;
+        }
+        return FileOpenError;
+    }
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        close(file);
+        return InvalidState;
+    }
+    void *mapped =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED)
+    {
+        return FileOpenError;
+    }
+
+    const ErrorCode result = loadState(
+        static_cast<const unsigned char *>(mapped), status.st_size);
+    munmap(mapped, status.st_size);
+    return result;
+}
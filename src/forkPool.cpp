@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <chrono>
+
+#include "forkPool.hpp"
+
+namespace
+{
+// Packs the range of forks [begin, end) into a word
+inline uint64_t packRange(uint64_t begin, uint64_t end)
+{
+    return begin << 32 | end;
+}
+
+inline uint64_t rangeBegin(uint64_t range)
+{
+    return range >> 32;
+}
+
+inline uint64_t rangeEnd(uint64_t range)
+{
+    return range & 0xffffffffull;
+}
+} // namespace
+
+ForkPool::ForkPool(unsigned int threads)
+{
+    const unsigned int count = std::max(
+        1u, threads > 0 ? threads : std::thread::hardware_concurrency());
+    for (unsigned int index = 0; index < count; index++)
+    {
+        workers.push_back(std::make_unique<Worker>());
+        Chip8 &chip8 = workers.back()->chip8;
+        chip8.setLogging(false);
+        chip8.initialize();
+        chip8.setPredecode(true);
+    }
+
+    // The calling thread is the first worker
+    for (unsigned int index = 1; index < count; index++)
+    {
+        this->threads.emplace_back(&ForkPool::loop, this, index);
+    }
+}
+
+ForkPool::~ForkPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void ForkPool::setScore(unsigned short address, unsigned char size)
+{
+    scoreAddress = address;
+    scoreSize = std::min<unsigned char>(size, FORK_MAX_SCORE_BYTES);
+}
+
+const std::vector<ForkResult> &
+ForkPool::explore(const Chip8 &source,
+                  const std::vector<std::vector<uint16_t>> &inputs,
+                  unsigned long frames)
+{
+    const auto start = std::chrono::steady_clock::now();
+    this->source = &source;
+    this->inputs = &inputs;
+    this->frames = frames;
+    results.resize(inputs.size());
+
+    // Every worker starts with an even share of the forks
+    const size_t count = inputs.size();
+    for (size_t index = 0; index < workers.size(); index++)
+    {
+        Worker &worker = *workers[index];
+        worker.range = packRange(count * index / workers.size(),
+                                 count * (index + 1) / workers.size());
+        worker.steals = 0;
+        worker.seconds = 0.0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        running = threads.size();
+    }
+    started.notify_all();
+    work(0);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return running == 0; });
+    }
+
+    statistics = ForkStatistics();
+    statistics.forks = count;
+    for (const ForkResult &result : results)
+    {
+        statistics.frames += result.frames;
+    }
+    for (const std::unique_ptr<Worker> &worker : workers)
+    {
+        statistics.steals += worker->steals;
+        statistics.workerSeconds += worker->seconds;
+    }
+    statistics.seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    return results;
+}
+
+void ForkPool::work(size_t self)
+{
+    const auto start = std::chrono::steady_clock::now();
+    Worker &worker = *workers[self];
+    size_t index;
+    while (take(worker, index) || steal(self, index))
+    {
+        runFork(worker.chip8, index);
+    }
+    worker.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+}
+
+bool ForkPool::take(Worker &worker, size_t &index)
+{
+    uint64_t range = worker.range.load();
+    while (rangeBegin(range) < rangeEnd(range))
+    {
+        if (worker.range.compare_exchange_weak(
+                range, packRange(rangeBegin(range) + 1, rangeEnd(range))))
+        {
+            index = rangeBegin(range);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ForkPool::steal(size_t thief, size_t &index)
+{
+    // Look at the other workers in turn, starting with the next one, so
+    // that thieves spread over the victims
+    for (size_t offset = 1; offset < workers.size(); offset++)
+    {
+        Worker &victim = *workers[(thief + offset) % workers.size()];
+        uint64_t range = victim.range.load();
+        while (rangeBegin(range) < rangeEnd(range))
+        {
+            // Leave the victim the first half, rounded down, and take the
+            // rest
+            const uint64_t begin = rangeBegin(range);
+            const uint64_t end = rangeEnd(range);
+            const uint64_t middle = begin + (end - begin) / 2;
+            if (victim.range.compare_exchange_weak(range,
+                                                   packRange(begin, middle)))
+            {
+                workers[thief]->range = packRange(middle + 1, end);
+                workers[thief]->steals++;
+                index = middle;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ForkPool::runFork(Chip8 &chip8, size_t index)
+{
+    ForkResult &result = results[index];
+    const std::vector<uint16_t> &keys = (*inputs)[index];
+
+    chip8.forkFrom(*source);
+    chip8.setInstructionsPerFrame(source->getInstructionsPerFrame());
+    result.frames = 0;
+    result.error = Ok;
+    for (unsigned long frame = 0; frame < frames; frame++)
+    {
+        if (!keys.empty())
+        {
+            chip8.setKeys(keys[std::min<size_t>(frame, keys.size() - 1)]);
+        }
+        if (chip8.runFrame() != Ok)
+        {
+            result.error = Error;
+            break;
+        }
+        result.frames++;
+    }
+
+    result.score = 0;
+    for (unsigned char byte = 0; byte < scoreSize; byte++)
+    {
+        result.score =
+            result.score << 8 | chip8.getMemory(scoreAddress + byte);
+    }
+    result.stateHash = chip8.hashState();
+    result.display = chip8.getDisplay();
+}
+
+void ForkPool::loop(size_t index)
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [this, seen]()
+                         { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+        }
+
+        work(index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+        }
+        finished.notify_one();
+    }
+}
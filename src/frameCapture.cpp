@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "frameCapture.hpp"
+
+namespace
+{
+// Returns a channel of a pixel
+inline int channel(uint32_t pixel, unsigned int index)
+{
+    return pixel >> (8 * index) & 0xff;
+}
+
+// Returns a component of a colour computed from its channels with weights in
+// 256ths, plus an offset, kept within a byte
+inline unsigned char component(uint32_t pixel, int red, int green, int blue,
+                               int offset)
+{
+    const int value = (red * channel(pixel, 0) + green * channel(pixel, 1) +
+                       blue * channel(pixel, 2) + 128) /
+                          256 +
+                      offset;
+    return static_cast<unsigned char>(std::clamp(value, 0, 255));
+}
+} // namespace
+
+FrameCapture::FrameCapture(size_t frames) : ring(std::max<size_t>(frames, 1))
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    close();
+}
+
+ErrorCode FrameCapture::open(const std::string &filename,
+                             CaptureFormat format)
+{
+    if (isOpen())
+    {
+        std::cout << "Error: a capture is already open" << std::endl;
+        return Error;
+    }
+    if (filename == "-")
+    {
+        stream = &std::cout;
+    }
+    else
+    {
+        file.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cout << "Error opening file " << filename << std::endl;
+            return FileOpenError;
+        }
+        stream = &file;
+    }
+
+    // Start the stream from an empty ring, with the size of its frames set
+    // by the first one
+    this->format = format;
+    head = 0;
+    tail = 0;
+    stopping = false;
+    width = 0;
+    height = 0;
+    captured = 0;
+    repeated = 0;
+    dropped = 0;
+    written = 0;
+    bytes = 0;
+    failed = false;
+    started = false;
+    converted.clear();
+    repeats = 0;
+    writer = std::thread(&FrameCapture::loop, this);
+    return Ok;
+}
+
+ErrorCode FrameCapture::close()
+{
+    if (!isOpen())
+    {
+        return Ok;
+    }
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    if (file.is_open())
+    {
+        file.close();
+        failed |= file.fail();
+    }
+    stream = nullptr;
+    return failed ? Error : Ok;
+}
+
+bool FrameCapture::capture(const Chip8 &chip8)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+    // Every frame of a stream has the size of the first one
+    const bool extended = chip8.isExtended();
+    const unsigned int frameWidth =
+        extended ? EXTENDED_DISPLAY_WIDTH : DISPLAY_WIDTH;
+    const unsigned int frameHeight =
+        extended ? EXTENDED_DISPLAY_HEIGHT : DISPLAY_HEIGHT;
+    if (width == 0)
+    {
+        width = frameWidth;
+        height = frameHeight;
+    }
+    const size_t position = tail.load(std::memory_order_relaxed);
+    if (frameWidth != width ||
+        position - head.load(std::memory_order_acquire) == ring.size())
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Copy the display into the free slot, combining the planes of the
+    // extended display
+    Frame &frame = ring[position % ring.size()];
+    if (extended)
+    {
+        for (unsigned char row = 0; row < EXTENDED_DISPLAY_HEIGHT; row++)
+        {
+            PlaneRow set = {0, 0};
+            for (unsigned char plane = 0; plane < NUM_PLANES; plane++)
+            {
+                set |= chip8.getPlaneRow(plane, row);
+            }
+            frame.display[2 * row] = set[0];
+            frame.display[2 * row + 1] = set[1];
+        }
+    }
+    else
+    {
+        std::copy(chip8.getDisplay().begin(), chip8.getDisplay().end(),
+                  frame.display.begin());
+    }
+
+    // A frame equal to the last one queued is only a marker for the writer
+    const size_t size = width / 64 * height * sizeof(uint64_t);
+    frame.repeat = position > 0 &&
+                   std::memcmp(frame.display.data(), last.data(), size) == 0;
+    if (!frame.repeat)
+    {
+        std::memcpy(last.data(), frame.display.data(), size);
+    }
+    tail.store(position + 1, std::memory_order_release);
+
+    captured.fetch_add(1, std::memory_order_relaxed);
+    if (frame.repeat)
+    {
+        repeated.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+CaptureStatistics FrameCapture::getStatistics() const
+{
+    CaptureStatistics statistics;
+    statistics.captured = captured.load(std::memory_order_relaxed);
+    statistics.repeated = repeated.load(std::memory_order_relaxed);
+    statistics.dropped = dropped.load(std::memory_order_relaxed);
+    statistics.written = written.load(std::memory_order_relaxed);
+    statistics.bytes = bytes.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+void FrameCapture::loop()
+{
+    while (true)
+    {
+        // The capture is closed once the ring is empty after the producer
+        // stopped
+        const bool stop = stopping.load(std::memory_order_acquire);
+        const size_t position = head.load(std::memory_order_relaxed);
+        if (position == tail.load(std::memory_order_acquire))
+        {
+            if (stop)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(
+                std::chrono::microseconds(CAPTURE_POLL_MICROSECONDS));
+            continue;
+        }
+
+        // A new frame is only written once it is known how many times it
+        // repeats
+        const Frame &frame = ring[position % ring.size()];
+        if (frame.repeat)
+        {
+            repeats++;
+        }
+        else
+        {
+            flush();
+            convert(frame);
+        }
+        head.store(position + 1, std::memory_order_release);
+    }
+    flush();
+    stream->flush();
+    failed |= stream->fail();
+}
+
+void FrameCapture::convert(const Frame &frame)
+{
+    const size_t count =
+        static_cast<size_t>(width) * height * scaler.getScale() *
+        scaler.getScale();
+    pixels.resize(count);
+    scaler.expand(frame.display.data(), width, height, pixels.data());
+
+    if (format == RawFormat)
+    {
+        converted.resize(4 * count);
+        for (size_t pixel = 0; pixel < count; pixel++)
+        {
+            for (unsigned int index = 0; index < 4; index++)
+            {
+                converted[4 * pixel + index] = channel(pixels[pixel], index);
+            }
+        }
+        return;
+    }
+
+    // The planes of Y, Cb and Cr, with the full range weights of JPEG. There
+    // are only two colours, so the last one is converted once.
+    converted.resize(3 * count);
+    uint32_t color = ~pixels[0];
+    unsigned char y = 0, cb = 0, cr = 0;
+    for (size_t pixel = 0; pixel < count; pixel++)
+    {
+        if (pixels[pixel] != color)
+        {
+            color = pixels[pixel];
+            y = component(color, 77, 150, 29, 0);
+            cb = component(color, -43, -85, 128, 128);
+            cr = component(color, 128, -107, -21, 128);
+        }
+        converted[pixel] = y;
+        converted[count + pixel] = cb;
+        converted[2 * count + pixel] = cr;
+    }
+}
+
+void FrameCapture::flush()
+{
+    if (converted.empty())
+    {
+        return;
+    }
+
+    // The planes are converted with the full range weights of JPEG, which
+    // the readers of Y4M only know of from the colour range tag
+    if (format == Y4mFormat && !started)
+    {
+        const std::string header =
+            "YUV4MPEG2 W" + std::to_string(width * scaler.getScale()) + " H" +
+            std::to_string(height * scaler.getScale()) + " F" +
+            std::to_string(FRAME_RATE) +
+            ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+        write(header.data(), header.size());
+        started = true;
+    }
+
+    // Without the repeat tag, every copy is written in full
+    const bool tagged = format == Y4mFormat && repeatTags;
+    for (unsigned long copy = 0; copy <= (tagged ? 0 : repeats); copy++)
+    {
+        if (format == Y4mFormat)
+        {
+            const std::string header =
+                tagged && repeats > 0
+                    ? "FRAME XREPEAT=" + std::to_string(repeats) + "\n"
+                    : "FRAME\n";
+            write(header.data(), header.size());
+        }
+        write(converted.data(), converted.size());
+    }
+
+    written.fetch_add(repeats + 1, std::memory_order_relaxed);
+    converted.clear();
+    repeats = 0;
+}
+
+void FrameCapture::write(const void *data, size_t size)
+{
+    stream->write(static_cast<const char *>(data), size);
+    failed |= stream->fail();
+    bytes.fetch_add(size, std::memory_order_relaxed);
+}
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cstring>
+
+#include "frameScaler.hpp"
+
+namespace
+{
+// Mask of the pixels of each byte of a row, with the pixel of its most
+// significant bit first.
+const std::array<PixelBlock, 256> byteMasks = [] {
+    std::array<PixelBlock, 256> masks;
+    for (unsigned int byte = 0; byte < masks.size(); byte++)
+    {
+        for (unsigned int pixel = 0; pixel < 8; pixel++)
+        {
+            masks[byte][pixel] = (byte >> (7 - pixel) & 0x1) != 0 ? ~0u : 0u;
+        }
+    }
+    return masks;
+}();
+
+// Returns true if the pixel at a column of a row of the display is set
+inline bool isSet(const uint64_t *row, unsigned int column)
+{
+    return (row[column / 64] >> (63 - column % 64) & 0x1) != 0;
+}
+
+// Returns true if the row of the display is selected by rows, where each
+// bit stands for height / 32 rows
+inline bool isSelected(uint32_t rows, unsigned int row, unsigned int height)
+{
+    return (rows >> (row / (height / DISPLAY_HEIGHT)) & 0x1) != 0;
+}
+} // namespace
+
+FrameScaler::FrameScaler(unsigned int scale)
+{
+    setScale(scale);
+    setColors(DEFAULT_FOREGROUND, DEFAULT_BACKGROUND);
+}
+
+void FrameScaler::setScale(unsigned int scale)
+{
+    this->scale =
+        std::clamp(scale, 1u, static_cast<unsigned int>(MAX_SCALE));
+    scaledRow.resize(EXTENDED_DISPLAY_WIDTH * this->scale / 8);
+}
+
+void FrameScaler::setColors(uint32_t foreground, uint32_t background)
+{
+    this->foreground = foreground;
+    this->background = background;
+    for (unsigned int pixel = 0; pixel < 8; pixel++)
+    {
+        foregroundBlock[pixel] = foreground;
+        backgroundBlock[pixel] = background;
+    }
+    updatePalette();
+}
+
+void FrameScaler::setDecay(unsigned char decay)
+{
+    this->decay = decay;
+}
+
+void FrameScaler::reset()
+{
+    std::fill(brightness.begin(), brightness.end(), 0);
+}
+
+void FrameScaler::updatePalette()
+{
+    for (unsigned int level = 0; level < palette.size(); level++)
+    {
+        uint32_t color = 0;
+        for (unsigned int shift = 0; shift < 32; shift += 8)
+        {
+            const int from = background >> shift & 0xff;
+            const int to = foreground >> shift & 0xff;
+            const int channel = from + (to - from) * static_cast<int>(level) /
+                                           static_cast<int>(palette.size() - 1);
+            color |= static_cast<uint32_t>(channel) << shift;
+        }
+        palette[level] = color;
+    }
+}
+
+unsigned int FrameScaler::getWidth(const Chip8 &chip8) const
+{
+    return (chip8.isExtended() ? EXTENDED_DISPLAY_WIDTH : DISPLAY_WIDTH) *
+           scale;
+}
+
+unsigned int FrameScaler::getHeight(const Chip8 &chip8) const
+{
+    return (chip8.isExtended() ? EXTENDED_DISPLAY_HEIGHT : DISPLAY_HEIGHT) *
+           scale;
+}
+
+void FrameScaler::expand(const Chip8 &chip8, uint32_t *pixels, uint32_t rows)
+{
+    if (!chip8.isExtended())
+    {
+        expand(chip8.getDisplay().data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+               pixels, rows);
+        return;
+    }
+
+    // A pixel of the extended display is set if it is set in any plane
+    for (unsigned char row = 0; row < EXTENDED_DISPLAY_HEIGHT; row++)
+    {
+        PlaneRow set = {0, 0};
+        for (unsigned char plane = 0; plane < NUM_PLANES; plane++)
+        {
+            set |= chip8.getPlaneRow(plane, row);
+        }
+        combined[2 * row] = set[0];
+        combined[2 * row + 1] = set[1];
+    }
+    expand(combined.data(), EXTENDED_DISPLAY_WIDTH, EXTENDED_DISPLAY_HEIGHT,
+           pixels, rows);
+}
+
+void FrameScaler::expand(const uint64_t *display, unsigned int width,
+                         unsigned int height, uint32_t *pixels, uint32_t rows)
+{
+    // The brightness is kept for the display in use, and starts dark
+    const size_t size = static_cast<size_t>(width) * height;
+    if (decay != 0 && brightness.size() != size)
+    {
+        brightness.assign(size, 0);
+    }
+
+    const unsigned int words = width / 64;
+    const size_t rowPixels = static_cast<size_t>(width) * scale * scale;
+    for (unsigned int row = 0; row < height; row++)
+    {
+        const uint64_t *source = display + row * words;
+        uint32_t *target = pixels + row * rowPixels;
+        if (decay != 0)
+        {
+            expandRowDecay(source, width, brightness.data() + row * width,
+                           target);
+        }
+        else if (!isSelected(rows, row, height))
+        {
+            continue;
+        }
+        else if (kernel == VectorKernel)
+        {
+            expandRowVector(source, width, target);
+        }
+        else
+        {
+            expandRowScalar(source, width, target);
+        }
+    }
+}
+
+void FrameScaler::expandRowScalar(const uint64_t *row, unsigned int width,
+                                  uint32_t *pixels)
+{
+    const unsigned int scaledWidth = width * scale;
+    for (unsigned int y = 0; y < scale; y++)
+    {
+        for (unsigned int x = 0; x < scaledWidth; x++)
+        {
+            pixels[y * scaledWidth + x] =
+                isSet(row, x / scale) ? foreground : background;
+        }
+    }
+}
+
+void FrameScaler::expandRowVector(const uint64_t *row, unsigned int width,
+                                  uint32_t *pixels)
+{
+    // Scale the row horizontally, a bit per pixel, setting the bits of each
+    // pixel of the row that is set
+    const unsigned int scaledWidth = width * scale;
+    const unsigned int scaledBytes = scaledWidth / 8;
+    std::fill(scaledRow.begin(), scaledRow.begin() + scaledBytes, 0);
+    for (unsigned int word = 0; word < width / 64; word++)
+    {
+        for (uint64_t bits = row[word]; bits != 0; bits &= bits - 1)
+        {
+            const unsigned int column =
+                word * 64 + 63 - __builtin_ctzll(bits);
+            for (unsigned int bit = column * scale;
+                 bit < (column + 1) * scale; bit++)
+            {
+                scaledRow[bit / 8] |= 0x80 >> (bit % 8);
+            }
+        }
+    }
+
+    // Every byte is eight pixels, picked from the colours by its mask
+    for (unsigned int byte = 0; byte < scaledBytes; byte++)
+    {
+        const PixelBlock mask = byteMasks[scaledRow[byte]];
+        const PixelBlock block =
+            (foregroundBlock & mask) | (backgroundBlock & ~mask);
+        std::memcpy(pixels + 8 * byte, &block, sizeof(block));
+    }
+
+    // The rest of the rows the row is scaled to are copies of the first one
+    for (unsigned int y = 1; y < scale; y++)
+    {
+        std::memcpy(pixels + y * scaledWidth, pixels,
+                    scaledWidth * sizeof(uint32_t));
+    }
+}
+
+void FrameScaler::expandRowDecay(const uint64_t *row, unsigned int width,
+                                 unsigned char *levels, uint32_t *pixels)
+{
+    // A pixel that is set is at full brightness, and one that is not keeps
+    // a fraction of the brightness it had
+    for (unsigned int column = 0; column < width; column++)
+    {
+        levels[column] =
+            isSet(row, column) ? 0xff : levels[column] * decay >> 8;
+    }
+
+    const unsigned int scaledWidth = width * scale;
+    for (unsigned int column = 0; column < width; column++)
+    {
+        std::fill_n(pixels + column * scale, scale, palette[levels[column]]);
+    }
+    for (unsigned int y = 1; y < scale; y++)
+    {
+        std::memcpy(pixels + y * scaledWidth, pixels,
+                    scaledWidth * sizeof(uint32_t));
+    }
+}
@@ -0,0 +1,527 @@
+#ifdef CHIP8_JIT
+
+#if !defined(__x86_64__)
+#error "The JIT can only generate x86-64 code"
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <sys/mman.h>
+#include <vector>
+
+#include "jit.hpp"
+
+namespace
+{
+
+// Registers used by the generated code, numbered as in the ModRM byte.
+enum Register : unsigned char
+{
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    EBX = 3,
+    ESI = 6
+};
+
+// Executes an instruction that has no translation to native code.
+int fallback(Chip8 *chip8, unsigned int opcode)
+{
+    const unsigned short instruction = opcode;
+    return chip8->executeInstruction(instruction);
+}
+
+// This class appends x86-64 instructions to a block of code. Every memory
+// operand is addressed relative to rbx, which holds the interpreter.
+class Emitter
+{
+public:
+    std::vector<unsigned char> code;
+
+    void bytes(std::initializer_list<unsigned char> values)
+    {
+        code.insert(code.end(), values);
+    }
+
+    void imm16(uint16_t value)
+    {
+        bytes({static_cast<unsigned char>(value),
+               static_cast<unsigned char>(value >> 8)});
+    }
+
+    void imm32(uint32_t value)
+    {
+        imm16(value);
+        imm16(value >> 16);
+    }
+
+    void imm64(uint64_t value)
+    {
+        imm32(value);
+        imm32(value >> 32);
+    }
+
+    // ModRM and displacement of the operand [rbx + displacement]
+    void operand(unsigned char reg, int32_t displacement)
+    {
+        bytes({static_cast<unsigned char>(0x80 | reg << 3 | EBX)});
+        imm32(displacement);
+    }
+
+    // movzx reg, byte [rbx + displacement]
+    void loadByte(Register reg, int32_t displacement)
+    {
+        bytes({0x0f, 0xb6});
+        operand(reg, displacement);
+    }
+
+    // mov byte [rbx + displacement], reg8
+    void storeByte(Register reg, int32_t displacement)
+    {
+        bytes({0x88});
+        operand(reg, displacement);
+    }
+
+    // mov byte [rbx + displacement], value
+    void storeByteImm(int32_t displacement, unsigned char value)
+    {
+        bytes({0xc6});
+        operand(0, displacement);
+        bytes({value});
+    }
+
+    // add byte [rbx + displacement], value
+    void addByteImm(int32_t displacement, unsigned char value)
+    {
+        bytes({0x80});
+        operand(0, displacement);
+        bytes({value});
+    }
+
+    // cmp byte [rbx + displacement], value
+    void compareByteImm(int32_t displacement, unsigned char value)
+    {
+        bytes({0x80});
+        operand(7, displacement);
+        bytes({value});
+    }
+
+    // cmp reg8, byte [rbx + displacement]
+    void compareByte(Register reg, int32_t displacement)
+    {
+        bytes({0x3a});
+        operand(reg, displacement);
+    }
+
+    // mov word [rbx + displacement], reg16
+    void storeWord(Register reg, int32_t displacement)
+    {
+        bytes({0x66, 0x89});
+        operand(reg, displacement);
+    }
+
+    // mov word [rbx + displacement], value
+    void storeWordImm(int32_t displacement, uint16_t value)
+    {
+        bytes({0x66, 0xc7});
+        operand(0, displacement);
+        imm16(value);
+    }
+
+    // add word [rbx + displacement], reg16
+    void addWord(Register reg, int32_t displacement)
+    {
+        bytes({0x66, 0x01});
+        operand(reg, displacement);
+    }
+
+    // cmp word [rbx + displacement], value
+    void compareWordImm(int32_t displacement, uint16_t value)
+    {
+        bytes({0x66, 0x81});
+        operand(7, displacement);
+        imm16(value);
+    }
+
+    // mov reg, value
+    void moveImm(Register reg, uint32_t value)
+    {
+        bytes({static_cast<unsigned char>(0xb8 + reg)});
+        imm32(value);
+    }
+
+    // Emits a short conditional jump with the given opcode and returns the
+    // position of its displacement, to be patched once the target is known
+    size_t jump(unsigned char opcode)
+    {
+        bytes({opcode, 0x00});
+        return code.size() - 1;
+    }
+
+    // Makes the jump at position land on the current end of the code
+    void patch(size_t position)
+    {
+        code[position] = static_cast<unsigned char>(code.size() - position - 1);
+    }
+
+    // Saves rbx and loads it with the interpreter, received in rdi
+    void prologue()
+    {
+        bytes({0x53});             // push rbx
+        bytes({0x48, 0x89, 0xfb}); // mov rbx, rdi
+    }
+
+    // Adds the instructions executed to the counter, keeping the ErrorCode
+    // in eax, and returns from the block
+    void exit(unsigned long *counter, unsigned char instructions)
+    {
+        if (instructions > 0)
+        {
+            bytes({0x48, 0xba}); // mov rdx, counter
+            imm64(reinterpret_cast<uint64_t>(counter));
+            bytes({0x48, 0x83, 0x02, instructions}); // add qword [rdx], n
+        }
+        bytes({0x5b}); // pop rbx
+        bytes({0xc3}); // ret
+    }
+
+    // Returns from the block with Ok
+    void exitOk(unsigned long *counter, unsigned char instructions)
+    {
+        bytes({0x31, 0xc0}); // xor eax, eax
+        exit(counter, instructions);
+    }
+};
+
+// Short conditional jump opcodes.
+const unsigned char JE = 0x74;
+const unsigned char JNE = 0x75;
+
+} // namespace
+
+JitCompiler::JitCompiler()
+{
+    // The buffer is never writable and executable at once: it is writable
+    // while code is copied into it, and executable the rest of the time
+    void *memory = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+    {
+        buffer = static_cast<unsigned char *>(memory);
+    }
+}
+
+JitCompiler::~JitCompiler()
+{
+    if (buffer != nullptr)
+    {
+        munmap(buffer, JIT_BUFFER_SIZE);
+    }
+}
+
+JitFunction JitCompiler::getBlock(const Chip8 &chip8, unsigned short address)
+{
+    // There is no instruction starting at the last byte of memory
+    if (address + 1 >= NUM_BYTES_MEMORY)
+    {
+        return nullptr;
+    }
+
+    JitBlock &block = blocks[address];
+    if (!block.valid)
+    {
+        compile(chip8, address, block);
+    }
+    return block.code;
+}
+
+void JitCompiler::invalidate(unsigned short index, unsigned short count)
+{
+    // Only blocks starting less than a whole block before the written bytes
+    // can overlap them
+    const unsigned short maxBlockBytes = 2 * MAX_BLOCK_LENGTH;
+    const unsigned short first =
+        index > maxBlockBytes ? index - maxBlockBytes : 0;
+    for (unsigned short address = first;
+         address < index + count && address < NUM_BYTES_MEMORY; address++)
+    {
+        JitBlock &block = blocks[address];
+        if (block.valid && block.end > index)
+        {
+            block.valid = false;
+            statistics.invalidated++;
+        }
+    }
+}
+
+void JitCompiler::compile(const Chip8 &chip8, unsigned short address,
+                          JitBlock &block)
+{
+    // Offsets of the registers inside the interpreter
+    const unsigned char *base = reinterpret_cast<const unsigned char *>(&chip8);
+    auto offset = [base](const void *member) {
+        return static_cast<int32_t>(
+            reinterpret_cast<const unsigned char *>(member) - base);
+    };
+    const int32_t pc = offset(&chip8.registers.pc);
+    const int32_t i = offset(&chip8.registers.i);
+    auto v = [&offset, &chip8](unsigned char index) {
+        return offset(&chip8.registers.v[index]);
+    };
+
+    unsigned long *counter = &statistics.instructions;
+    Emitter emitter;
+    emitter.prologue();
+
+    // The code is generated for the quirk set in use, which drops it when it
+    // changes
+    const unsigned char quirks = chip8.getQuirks();
+
+    unsigned char count = 0;
+    bool terminated = false;
+    bool exited = false;
+    while (count < MAX_BLOCK_LENGTH && address + 1 < NUM_BYTES_MEMORY &&
+           !terminated)
+    {
+        const Chip8::Instruction in = Chip8::decode(
+            chip8.getMemory(address) << 8 | chip8.getMemory(address + 1),
+            quirks);
+        const unsigned short next = address + 2;
+        const unsigned char shifted =
+            (quirks & ShiftVyQuirk) != 0 ? in.y : in.x;
+        terminated = Chip8::endsBlock(in);
+
+        bool translated = true;
+        switch (in.opcode >> 12)
+        {
+        case 0x1:
+            // 1nnn - JP addr
+            emitter.storeWordImm(pc, in.nnn);
+            emitter.exitOk(counter, count + 1);
+            break;
+        case 0x3:
+        case 0x4:
+            // 3xkk - SE Vx, byte and 4xkk - SNE Vx, byte
+            emitter.compareByteImm(v(in.x), in.kk);
+            emitter.moveImm(EAX, next);
+            emitter.moveImm(ECX, static_cast<unsigned short>(address + 4));
+            emitter.bytes({0x0f, static_cast<unsigned char>(
+                                     in.opcode >> 12 == 0x3 ? 0x44 : 0x45),
+                           0xc1}); // cmove or cmovne eax, ecx
+            emitter.storeWord(EAX, pc);
+            emitter.exitOk(counter, count + 1);
+            break;
+        case 0x5:
+            // 5xy0 - SE Vx, Vy
+            emitter.loadByte(EDX, v(in.x));
+            emitter.compareByte(EDX, v(in.y));
+            emitter.moveImm(EAX, next);
+            emitter.moveImm(ECX, static_cast<unsigned short>(address + 4));
+            emitter.bytes({0x0f, 0x44, 0xc1}); // cmove eax, ecx
+            emitter.storeWord(EAX, pc);
+            emitter.exitOk(counter, count + 1);
+            break;
+        case 0x6:
+            // 6xkk - LD Vx, byte
+            emitter.storeByteImm(v(in.x), in.kk);
+            break;
+        case 0x7:
+            // 7xkk - ADD Vx, byte
+            emitter.addByteImm(v(in.x), in.kk);
+            break;
+        case 0x8:
+            switch (in.n)
+            {
+            case 0x0:
+                // 8xy0 - LD Vx, Vy
+                emitter.loadByte(EAX, v(in.y));
+                emitter.storeByte(EAX, v(in.x));
+                break;
+            case 0x1:
+            case 0x2:
+            case 0x3:
+                // 8xy1 - OR, 8xy2 - AND and 8xy3 - XOR
+                emitter.loadByte(EAX, v(in.x));
+                emitter.loadByte(ECX, v(in.y));
+                emitter.bytes({in.n == 0x1   ? static_cast<unsigned char>(0x08)
+                               : in.n == 0x2 ? static_cast<unsigned char>(0x20)
+                                             : static_cast<unsigned char>(0x30),
+                               0xc8}); // or, and or xor al, cl
+                emitter.storeByte(EAX, v(in.x));
+                if ((quirks & ResetVfQuirk) != 0)
+                {
+                    emitter.storeByteImm(v(0xf), 0x0);
+                }
+                break;
+            case 0x4:
+                // 8xy4 - ADD Vx, Vy
+                emitter.loadByte(EAX, v(in.x));
+                emitter.loadByte(ECX, v(in.y));
+                emitter.bytes({0x01, 0xc8}); // add eax, ecx
+                emitter.storeByte(EAX, v(in.x));
+                emitter.bytes({0xc1, 0xe8, 0x08}); // shr eax, 8
+                emitter.storeByte(EAX, v(0xf));
+                break;
+            case 0x5:
+            case 0x7:
+            {
+                // 8xy5 - SUB Vx, Vy and 8xy7 - SUBN Vx, Vy. The flag is set
+                // before the subtraction, which reads VF again if involved
+                const unsigned char minuend = in.n == 0x5 ? in.x : in.y;
+                const unsigned char subtrahend = in.n == 0x5 ? in.y : in.x;
+                emitter.loadByte(EAX, v(minuend));
+                emitter.loadByte(ECX, v(subtrahend));
+                emitter.bytes({0x38, 0xc8});       // cmp al, cl
+                emitter.bytes({0x0f, 0x97, 0xc2}); // seta dl
+                emitter.storeByte(EDX, v(0xf));
+                emitter.loadByte(EAX, v(minuend));
+                emitter.loadByte(ECX, v(subtrahend));
+                emitter.bytes({0x28, 0xc8}); // sub al, cl
+                emitter.storeByte(EAX, v(in.x));
+                break;
+            }
+            case 0x6:
+                // 8xy6 - SHR Vx, of Vy with the COSMAC quirk
+                emitter.loadByte(EAX, v(shifted));
+                emitter.bytes({0x24, 0x01}); // and al, 1
+                emitter.storeByte(EAX, v(0xf));
+                emitter.loadByte(EAX, v(shifted));
+                emitter.bytes({0xd0, 0xe8}); // shr al, 1
+                emitter.storeByte(EAX, v(in.x));
+                break;
+            case 0xe:
+                // 8xyE - SHL Vx, of Vy with the COSMAC quirk
+                emitter.loadByte(EAX, v(shifted));
+                emitter.bytes({0xc0, 0xe8, 0x07}); // shr al, 7
+                emitter.storeByte(EAX, v(0xf));
+                emitter.loadByte(EAX, v(shifted));
+                emitter.bytes({0xd0, 0xe0}); // shl al, 1
+                emitter.storeByte(EAX, v(in.x));
+                break;
+            default:
+                translated = false;
+                break;
+            }
+            break;
+        case 0xa:
+            // Annn - LD I, addr
+            emitter.storeWordImm(i, in.nnn);
+            break;
+        case 0xf:
+            switch (in.kk)
+            {
+            case 0x1e:
+                // Fx1E - ADD I, Vx
+                emitter.loadByte(EAX, v(in.x));
+                emitter.addWord(EAX, i);
+                break;
+            default:
+                // The timers among them are worked out from the count of
+                // ticks, which is left to the interpreter
+                translated = false;
+                break;
+            }
+            break;
+        default:
+            translated = false;
+            break;
+        }
+
+        // The translated jumps and skips always leave the block
+        exited = translated && terminated;
+
+        if (!translated)
+        {
+            // Execute the instruction in the interpreter, with the program
+            // counter pointing to it
+            emitter.storeWordImm(pc, address);
+            emitter.moveImm(ESI, in.opcode);
+            emitter.bytes({0x48, 0x89, 0xdf}); // mov rdi, rbx
+            emitter.bytes({0x48, 0xb8});       // mov rax, fallback
+            emitter.imm64(reinterpret_cast<uint64_t>(&fallback));
+            emitter.bytes({0xff, 0xd0}); // call rax
+
+            // Leave with its ErrorCode if it failed
+            emitter.bytes({0x85, 0xc0}); // test eax, eax
+            const size_t succeeded = emitter.jump(JE);
+            emitter.exit(counter, count);
+            emitter.patch(succeeded);
+
+            // Leave if it did not continue at the next instruction or if it
+            // wrote to the memory of this block
+            emitter.compareWordImm(pc, next);
+            const size_t jumped = emitter.jump(JNE);
+            emitter.bytes({0x48, 0xb8}); // mov rax, &block.valid
+            emitter.imm64(reinterpret_cast<uint64_t>(&block.valid));
+            emitter.bytes({0x80, 0x38, 0x00}); // cmp byte [rax], 0
+            const size_t valid = emitter.jump(JNE);
+            emitter.patch(jumped);
+            emitter.exitOk(counter, count + 1);
+            emitter.patch(valid);
+        }
+
+        address = next;
+        count++;
+    }
+
+    // Unless the last instruction already left the block, continue at the
+    // next address
+    if (!exited)
+    {
+        emitter.storeWordImm(pc, address);
+        emitter.exitOk(counter, count);
+    }
+
+    // Make room for the code, starting over if the buffer is full, and copy
+    // it while the buffer is writable. The block is left invalid, and
+    // executed by the interpreter, if the protection cannot be changed.
+    if (used + emitter.code.size() > JIT_BUFFER_SIZE)
+    {
+        flush();
+    }
+    block.code = nullptr;
+    if (!setExecutable(false))
+    {
+        return;
+    }
+    std::memcpy(buffer + used, emitter.code.data(), emitter.code.size());
+    if (!setExecutable(true))
+    {
+        return;
+    }
+    block.code = reinterpret_cast<JitFunction>(buffer + used);
+    used += emitter.code.size();
+
+    block.end = address;
+    block.valid = true;
+    statistics.compiled++;
+}
+
+void JitCompiler::flush()
+{
+    for (JitBlock &block : blocks)
+    {
+        block.valid = false;
+    }
+    used = 0;
+    setExecutable(false);
+}
+
+bool JitCompiler::setExecutable(bool enabled)
+{
+    if (enabled == executable)
+    {
+        return true;
+    }
+    const int protection =
+        enabled ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE;
+    if (mprotect(buffer, JIT_BUFFER_SIZE, protection) != 0)
+    {
+        return false;
+    }
+    executable = enabled;
+    return true;
+}
+
+#endif
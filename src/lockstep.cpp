@@ -0,0 +1,648 @@
+#include <algorithm>
+
+#include "lockstep.hpp"
+
+namespace
+{
+// Mask of LANE_BLOCK lanes with word sized elements, and the same lanes as
+// quad words, used to count them.
+typedef short LaneWordMask __attribute__((vector_size(2 * LANE_BLOCK)));
+typedef unsigned long long LaneQuads __attribute__((vector_size(LANE_BLOCK)));
+
+// Number of groups smaller than MIN_GROUP_SIZE issued in a step before the
+// rest of the step is executed one lane at a time.
+const size_t MAX_DIVERGED_GROUPS = 8;
+
+// Returns the number of lanes selected by mask
+inline size_t countLanes(const LaneMask &mask)
+{
+    const LaneQuads quads = reinterpret_cast<LaneQuads>(mask);
+    size_t bits = 0;
+    for (size_t index = 0; index < LANE_BLOCK / 8; index++)
+    {
+        bits += __builtin_popcountll(quads[index]);
+    }
+    return bits / 8;
+}
+
+// Returns true if mask selects any lane
+inline bool anyLane(const LaneMask &mask)
+{
+    const LaneQuads quads = reinterpret_cast<LaneQuads>(mask);
+    unsigned long long bits = 0;
+    for (size_t index = 0; index < LANE_BLOCK / 8; index++)
+    {
+        bits |= quads[index];
+    }
+    return bits != 0;
+}
+
+// Writes value to target in the lanes selected by mask
+inline void write(LaneBytes &target, const LaneBytes &value,
+                  const LaneMask &mask)
+{
+    const LaneBytes select = reinterpret_cast<LaneBytes>(mask);
+    target = (target & ~select) | (value & select);
+}
+
+inline void write(LaneWords &target, const LaneWords &value,
+                  const LaneMask &mask)
+{
+    const LaneWords select = reinterpret_cast<LaneWords>(
+        __builtin_convertvector(mask, LaneWordMask));
+    target = (target & ~select) | (value & select);
+}
+
+// Advances the PC of the lanes selected by mask, skipping the next
+// instruction in the lanes where condition holds
+inline void skip(LaneWords &pc, const LaneMask &condition,
+                 const LaneMask &mask)
+{
+    const LaneWords step = reinterpret_cast<LaneWords>(
+        __builtin_convertvector(condition, LaneWordMask));
+    write(pc, pc + (2 + (step & 2)), mask);
+}
+} // namespace
+
+LockstepEngine::LockstepEngine(size_t lanes)
+    : lanes(lanes), blocks((lanes + LANE_BLOCK - 1) / LANE_BLOCK),
+      i(blocks), pc(blocks), sp(blocks), dtr(blocks), str(blocks),
+      running(blocks), pending(blocks), errors(lanes, Ok),
+      machines(std::make_unique<Chip8[]>(lanes))
+{
+    for (std::vector<LaneBytes> &registers : v)
+    {
+        registers.resize(blocks);
+    }
+    for (std::vector<LaneWords> &level : stack)
+    {
+        level.resize(blocks);
+    }
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+        machines[lane].setLogging(false);
+        machines[lane].initialize();
+        loadLane(lane);
+        running[lane / LANE_BLOCK][lane % LANE_BLOCK] = -1;
+    }
+    written.fill(false);
+    statistics.lanes = lanes;
+}
+
+LockstepEngine::~LockstepEngine() = default;
+
+ErrorCode LockstepEngine::loadProgram(const unsigned char *program,
+                                      size_t size)
+{
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+        Chip8 &machine = machines[lane];
+        machine.initialize();
+        const ErrorCode result = machine.loadProgram(program, size);
+        if (result != Ok)
+        {
+            return result;
+        }
+        loadLane(lane);
+        running[lane / LANE_BLOCK][lane % LANE_BLOCK] = -1;
+        errors[lane] = Ok;
+    }
+    written.fill(false);
+    frames = 0;
+    return Ok;
+}
+
+void LockstepEngine::setQuirks(unsigned char quirks)
+{
+    this->quirks = quirks % NUM_QUIRK_SETS;
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+        machines[lane].setQuirks(quirks);
+    }
+}
+
+void LockstepEngine::seedRandom(uint64_t seed)
+{
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+        machines[lane].seedRandom(seed + lane);
+    }
+}
+
+unsigned long LockstepEngine::step()
+{
+    unsigned long executed = 0;
+    size_t diverged = 0;
+    std::copy(running.begin(), running.end(), pending.begin());
+
+    // Issue a group for the first pending lane until every lane has executed
+    // its instruction. Lanes before the first pending one are never pending
+    // again in this step.
+    size_t block = 0;
+    while (diverged < MAX_DIVERGED_GROUPS)
+    {
+        while (block < blocks && !anyLane(pending[block]))
+        {
+            block++;
+        }
+        if (block == blocks)
+        {
+            break;
+        }
+        size_t leader = block * LANE_BLOCK;
+        while (pending[block][leader % LANE_BLOCK] == 0)
+        {
+            leader++;
+        }
+
+        const size_t count = executeGroup(leader);
+        statistics.groups++;
+        executed += count;
+        if (count < MIN_GROUP_SIZE)
+        {
+            diverged++;
+        }
+    }
+
+    // Too many lanes have diverged to be worth grouping them
+    for (; block < blocks; block++)
+    {
+        for (size_t index = 0; index < LANE_BLOCK; index++)
+        {
+            if (pending[block][index] != 0)
+            {
+                executeLane(block * LANE_BLOCK + index);
+                executed += isRunning(block * LANE_BLOCK + index) ? 1 : 0;
+                statistics.groups++;
+            }
+        }
+    }
+
+    statistics.steps++;
+    statistics.instructions += executed;
+    return executed;
+}
+
+unsigned long LockstepEngine::run(unsigned long steps)
+{
+    unsigned long executed = 0;
+    for (unsigned long count = 0; count < steps; count++)
+    {
+        if (std::none_of(running.begin(), running.end(), anyLane))
+        {
+            break;
+        }
+        executed += step();
+    }
+    return executed;
+}
+
+unsigned long LockstepEngine::runFrames(unsigned long count)
+{
+    unsigned long executed = 0;
+    for (unsigned long frame = 0; frame < count; frame++)
+    {
+        if (std::none_of(running.begin(), running.end(), anyLane))
+        {
+            break;
+        }
+        executed += run(instructionsPerFrame);
+        tickTimers();
+        frames++;
+    }
+    return executed;
+}
+
+void LockstepEngine::tickTimers()
+{
+    // A lane compared to zero is all ones where it is not zero yet, and
+    // adding all ones decrements it
+    for (size_t block = 0; block < blocks; block++)
+    {
+        const LaneBytes select = reinterpret_cast<LaneBytes>(running[block]);
+        dtr[block] += reinterpret_cast<LaneBytes>(dtr[block] != 0) & select;
+        str[block] += reinterpret_cast<LaneBytes>(str[block] != 0) & select;
+    }
+}
+
+bool LockstepEngine::isRunning(size_t lane) const
+{
+    return running[lane / LANE_BLOCK][lane % LANE_BLOCK] != 0;
+}
+
+void LockstepEngine::setRegister(size_t lane, unsigned char index,
+                                 unsigned char value)
+{
+    v[index][lane / LANE_BLOCK][lane % LANE_BLOCK] = value;
+}
+
+const Chip8 &LockstepEngine::getLane(size_t lane)
+{
+    storeLane(lane);
+    return machines[lane];
+}
+
+size_t LockstepEngine::executeGroup(size_t leader)
+{
+    const size_t first = leader / LANE_BLOCK;
+    const unsigned short address = pc[first][leader % LANE_BLOCK];
+    const Chip8 &machine = machines[leader];
+    const unsigned short opcode =
+        machine.memory[address] << 8 | machine.memory[address + 1];
+    const Chip8::Instruction in = Chip8::decode(opcode, quirks);
+
+    // Every lane holds the same code unless some lane wrote to it. The pc
+    // wraps around at the end of memory, as the memory itself does.
+    const bool shared = !written[address % NUM_BYTES_MEMORY] &&
+                        !written[(address + 1) % NUM_BYTES_MEMORY];
+
+    size_t executed = 0;
+    for (size_t block = first; block < blocks; block++)
+    {
+        LaneMask mask = pending[block] &
+                        __builtin_convertvector(pc[block] == address, LaneMask);
+        if (!shared)
+        {
+            for (size_t index = 0; index < LANE_BLOCK; index++)
+            {
+                if (mask[index] == 0)
+                {
+                    continue;
+                }
+                const Chip8 &lane = machines[block * LANE_BLOCK + index];
+                if ((lane.memory[address] << 8 | lane.memory[address + 1]) !=
+                    opcode)
+                {
+                    mask[index] = 0;
+                }
+            }
+        }
+        if (!anyLane(mask))
+        {
+            continue;
+        }
+        pending[block] &= ~mask;
+
+        if (executeVector(in, block, mask))
+        {
+            const size_t count = countLanes(mask);
+            statistics.vectorInstructions += count;
+            executed += count;
+            continue;
+        }
+        if (executeLanes(in, block, mask))
+        {
+            executed += countLanes(mask & running[block]);
+            continue;
+        }
+        for (size_t index = 0; index < LANE_BLOCK; index++)
+        {
+            if (mask[index] != 0)
+            {
+                executeLane(block * LANE_BLOCK + index);
+                executed += isRunning(block * LANE_BLOCK + index) ? 1 : 0;
+            }
+        }
+    }
+    return executed;
+}
+
+bool LockstepEngine::executeVector(const Chip8::Instruction &in, size_t block,
+                                   const LaneMask &mask)
+{
+    // The registers are referenced, and not copied, so that an instruction
+    // that writes VF reads it again afterwards, as the interpreter does
+    LaneBytes &vx = v[in.x][block];
+    LaneBytes &vy = v[in.y][block];
+    LaneBytes &vf = v[0xf][block];
+    LaneBytes &shifted = (quirks & ShiftVyQuirk) != 0 ? vy : vx;
+    LaneWords &lanePc = pc[block];
+
+    // The stack is only addressed in vector form when every lane has the same
+    // stack pointer
+    size_t first = 0;
+    while (mask[first] == 0)
+    {
+        first++;
+    }
+    const unsigned char laneSp = sp[block][first];
+    const bool sameSp = !anyLane(mask & (sp[block] != laneSp));
+
+    switch (in.opcode >> 12)
+    {
+    case 0x0:
+        // 00EE - RET
+        if (in.opcode != 0x00ee || !sameSp || laneSp == 0 ||
+            laneSp >= SIZE_STACK)
+        {
+            return false;
+        }
+        write(lanePc, stack[laneSp][block], mask);
+        write(sp[block], LaneBytes{} + static_cast<unsigned char>(laneSp - 1),
+              mask);
+        return true;
+    case 0x1:
+        // 1nnn - JP addr
+        write(lanePc, LaneWords{} + in.nnn, mask);
+        return true;
+    case 0x2:
+        // 2nnn - CALL addr
+        if (!sameSp || laneSp + 1 >= SIZE_STACK)
+        {
+            return false;
+        }
+        write(sp[block], LaneBytes{} + static_cast<unsigned char>(laneSp + 1),
+              mask);
+        write(stack[laneSp + 1][block], lanePc, mask);
+        write(lanePc, LaneWords{} + in.nnn, mask);
+        return true;
+    case 0x3:
+        // 3xkk - SE Vx, byte
+        skip(lanePc, vx == in.kk, mask);
+        return true;
+    case 0x4:
+        // 4xkk - SNE Vx, byte
+        skip(lanePc, vx != in.kk, mask);
+        return true;
+    case 0x5:
+        // 5xy0 - SE Vx, Vy
+        skip(lanePc, vx == vy, mask);
+        return true;
+    case 0x6:
+        // 6xkk - LD Vx, byte
+        write(vx, LaneBytes{} + in.kk, mask);
+        break;
+    case 0x7:
+        // 7xkk - ADD Vx, byte
+        write(vx, vx + in.kk, mask);
+        break;
+    case 0x8:
+        switch (in.n)
+        {
+        case 0x0:
+            // 8xy0 - LD Vx, Vy
+            write(vx, vy, mask);
+            break;
+        case 0x1:
+            // 8xy1 - OR Vx, Vy
+            write(vx, vx | vy, mask);
+            if ((quirks & ResetVfQuirk) != 0)
+            {
+                write(vf, LaneBytes{}, mask);
+            }
+            break;
+        case 0x2:
+            // 8xy2 - AND Vx, Vy
+            write(vx, vx & vy, mask);
+            if ((quirks & ResetVfQuirk) != 0)
+            {
+                write(vf, LaneBytes{}, mask);
+            }
+            break;
+        case 0x3:
+            // 8xy3 - XOR Vx, Vy
+            write(vx, vx ^ vy, mask);
+            if ((quirks & ResetVfQuirk) != 0)
+            {
+                write(vf, LaneBytes{}, mask);
+            }
+            break;
+        case 0x4:
+        {
+            // 8xy4 - ADD Vx, Vy
+            const LaneBytes sum = vx + vy;
+            const LaneBytes carry = reinterpret_cast<LaneBytes>(sum < vx) & 1;
+            write(vx, sum, mask);
+            write(vf, carry, mask);
+            break;
+        }
+        case 0x5:
+            // 8xy5 - SUB Vx, Vy
+            write(vf, reinterpret_cast<LaneBytes>(vx > vy) & 1, mask);
+            write(vx, vx - vy, mask);
+            break;
+        case 0x6:
+            // 8xy6 - SHR Vx, of Vy with the COSMAC quirk
+            write(vf, shifted & 1, mask);
+            write(vx, shifted >> 1, mask);
+            break;
+        case 0x7:
+            // 8xy7 - SUBN Vx, Vy
+            write(vf, reinterpret_cast<LaneBytes>(vy > vx) & 1, mask);
+            write(vx, vy - vx, mask);
+            break;
+        case 0xe:
+            // 8xyE - SHL Vx, of Vy with the COSMAC quirk
+            write(vf, shifted >> 7, mask);
+            write(vx, shifted << 1, mask);
+            break;
+        default:
+            return false;
+        }
+        break;
+    case 0xa:
+        // Annn - LD I, addr
+        write(i[block], LaneWords{} + in.nnn, mask);
+        break;
+    case 0xb:
+        // Bnnn - JP V0, addr, or Bxnn - JP Vx, addr with the SCHIP quirk
+        write(lanePc,
+              __builtin_convertvector(
+                  v[(quirks & JumpVxQuirk) != 0 ? in.x : 0x0][block],
+                  LaneWords) +
+                  in.nnn,
+              mask);
+        return true;
+    case 0xf:
+        switch (in.kk)
+        {
+        case 0x07:
+            // Fx07 - LD Vx, DT
+            write(vx, dtr[block], mask);
+            break;
+        case 0x15:
+            // Fx15 - LD DT, Vx
+            write(dtr[block], vx, mask);
+            break;
+        case 0x18:
+            // Fx18 - LD ST, Vx
+            write(str[block], vx, mask);
+            break;
+        case 0x1e:
+            // Fx1E - ADD I, Vx
+            write(i[block], i[block] + __builtin_convertvector(vx, LaneWords), mask);
+            break;
+        default:
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    write(lanePc, lanePc + 2, mask);
+    return true;
+}
+
+bool LockstepEngine::executeLanes(const Chip8::Instruction &in, size_t block,
+                                  const LaneMask &mask)
+{
+    // Only the instructions that read or write the memory or the generator of
+    // the lanes are executed here
+    const bool memory = in.opcode >> 12 == 0xf &&
+                        (in.kk == 0x33 || in.kk == 0x55 || in.kk == 0x65);
+    if (in.opcode >> 12 != 0xc && !memory)
+    {
+        return false;
+    }
+
+    for (size_t index = 0; index < LANE_BLOCK; index++)
+    {
+        if (mask[index] == 0)
+        {
+            continue;
+        }
+        const size_t lane = block * LANE_BLOCK + index;
+        Chip8 &machine = machines[lane];
+        const unsigned short laneI = i[block][index];
+        if (memory && laneI + std::max<unsigned short>(in.x, 2) >=
+                          NUM_BYTES_MEMORY)
+        {
+            // Let the interpreter deal with the memory it cannot address
+            executeLane(lane);
+            continue;
+        }
+
+        if (!memory)
+        {
+            // Cxkk - RND Vx, byte, whose byte may be any of the cases below
+            v[in.x][block][index] =
+                static_cast<unsigned char>(machine.random.next() >> 24) &
+                in.kk;
+            pc[block][index] += 2;
+            continue;
+        }
+
+        switch (in.kk)
+        {
+        case 0x33:
+        {
+            // Fx33 - LD B, Vx
+            const unsigned char value = v[in.x][block][index];
+            machine.memory.write(laneI, value / 100);
+            machine.memory.write(laneI + 1, (value / 10) % 10);
+            machine.memory.write(laneI + 2, value % 10);
+            std::fill_n(&written[laneI], 3, true);
+            break;
+        }
+        case 0x55:
+            // Fx55 - LD [I], Vx
+            for (unsigned char reg = 0; reg <= in.x; reg++)
+            {
+                machine.memory.write(laneI + reg, v[reg][block][index]);
+            }
+            std::fill_n(&written[laneI], in.x + 1, true);
+            if ((quirks & IncrementIQuirk) != 0)
+            {
+                i[block][index] += in.x + 1;
+            }
+            break;
+        default:
+            // Fx65 - LD Vx, [I]
+            for (unsigned char reg = 0; reg <= in.x; reg++)
+            {
+                v[reg][block][index] = machine.memory[laneI + reg];
+            }
+            if ((quirks & IncrementIQuirk) != 0)
+            {
+                i[block][index] += in.x + 1;
+            }
+            break;
+        }
+        pc[block][index] += 2;
+    }
+    return true;
+}
+
+void LockstepEngine::executeLane(size_t lane)
+{
+    pending[lane / LANE_BLOCK][lane % LANE_BLOCK] = 0;
+    storeLane(lane);
+
+    Chip8 &machine = machines[lane];
+    const unsigned short address = machine.registers.pc;
+    const unsigned short opcode =
+        machine.memory[address] << 8 | machine.memory[address + 1];
+
+    // Keep track of the memory written, which may hold code that is no
+    // longer the same in every lane
+    const unsigned short start = machine.registers.i;
+    size_t count = 0;
+    if ((opcode & 0xf0ff) == 0xf033)
+    {
+        count = 3;
+    }
+    else if ((opcode & 0xf0ff) == 0xf055)
+    {
+        count = ((opcode >> 8) & 0xf) + 1;
+    }
+    for (size_t index = start; index < start + count; index++)
+    {
+        written[index % NUM_BYTES_MEMORY] = true;
+    }
+
+    // A lane waiting on a key executes the same instruction on the next step
+    const ErrorCode result = machine.executeInstruction(opcode);
+    loadLane(lane);
+    if (result != Ok && result != KeyWaitPending)
+    {
+        stopLane(lane, result);
+    }
+}
+
+void LockstepEngine::storeLane(size_t lane)
+{
+    const size_t block = lane / LANE_BLOCK;
+    const size_t index = lane % LANE_BLOCK;
+    Chip8 &machine = machines[lane];
+    for (size_t reg = 0; reg < NUM_REGISTERS; reg++)
+    {
+        machine.registers.v[reg] = v[reg][block][index];
+    }
+    machine.registers.i = i[block][index];
+    machine.registers.pc = pc[block][index];
+    machine.registers.sp = sp[block][index];
+    machine.frames = frames;
+    machine.setDelayTimer(dtr[block][index]);
+    machine.setSoundTimer(str[block][index]);
+    for (size_t level = 0; level < SIZE_STACK; level++)
+    {
+        machine.registers.stack[level] = stack[level][block][index];
+    }
+}
+
+void LockstepEngine::loadLane(size_t lane)
+{
+    const size_t block = lane / LANE_BLOCK;
+    const size_t index = lane % LANE_BLOCK;
+    const Chip8 &machine = machines[lane];
+    for (size_t reg = 0; reg < NUM_REGISTERS; reg++)
+    {
+        v[reg][block][index] = machine.registers.v[reg];
+    }
+    i[block][index] = machine.registers.i;
+    pc[block][index] = machine.registers.pc;
+    sp[block][index] = machine.registers.sp;
+    dtr[block][index] = machine.getDelayTimer();
+    str[block][index] = machine.getSoundTimer();
+    for (size_t level = 0; level < SIZE_STACK; level++)
+    {
+        stack[level][block][index] = machine.registers.stack[level];
+    }
+}
+
+void LockstepEngine::stopLane(size_t lane, ErrorCode error)
+{
+    running[lane / LANE_BLOCK][lane % LANE_BLOCK] = 0;
+    errors[lane] = error;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "pagedMemory.hpp"
+#include "utils.hpp"
+
+static_assert(NUM_MEMORY_PAGES <= 16, "a page needs a bit of privatePages");
+
+namespace
+{
+// Pages loaded by any memory, by the checksum of their contents. The table
+// does not keep the pages alive, and a page is only shared if its contents
+// are the same.
+class PageTable
+{
+public:
+    // Returns a shared page with the given contents, creating it if no
+    // memory holds one
+    std::shared_ptr<MemoryPage> share(const MemoryPage &contents)
+    {
+        const uint64_t key = Utils::checksum(contents.data(), contents.size());
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::weak_ptr<MemoryPage>> &candidates = pages[key];
+        for (const std::weak_ptr<MemoryPage> &candidate : candidates)
+        {
+            std::shared_ptr<MemoryPage> page = candidate.lock();
+            if (page != nullptr && *page == contents)
+            {
+                return page;
+            }
+        }
+
+        // Forget the pages no memory holds anymore
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [](const std::weak_ptr<MemoryPage> &page)
+                                        { return page.expired(); }),
+                         candidates.end());
+        std::shared_ptr<MemoryPage> page =
+            std::make_shared<MemoryPage>(contents);
+        candidates.push_back(page);
+        return page;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::vector<std::weak_ptr<MemoryPage>>> pages;
+};
+
+PageTable &pageTable()
+{
+    static PageTable table;
+    return table;
+}
+
+// The page every memory starts with, which is kept for the whole run
+const std::shared_ptr<MemoryPage> &zeroPage()
+{
+    static const std::shared_ptr<MemoryPage> page =
+        pageTable().share(MemoryPage{});
+    return page;
+}
+} // namespace
+
+PagedMemory::PagedMemory()
+{
+    clear();
+}
+
+void PagedMemory::read(unsigned short address, unsigned char *output,
+                       size_t size) const
+{
+    while (size > 0)
+    {
+        const size_t offset = address % MEMORY_PAGE_SIZE;
+        const size_t count = std::min(size, MEMORY_PAGE_SIZE - offset);
+        const MemoryPage &page =
+            *pages[address / MEMORY_PAGE_SIZE % NUM_MEMORY_PAGES];
+        std::memcpy(output, page.data() + offset, count);
+        output += count;
+        address += count;
+        size -= count;
+    }
+}
+
+void PagedMemory::write(unsigned short address, const unsigned char *input,
+                        size_t size)
+{
+    while (size > 0)
+    {
+        const size_t index = address / MEMORY_PAGE_SIZE % NUM_MEMORY_PAGES;
+        const size_t offset = address % MEMORY_PAGE_SIZE;
+        const size_t count = std::min(size, MEMORY_PAGE_SIZE - offset);
+        if (std::memcmp(pages[index]->data() + offset, input, count) != 0)
+        {
+            std::memcpy(writablePage(index).data() + offset, input, count);
+        }
+        input += count;
+        address += count;
+        size -= count;
+    }
+}
+
+void PagedMemory::load(unsigned short address, const unsigned char *input,
+                       size_t size)
+{
+    while (size > 0)
+    {
+        const size_t index = address / MEMORY_PAGE_SIZE % NUM_MEMORY_PAGES;
+        const size_t offset = address % MEMORY_PAGE_SIZE;
+        const size_t count = std::min(size, MEMORY_PAGE_SIZE - offset);
+        MemoryPage contents = *pages[index];
+        std::memcpy(contents.data() + offset, input, count);
+        pages[index] = pageTable().share(contents);
+        privatePages &= ~(0x1 << index);
+        input += count;
+        address += count;
+        size -= count;
+    }
+}
+
+void PagedMemory::clear()
+{
+    pages.fill(zeroPage());
+    privatePages = 0;
+}
+
+uint64_t PagedMemory::hash(uint64_t seed) const
+{
+    for (const std::shared_ptr<MemoryPage> &page : pages)
+    {
+        seed = Utils::hash(page->data(), page->size(), seed);
+    }
+    return seed;
+}
+
+size_t PagedMemory::getPrivatePages() const
+{
+    size_t count = 0;
+    for (size_t index = 0; index < NUM_MEMORY_PAGES; index++)
+    {
+        count += (privatePages >> index & 0x1) != 0 &&
+                 pages[index].use_count() == 1;
+    }
+    return count;
+}
+
+uint16_t PagedMemory::getDifferentPages(const PagedMemory &other) const
+{
+    uint16_t different = 0;
+    for (size_t index = 0; index < NUM_MEMORY_PAGES; index++)
+    {
+        if (pages[index] != other.pages[index])
+        {
+            different |= 0x1 << index;
+        }
+    }
+    return different;
+}
+
+void PagedMemory::makePrivate(size_t index)
+{
+    pages[index] = std::make_shared<MemoryPage>(*pages[index]);
+    privatePages |= 0x1 << index;
+}
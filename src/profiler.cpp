@@ -0,0 +1,268 @@
+#include <iomanip>
+#include <sstream>
+
+#include "profiler.hpp"
+
+namespace
+{
+// Formats a number in hexadecimal with the given number of digits
+std::string hex(unsigned int value, int digits)
+{
+    std::ostringstream stream;
+    stream << "0x" << std::hex << std::setfill('0') << std::setw(digits)
+           << value;
+    return stream.str();
+}
+
+// Formats the fraction of total that count is, as a percentage
+std::string percentage(unsigned long count, unsigned long total)
+{
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(2)
+           << (total > 0 ? 100.0 * count / total : 0.0) << "%";
+    return stream.str();
+}
+} // namespace
+
+void Profiler::reset()
+{
+    instructions = 0;
+    opcodes.fill(0);
+    addresses.fill(0);
+    lastOpcodes.fill(0);
+    depths.fill(0);
+    loopCounts.fill(0);
+    loopEnds.fill(0);
+}
+
+std::string Profiler::opcodeClass(unsigned short opcode)
+{
+    const char *digits = "0123456789ABCDEF";
+    const unsigned char group = opcode >> 12;
+    switch (group)
+    {
+    case 0x0:
+        return opcode == 0x00e0 ? "00E0" : opcode == 0x00ee ? "00EE" : "0nnn";
+    case 0x1:
+    case 0x2:
+    case 0xa:
+    case 0xb:
+        return std::string(1, digits[group]) + "nnn";
+    case 0x3:
+    case 0x4:
+    case 0x6:
+    case 0x7:
+    case 0xc:
+        return std::string(1, digits[group]) + "xkk";
+    case 0x5:
+    case 0x9:
+        return std::string(1, digits[group]) + "xy0";
+    case 0x8:
+        return std::string("8xy") + digits[opcode & 0xf];
+    case 0xd:
+        return "Dxyn";
+    default:
+        return std::string(1, digits[group]) + "x" + digits[(opcode >> 4) & 0xf] +
+               digits[opcode & 0xf];
+    }
+}
+
+std::vector<std::pair<std::string, unsigned long>>
+Profiler::getOpcodeClasses() const
+{
+    // Add up the opcodes of each class, keeping the classes in a stable order
+    std::vector<std::pair<std::string, unsigned long>> classes;
+    for (size_t opcode = 0; opcode < opcodes.size(); opcode++)
+    {
+        if (opcodes[opcode] == 0)
+        {
+            continue;
+        }
+        const std::string name = opcodeClass(opcode);
+        auto entry = std::find_if(classes.begin(), classes.end(),
+                                  [&name](const auto &item)
+                                  { return item.first == name; });
+        if (entry == classes.end())
+        {
+            classes.emplace_back(name, opcodes[opcode]);
+        }
+        else
+        {
+            entry->second += opcodes[opcode];
+        }
+    }
+    std::stable_sort(classes.begin(), classes.end(),
+                     [](const auto &first, const auto &second)
+                     { return first.second > second.second; });
+    return classes;
+}
+
+std::vector<Profiler::Loop> Profiler::getLoops() const
+{
+    std::vector<Loop> loops;
+    for (size_t head = 0; head < NUM_BYTES_MEMORY; head++)
+    {
+        if (loopCounts[head] > 0)
+        {
+            loops.push_back({static_cast<unsigned short>(head), loopEnds[head],
+                             loopCounts[head]});
+        }
+    }
+    std::stable_sort(loops.begin(), loops.end(),
+                     [](const Loop &first, const Loop &second)
+                     { return first.count > second.count; });
+    return loops;
+}
+
+unsigned char Profiler::getMaxDepth() const
+{
+    for (size_t depth = PROFILE_DEPTHS; depth > 0; depth--)
+    {
+        if (depths[depth - 1] > 0)
+        {
+            return depth - 1;
+        }
+    }
+    return 0;
+}
+
+double Profiler::getAverageDepth() const
+{
+    double sum = 0.0;
+    for (size_t depth = 0; depth < PROFILE_DEPTHS; depth++)
+    {
+        sum += static_cast<double>(depth) * depths[depth];
+    }
+    return instructions > 0 ? sum / instructions : 0.0;
+}
+
+void Profiler::writeReport(std::ostream &output) const
+{
+    output << "Instructions executed: " << instructions << std::endl;
+
+    output << std::endl << "Opcode classes:" << std::endl;
+    const auto classes = getOpcodeClasses();
+    for (size_t index = 0;
+         index < std::min<size_t>(classes.size(), PROFILE_REPORT_ENTRIES);
+         index++)
+    {
+        output << "  " << std::left << std::setw(6) << classes[index].first
+               << std::right << std::setw(14) << classes[index].second
+               << std::setw(10)
+               << percentage(classes[index].second, instructions)
+               << std::endl;
+    }
+
+    // The hottest addresses, with the instruction last executed there
+    std::vector<unsigned short> hot;
+    for (size_t address = 0; address < NUM_BYTES_MEMORY; address++)
+    {
+        if (addresses[address] > 0)
+        {
+            hot.push_back(address);
+        }
+    }
+    std::stable_sort(hot.begin(), hot.end(),
+                     [this](unsigned short first, unsigned short second)
+                     { return addresses[first] > addresses[second]; });
+    output << std::endl << "Hot spots:" << std::endl;
+    for (size_t index = 0;
+         index < std::min<size_t>(hot.size(), PROFILE_REPORT_ENTRIES); index++)
+    {
+        const unsigned short address = hot[index];
+        output << "  " << hex(address, 4) << "  "
+               << hex(lastOpcodes[address], 4) << std::setw(14)
+               << addresses[address] << std::setw(10)
+               << percentage(addresses[address], instructions) << std::endl;
+    }
+
+    output << std::endl << "Loops:" << std::endl;
+    const std::vector<Loop> loops = getLoops();
+    for (size_t index = 0;
+         index < std::min<size_t>(loops.size(), PROFILE_REPORT_ENTRIES);
+         index++)
+    {
+        output << "  " << hex(loops[index].head, 4) << "-"
+               << hex(loops[index].end, 4) << std::setw(14)
+               << loops[index].count << " iterations" << std::endl;
+    }
+
+    output << std::endl
+           << "Stack depth: max " << static_cast<int>(getMaxDepth())
+           << ", average " << std::fixed << std::setprecision(2)
+           << getAverageDepth() << std::defaultfloat << std::endl;
+    for (size_t depth = 0; depth < PROFILE_DEPTHS; depth++)
+    {
+        if (depths[depth] > 0)
+        {
+            output << "  " << std::setw(3) << depth << std::setw(14)
+                   << depths[depth] << std::setw(10)
+                   << percentage(depths[depth], instructions) << std::endl;
+        }
+    }
+}
+
+void Profiler::writeJson(std::ostream &output) const
+{
+    output << "{" << std::endl;
+    output << "  \"instructions\": " << instructions << "," << std::endl;
+
+    output << "  \"opcodeClasses\": [";
+    const auto classes = getOpcodeClasses();
+    for (size_t index = 0; index < classes.size(); index++)
+    {
+        output << (index > 0 ? "," : "") << std::endl
+               << "    {\"class\": \"" << classes[index].first
+               << "\", \"count\": " << classes[index].second << "}";
+    }
+    output << std::endl << "  ]," << std::endl;
+
+    output << "  \"addresses\": [";
+    bool first = true;
+    for (size_t address = 0; address < NUM_BYTES_MEMORY; address++)
+    {
+        if (addresses[address] == 0)
+        {
+            continue;
+        }
+        output << (first ? "" : ",") << std::endl
+               << "    {\"address\": \"" << hex(address, 4)
+               << "\", \"opcode\": \"" << hex(lastOpcodes[address], 4)
+               << "\", \"count\": " << addresses[address] << "}";
+        first = false;
+    }
+    output << std::endl << "  ]," << std::endl;
+
+    output << "  \"loops\": [";
+    const std::vector<Loop> loops = getLoops();
+    for (size_t index = 0; index < loops.size(); index++)
+    {
+        output << (index > 0 ? "," : "") << std::endl
+               << "    {\"head\": \"" << hex(loops[index].head, 4)
+               << "\", \"end\": \"" << hex(loops[index].end, 4)
+               << "\", \"count\": " << loops[index].count << "}";
+    }
+    output << std::endl << "  ]," << std::endl;
+
+    output << "  \"stack\": {" << std::endl;
+    output << "    \"maxDepth\": " << static_cast<int>(getMaxDepth()) << ","
+           << std::endl;
+    output << "    \"averageDepth\": " << std::fixed << std::setprecision(4)
+           << getAverageDepth() << std::defaultfloat << "," << std::endl;
+    output << "    \"depths\": [";
+    first = true;
+    for (size_t depth = 0; depth < PROFILE_DEPTHS; depth++)
+    {
+        if (depths[depth] == 0)
+        {
+            continue;
+        }
+        output << (first ? "" : ",") << std::endl
+               << "      {\"depth\": " << depth
+               << ", \"count\": " << depths[depth] << "}";
+        first = false;
+    }
+    output << std::endl << "    ]" << std::endl;
+    output << "  }" << std::endl;
+    output << "}" << std::endl;
+}
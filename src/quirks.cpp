@@ -0,0 +1,83 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "quirks.hpp"
+
+ErrorCode QuirkConfig::load(const std::string &filename)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        std::cout << "Error opening file " << filename << std::endl;
+        return FileOpenError;
+    }
+
+    std::string line;
+    unsigned long number = 0;
+    while (std::getline(file, line))
+    {
+        number++;
+        std::istringstream words(line.substr(0, line.find('#')));
+        std::string program;
+        if (!(words >> program))
+        {
+            continue;
+        }
+
+        unsigned char quirks = 0;
+        std::string name;
+        while (words >> name)
+        {
+            if (!parse(name, quirks))
+            {
+                std::cout << "Error: unknown quirk " << name << " in line "
+                          << number << " of " << filename << std::endl;
+                return Error;
+            }
+        }
+        if (program == "*")
+        {
+            fallback = quirks;
+        }
+        else
+        {
+            set(program, quirks);
+        }
+    }
+    return Ok;
+}
+
+void QuirkConfig::set(const std::string &program, unsigned char quirks)
+{
+    programs[program] = quirks % NUM_QUIRK_SETS;
+}
+
+unsigned char QuirkConfig::find(const std::string &path) const
+{
+    const auto entry =
+        programs.find(std::filesystem::path(path).filename().string());
+    return entry != programs.end() ? entry->second : fallback;
+}
+
+bool QuirkConfig::parse(const std::string &name, unsigned char &quirks)
+{
+    const std::pair<const char *, unsigned char> names[] = {
+        {"none", 0},
+        {"cosmac", COSMAC_QUIRKS},
+        {"schip", SCHIP_QUIRKS},
+        {"shift-vy", ShiftVyQuirk},
+        {"increment-i", IncrementIQuirk},
+        {"jump-vx", JumpVxQuirk},
+        {"reset-vf", ResetVfQuirk}};
+    for (const auto &[known, flags] : names)
+    {
+        if (name == known)
+        {
+            quirks |= flags;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cstring>
+
+#include "rewind.hpp"
+
+namespace
+{
+// Appends a number with seven bits per byte, the lowest first
+void writeNumber(std::vector<unsigned char> &output, size_t value)
+{
+    while (value >= 0x80)
+    {
+        output.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<unsigned char>(value));
+}
+
+// Reads a number written by writeNumber, advancing position
+size_t readNumber(const std::vector<unsigned char> &input, size_t &position)
+{
+    size_t value = 0;
+    for (unsigned int shift = 0; position < input.size(); shift += 7)
+    {
+        const unsigned char byte = input[position++];
+        value |= static_cast<size_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    return value;
+}
+} // namespace
+
+Rewind::Rewind(unsigned long frames, unsigned int keyframeInterval)
+    : ring(std::max(frames, 1ul)),
+      keyframeInterval(std::max(keyframeInterval, 1u)),
+      state(Chip8::getStateSize())
+{
+}
+
+ErrorCode Rewind::record(const Chip8 &chip8)
+{
+    const ErrorCode result = chip8.saveState(state.data(), state.size());
+    if (result != Ok)
+    {
+        return result;
+    }
+
+    // Start a new keyframe every interval, and whenever the one the deltas
+    // would refer to is not kept or is about to be overwritten
+    Frame &frame = frameAt(next);
+    if (count == 0 || next - keyframe >= keyframeInterval ||
+        next - count > keyframe || next - keyframe >= ring.size())
+    {
+        keyframe = next;
+        keyframeState = state;
+        frame.data = state;
+    }
+    else
+    {
+        // A delta stored where a keyframe was does not keep its memory
+        encode(state, keyframeState, frame.data);
+        if (frame.data.capacity() >= state.size() &&
+            frame.data.size() < state.size() / 2)
+        {
+            frame.data.shrink_to_fit();
+        }
+    }
+    frame.keyframe = keyframe;
+    next++;
+    count = std::min<unsigned long>(count + 1, ring.size());
+
+    // The deltas of the oldest frames cannot be restored once their
+    // keyframe has been overwritten
+    while (count > 0 && frameAt(next - count).keyframe < next - count)
+    {
+        count--;
+    }
+    return Ok;
+}
+
+ErrorCode Rewind::rewind(Chip8 &chip8, unsigned long frames)
+{
+    if (frames >= count)
+    {
+        return Error;
+    }
+
+    // Rebuild the state from its keyframe and its delta
+    const unsigned long target = next - 1 - frames;
+    const Frame &frame = frameAt(target);
+    const Frame &key = frameAt(frame.keyframe);
+    state = key.data;
+    if (frame.keyframe != target)
+    {
+        decode(frame.data, state);
+    }
+    const ErrorCode result = chip8.loadState(state.data(), state.size());
+    if (result != Ok)
+    {
+        return result;
+    }
+
+    // Continue recording after the restored frame, with deltas against its
+    // keyframe
+    next = target + 1;
+    count -= frames;
+    keyframe = frame.keyframe;
+    keyframeState = key.data;
+    return Ok;
+}
+
+void Rewind::clear()
+{
+    next = 0;
+    count = 0;
+    keyframe = 0;
+}
+
+size_t Rewind::getMemoryUsage() const
+{
+    size_t bytes = keyframeState.capacity() + state.capacity();
+    for (const Frame &frame : ring)
+    {
+        bytes += frame.data.capacity();
+    }
+    return bytes;
+}
+
+void Rewind::encode(const std::vector<unsigned char> &state,
+                    const std::vector<unsigned char> &keyframe,
+                    std::vector<unsigned char> &delta)
+{
+    // The delta is a sequence of runs: the number of bytes equal to the
+    // keyframe, the number of bytes that differ, and their XOR
+    delta.clear();
+    const size_t size = state.size();
+    size_t position = 0;
+    while (position < size)
+    {
+        // Skip the equal bytes a word at a time
+        const size_t start = position;
+        while (position + sizeof(uint64_t) <= size)
+        {
+            uint64_t a;
+            uint64_t b;
+            std::memcpy(&a, &state[position], sizeof(a));
+            std::memcpy(&b, &keyframe[position], sizeof(b));
+            if (a != b)
+            {
+                break;
+            }
+            position += sizeof(uint64_t);
+        }
+        while (position < size && state[position] == keyframe[position])
+        {
+            position++;
+        }
+        if (position == size)
+        {
+            break;
+        }
+
+        // Take the bytes that differ, up to the next equal one
+        const size_t changed = position;
+        while (position < size && state[position] != keyframe[position])
+        {
+            position++;
+        }
+        writeNumber(delta, changed - start);
+        writeNumber(delta, position - changed);
+        for (size_t index = changed; index < position; index++)
+        {
+            delta.push_back(state[index] ^ keyframe[index]);
+        }
+    }
+}
+
+void Rewind::decode(const std::vector<unsigned char> &delta,
+                    std::vector<unsigned char> &state)
+{
+    size_t input = 0;
+    size_t output = 0;
+    while (input < delta.size())
+    {
+        output += readNumber(delta, input);
+        const size_t changed = readNumber(delta, input);
+        for (size_t index = 0;
+             index < changed && output < state.size() && input < delta.size();
+             index++)
+        {
+            state[output++] ^= delta[input++];
+        }
+    }
+}
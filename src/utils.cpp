@@ -0,0 +1,32 @@
+#include <cstring>
+
+#include "utils.hpp"
+
+uint64_t Utils::hash(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t index = 0; index < size; index++)
+    {
+        hash ^= bytes[index];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t Utils::checksum(const void *data, size_t size)
+{
+    // Multiply and rotate each word into the hash, and hash the bytes that do
+    // not fill a word at the end
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+    size_t index = 0;
+    for (; index + sizeof(uint64_t) <= size; index += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + index, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash = hash << 29 | hash >> 35;
+    }
+    return Utils::hash(bytes + index, size - index, hash);
+}
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "vectorEnv.hpp"
+
+VectorEnv::VectorEnv(size_t count, uint64_t *observations,
+                     unsigned int threads)
+    : observations(observations), rewards(count, 0), done(count, 1),
+      scores(count, 0)
+{
+    for (size_t index = 0; index < count; index++)
+    {
+        machines.push_back(std::make_unique<Chip8>());
+        machines.back()->setLogging(false);
+    }
+
+    // The calling thread steps the first slice
+    unsigned int slices =
+        threads > 0 ? threads : std::thread::hardware_concurrency();
+    slices = std::max(1u, std::min<unsigned int>(slices, count));
+    for (unsigned int slice = 1; slice < slices; slice++)
+    {
+        this->threads.emplace_back(&VectorEnv::loop, this, slice);
+    }
+}
+
+VectorEnv::~VectorEnv()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+ErrorCode VectorEnv::loadProgram(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "Error opening file " << filename << std::endl;
+        return FileOpenError;
+    }
+    program.assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+    return Ok;
+}
+
+ErrorCode VectorEnv::loadProgram(const unsigned char *program, size_t size)
+{
+    if (size > NUM_BYTES_MEMORY - START_AVAILABLE_MEMORY)
+    {
+        return NotEnoughMemory;
+    }
+    this->program.assign(program, program + size);
+    return Ok;
+}
+
+void VectorEnv::setScore(unsigned short address, unsigned char size)
+{
+    scoreAddress = address;
+    scoreSize = std::min<unsigned char>(size, ENV_MAX_SCORE_BYTES);
+}
+
+ErrorCode VectorEnv::reset(const uint64_t *seeds)
+{
+    for (size_t index = 0; index < machines.size(); index++)
+    {
+        const ErrorCode result = reset(index, seeds[index]);
+        if (result != Ok)
+        {
+            return result;
+        }
+    }
+    return Ok;
+}
+
+ErrorCode VectorEnv::reset(size_t index, uint64_t seed)
+{
+    Chip8 &chip8 = *machines[index];
+    chip8.initialize();
+    chip8.seedRandom(seed);
+    chip8.setInstructionsPerFrame(instructionsPerFrame);
+    const ErrorCode result = chip8.loadProgram(program.data(), program.size());
+    if (result != Ok)
+    {
+        return result;
+    }
+
+    // The whole display is written, as every row starts dirty
+    writeObservation(index);
+    rewards[index] = 0;
+    scores[index] = readScore(index);
+    done[index] = 0;
+    return Ok;
+}
+
+void VectorEnv::step(const uint16_t *actions)
+{
+    this->actions = actions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        running = threads.size();
+    }
+    started.notify_all();
+    stepSlice(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return running == 0; });
+}
+
+void VectorEnv::stepSlice(size_t slice)
+{
+    const size_t slices = threads.size() + 1;
+    const size_t end = machines.size() * (slice + 1) / slices;
+    for (size_t index = machines.size() * slice / slices; index < end;
+         index++)
+    {
+        if (done[index] != 0)
+        {
+            rewards[index] = 0;
+            continue;
+        }
+
+        Chip8 &chip8 = *machines[index];
+        chip8.setKeys(actions[index]);
+        for (unsigned int frame = 0; frame < frameSkip; frame++)
+        {
+            if (chip8.runFrame() != Ok)
+            {
+                done[index] = 1;
+                break;
+            }
+        }
+        writeObservation(index);
+        const uint64_t score = readScore(index);
+        rewards[index] = static_cast<int64_t>(score - scores[index]);
+        scores[index] = score;
+    }
+}
+
+void VectorEnv::writeObservation(size_t index)
+{
+    Chip8 &chip8 = *machines[index];
+    uint64_t *observation = observations + index * OBSERVATION_WORDS;
+    for (uint32_t rows = chip8.takeDirtyRows(); rows != 0; rows &= rows - 1)
+    {
+        const unsigned char row = __builtin_ctz(rows);
+        observation[row] = chip8.getDisplayRow(row);
+    }
+}
+
+uint64_t VectorEnv::readScore(size_t index) const
+{
+    uint64_t score = 0;
+    for (unsigned char byte = 0; byte < scoreSize; byte++)
+    {
+        score = score << 8 | machines[index]->getMemory(scoreAddress + byte);
+    }
+    return score;
+}
+
+void VectorEnv::loop(size_t slice)
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [this, seen]()
+                         { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+        }
+
+        stepSlice(slice);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+        }
+        finished.notify_one();
+    }
+}
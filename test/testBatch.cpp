@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "batchRunner.hpp"
+#include "chip8.hpp"
+
+// This class will test the headless batch runner
+class TestBatch : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestBatch);
+    CPPUNIT_TEST(testBatch_threads);
+    CPPUNIT_TEST(testBatch_loadProgram);
+    CPPUNIT_TEST(testBatch_errors);
+    CPPUNIT_TEST(testBatch_frames);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testBatch_threads(void);
+    void testBatch_loadProgram(void);
+    void testBatch_errors(void);
+    void testBatch_frames(void);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestBatch);
+
+void TestBatch::testBatch_threads(void)
+{
+    // The results of a batch do not depend on the number of threads
+    BatchRunner single;
+    BatchRunner pool;
+    CPPUNIT_ASSERT_EQUAL(Ok, single.addPath("games"));
+    CPPUNIT_ASSERT_EQUAL(Ok, pool.addPath("games"));
+    single.setCycles(10000);
+    pool.setCycles(10000);
+    single.setThreads(1);
+    pool.setThreads(4);
+    const std::vector<BatchResult> expected = single.run();
+    const std::vector<BatchResult> actual = pool.run();
+
+    CPPUNIT_ASSERT(!expected.empty());
+    CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+    for (size_t index = 0; index < expected.size(); index++)
+    {
+        CPPUNIT_ASSERT_EQUAL(expected[index].rom, actual[index].rom);
+        CPPUNIT_ASSERT_EQUAL(expected[index].cycles, actual[index].cycles);
+        CPPUNIT_ASSERT_EQUAL(expected[index].error, actual[index].error);
+        CPPUNIT_ASSERT_EQUAL(expected[index].reason, actual[index].reason);
+        CPPUNIT_ASSERT_EQUAL(expected[index].stateHash,
+                             actual[index].stateHash);
+    }
+}
+
+void TestBatch::testBatch_loadProgram(void)
+{
+    // Loading from a buffer and from a file gives the same state
+    const unsigned char program[] = {0x60, 0x12, 0x70, 0x01, 0x12, 0x02};
+    Chip8 buffer;
+    Chip8 file;
+    buffer.initialize();
+    file.initialize();
+    buffer.setLogging(false);
+    CPPUNIT_ASSERT_EQUAL(Ok, buffer.loadProgram(program, sizeof(program)));
+    for (size_t index = 0; index < sizeof(program); index++)
+    {
+        file.setMemory(START_AVAILABLE_MEMORY + index, program[index]);
+    }
+    CPPUNIT_ASSERT_EQUAL(file.hashState(), buffer.hashState());
+
+    // Any change to the state changes the hash
+    CPPUNIT_ASSERT_EQUAL(Ok, buffer.executeCycle());
+    CPPUNIT_ASSERT(file.hashState() != buffer.hashState());
+
+    // A program that does not fit in memory is rejected
+    const std::vector<unsigned char> big(NUM_BYTES_MEMORY, 0);
+    CPPUNIT_ASSERT_EQUAL(NotEnoughMemory,
+                         buffer.loadProgram(big.data(), big.size()));
+}
+
+void TestBatch::testBatch_errors(void)
+{
+    // A path that is neither a file nor a directory is rejected
+    BatchRunner runner;
+    CPPUNIT_ASSERT_EQUAL(FileOpenError, runner.addPath("testBatch.none"));
+
+    // A program that stops on an unknown opcode, one that does not fit in
+    // memory and one that is removed before the batch runs
+    const std::string names[] = {"testBatch.zero", "testBatch.big",
+                                 "testBatch.gone"};
+    const size_t sizes[] = {2, NUM_BYTES_MEMORY, 2};
+    for (size_t index = 0; index < 3; index++)
+    {
+        std::ofstream(names[index], std::ios::binary)
+            << std::string(sizes[index], '\0');
+        CPPUNIT_ASSERT_EQUAL(Ok, runner.addPath(names[index]));
+    }
+    std::remove(names[2].c_str());
+    runner.setThreads(1);
+    const std::vector<BatchResult> results = runner.run();
+    std::remove(names[0].c_str());
+    std::remove(names[1].c_str());
+    CPPUNIT_ASSERT_EQUAL(UnknownOpcode, results[0].reason);
+    CPPUNIT_ASSERT_EQUAL(NotEnoughMemory, results[1].error);
+    CPPUNIT_ASSERT_EQUAL(FileOpenError, results[2].error);
+
+    // Every error and stop reason is written by name
+    std::ostringstream output;
+    runner.writeResults(output);
+    const std::string csv = output.str();
+    CPPUNIT_ASSERT(csv.find("testBatch.zero,0,0,unknown_opcode,") !=
+                   std::string::npos);
+    CPPUNIT_ASSERT(csv.find("testBatch.big,0,0,not_enough_memory,") !=
+                   std::string::npos);
+    CPPUNIT_ASSERT(csv.find("testBatch.gone,0,0,file_open_error,") !=
+                   std::string::npos);
+}
+
+void TestBatch::testBatch_frames(void)
+{
+    // Wait for the delay timer and then stop on an unknown opcode: 0x200 LD
+    // V0, 3, 0x202 LD DT, V0, 0x204 LD V1, DT, 0x206 SE V1, 0 and 0x208 JP
+    // 0x204
+    const unsigned char program[] = {0x60, 0x03, 0xf0, 0x15, 0xf1,
+                                     0x07, 0x31, 0x00, 0x12, 0x04};
+    std::ofstream("testBatch.wait", std::ios::binary)
+        .write(reinterpret_cast<const char *>(program), sizeof(program));
+
+    // Without frames, the timer never counts down
+    BatchRunner cycles;
+    CPPUNIT_ASSERT_EQUAL(Ok, cycles.addPath("testBatch.wait"));
+    cycles.setCycles(10000);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, cycles.run()[0].reason);
+
+    // The frames count the timer down until the program gets past its wait,
+    // as the interpreter does
+    BatchRunner frames;
+    CPPUNIT_ASSERT_EQUAL(Ok, frames.addPath("testBatch.wait"));
+    frames.setFrames(10);
+    const BatchResult result = frames.run()[0];
+    std::remove("testBatch.wait");
+
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram(program, sizeof(program)));
+    RunResult run = {BudgetExhausted, 0};
+    CPPUNIT_ASSERT_EQUAL(Error, chip8.runFrames(10, &run));
+    CPPUNIT_ASSERT_EQUAL(UnknownOpcode, result.reason);
+    CPPUNIT_ASSERT_EQUAL(run.cycles, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(3ul, result.frames);
+    CPPUNIT_ASSERT_EQUAL(chip8.getFrames(), result.frames);
+
+    std::ostringstream output;
+    frames.writeResults(output);
+    CPPUNIT_ASSERT(output.str().find("testBatch.wait," +
+                                     std::to_string(run.cycles) +
+                                     ",3,unknown_opcode,") !=
+                   std::string::npos);
+}
@@ -0,0 +1,222 @@
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "blockCache.hpp"
+#include "chip8.hpp"
+
+// This class will test the caches that avoid decoding instructions again
+class TestCache : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestCache);
+    CPPUNIT_TEST(testPredecode_loop);
+    CPPUNIT_TEST(testPredecode_setInstruction);
+    CPPUNIT_TEST(testPredecode_selfModifying);
+    CPPUNIT_TEST(testPredecode_endOfMemory);
+    CPPUNIT_TEST(testBlock_loop);
+    CPPUNIT_TEST(testBlock_selfModifying);
+    CPPUNIT_TEST(testBlock_endOfMemory);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testPredecode_loop(void);
+    void testPredecode_setInstruction(void);
+    void testPredecode_selfModifying(void);
+    void testPredecode_endOfMemory(void);
+    void testBlock_loop(void);
+    void testBlock_selfModifying(void);
+    void testBlock_endOfMemory(void);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestCache);
+
+void TestCache::testPredecode_loop(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setPredecode(true);
+
+    // Add 3 to V0 in a loop: 0x200 ADD V0, 3 and 0x202 JP 0x200
+    chip8.setInstructionInMemory(0x200, 0x7003);
+    chip8.setInstructionInMemory(0x202, 0x1200);
+
+    // Execute ten iterations of the loop
+    for (size_t cycle = 0; cycle < 20; cycle++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    }
+
+    // Check the cached instructions kept adding to the register
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(30), chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x200), chip8.getPc());
+}
+
+void TestCache::testPredecode_setInstruction(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setPredecode(true);
+
+    // Execute an instruction so that it is cached
+    chip8.setInstructionInMemory(0x200, 0x6005);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x05),
+                         chip8.getRegister(0));
+
+    // Overwrite only the second byte of the instruction and execute it again
+    chip8.setMemory(0x201, 0x07);
+    chip8.setPc(0x200);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+
+    // Check the new instruction was executed instead of the cached one
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x07),
+                         chip8.getRegister(0));
+}
+
+void TestCache::testPredecode_selfModifying(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setPredecode(true);
+
+    // A program that rewrites its first instruction, LD V0, 0x05, into
+    // LD V0, 0x07 through LD [I], V1 and then jumps back to it
+    chip8.setInstructionInMemory(0x200, 0x6005);
+    chip8.setInstructionInMemory(0x202, 0xa200);
+    chip8.setInstructionInMemory(0x204, 0x6060);
+    chip8.setInstructionInMemory(0x206, 0x6107);
+    chip8.setInstructionInMemory(0x208, 0xf155);
+    chip8.setInstructionInMemory(0x20a, 0x1200);
+
+    // Execute the whole program and the rewritten instruction
+    for (size_t cycle = 0; cycle < 7; cycle++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    }
+
+    // Check the rewritten instruction was the one executed
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x07),
+                         chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x202), chip8.getPc());
+}
+
+void TestCache::testPredecode_endOfMemory(void)
+{
+    // 0x200 JP 0xFFE, 0xFFE LD V0, 1, and then the instructions at the
+    // start of memory: 0x000 ADD V1, 2 and 0x002 JP 0x200
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.setInstructionInMemory(0x200, 0x1ffe);
+    chip8.setInstructionInMemory(0xffe, 0x6001);
+    chip8.setInstructionInMemory(0x000, 0x7102);
+    chip8.setInstructionInMemory(0x002, 0x1200);
+
+    // The cached instructions wrap around at the end of memory, as the
+    // memory does
+    Chip8 cached;
+    cached.setLogging(false);
+    cached.initialize();
+    cached.forkFrom(chip8);
+    cached.setPredecode(true);
+    for (size_t cycle = 0; cycle < 12; cycle++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+        CPPUNIT_ASSERT_EQUAL(Ok, cached.executeCycle());
+        CPPUNIT_ASSERT_EQUAL(chip8.getPc(), cached.getPc());
+    }
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(6), cached.getRegister(1));
+    CPPUNIT_ASSERT_EQUAL(chip8.hashState(), cached.hashState());
+}
+
+void TestCache::testBlock_loop(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setBlockCache(true);
+
+    // A loop of three instructions: 0x200 ADD V0, 3, 0x202 ADD V1, 1 and
+    // 0x204 JP 0x200
+    chip8.setInstructionInMemory(0x200, 0x7003);
+    chip8.setInstructionInMemory(0x202, 0x7101);
+    chip8.setInstructionInMemory(0x204, 0x1200);
+
+    // Every block executes a whole iteration of the loop
+    for (size_t iteration = 0; iteration < 10; iteration++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeBlock());
+        CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x200),
+                             chip8.getPc());
+    }
+
+    // Check the registers and the counters of the cache
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(30), chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(10), chip8.getRegister(1));
+    const BlockStatistics statistics = chip8.getBlockStatistics();
+    CPPUNIT_ASSERT_EQUAL(10ul, statistics.executed);
+    CPPUNIT_ASSERT_EQUAL(30ul, statistics.instructions);
+    CPPUNIT_ASSERT_EQUAL(1ul, statistics.compiled);
+    CPPUNIT_ASSERT_EQUAL(0ul, statistics.invalidated);
+}
+
+void TestCache::testBlock_selfModifying(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setBlockCache(true);
+
+    // A block that rewrites its own last instruction, LD V0, 0x05, into
+    // LD V0, 0x07 through LD [I], V1 before reaching it
+    chip8.setInstructionInMemory(0x200, 0xa208);
+    chip8.setInstructionInMemory(0x202, 0x6060);
+    chip8.setInstructionInMemory(0x204, 0x6107);
+    chip8.setInstructionInMemory(0x206, 0xf155);
+    chip8.setInstructionInMemory(0x208, 0x6005);
+    chip8.setInstructionInMemory(0x20a, 0x1200);
+
+    // The first block stops right after the write, and the next one is
+    // compiled from the rewritten memory
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeBlock());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x208), chip8.getPc());
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeBlock());
+
+    // Check the rewritten instruction was the one executed
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x07),
+                         chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x200), chip8.getPc());
+    const BlockStatistics statistics = chip8.getBlockStatistics();
+    CPPUNIT_ASSERT_EQUAL(2ul, statistics.executed);
+    CPPUNIT_ASSERT_EQUAL(6ul, statistics.instructions);
+    CPPUNIT_ASSERT_EQUAL(2ul, statistics.compiled);
+    CPPUNIT_ASSERT_EQUAL(1ul, statistics.invalidated);
+}
+
+void TestCache::testBlock_endOfMemory(void)
+{
+    // The same program as testPredecode_endOfMemory, which runs off the end
+    // of memory
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.setInstructionInMemory(0x200, 0x1ffe);
+    chip8.setInstructionInMemory(0xffe, 0x6001);
+    chip8.setInstructionInMemory(0x000, 0x7102);
+    chip8.setInstructionInMemory(0x002, 0x1200);
+    Chip8 cached;
+    cached.setLogging(false);
+    cached.initialize();
+    cached.forkFrom(chip8);
+    cached.setBlockCache(true);
+
+    // Every iteration is a block at 0x200, one at 0xFFE and one at the
+    // start of memory, where the pc wraps around
+    for (size_t block = 0; block < 9; block++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, cached.executeBlock());
+    }
+    CPPUNIT_ASSERT_EQUAL(12ul, cached.getBlockStatistics().instructions);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, chip8.runCycles(12).reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(6), cached.getRegister(1));
+    CPPUNIT_ASSERT_EQUAL(chip8.getPc(), cached.getPc());
+    CPPUNIT_ASSERT_EQUAL(chip8.hashState(), cached.hashState());
+}
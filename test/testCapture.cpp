@@ -0,0 +1,224 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+#include "frameCapture.hpp"
+#include "frameScaler.hpp"
+
+// This class will test the capture of frames to video streams: the format
+// of the streams, the repeat markers and the counters of the frames
+class TestCapture : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestCapture);
+    CPPUNIT_TEST(testCapture_y4m);
+    CPPUNIT_TEST(testCapture_y4mCopies);
+    CPPUNIT_TEST(testCapture_raw);
+    CPPUNIT_TEST(testCapture_dropped);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testCapture_y4m(void);
+    void testCapture_y4mCopies(void);
+    void testCapture_raw(void);
+    void testCapture_dropped(void);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestCapture);
+
+namespace
+{
+const std::string filename = "testCapture.out";
+
+// Returns the contents of the capture file, and removes it
+std::string readCapture()
+{
+    std::string contents;
+    {
+        std::ifstream file(filename, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>());
+    }
+    std::remove(filename.c_str());
+    return contents;
+}
+} // namespace
+
+void TestCapture::testCapture_y4m(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+
+    // Three equal frames and then a different one
+    FrameCapture capture;
+    CPPUNIT_ASSERT(!capture.capture(chip8));
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.open(filename, Y4mFormat));
+    CPPUNIT_ASSERT(capture.isOpen());
+    CPPUNIT_ASSERT_EQUAL(Error, capture.open(filename, Y4mFormat));
+    for (unsigned int frame = 0; frame < 3; frame++)
+    {
+        CPPUNIT_ASSERT(capture.capture(chip8));
+    }
+    chip8.setI(FONT_START);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd005));
+    CPPUNIT_ASSERT(capture.capture(chip8));
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.close());
+    CPPUNIT_ASSERT(!capture.isOpen());
+
+    const CaptureStatistics statistics = capture.getStatistics();
+    CPPUNIT_ASSERT_EQUAL(4ul, statistics.captured);
+    CPPUNIT_ASSERT_EQUAL(2ul, statistics.repeated);
+    CPPUNIT_ASSERT_EQUAL(0ul, statistics.dropped);
+    CPPUNIT_ASSERT_EQUAL(4ul, statistics.written);
+
+    // The first frame is written once with the number of its repeats, and
+    // then the second one
+    const std::string contents = readCapture();
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(statistics.bytes),
+                         contents.size());
+    const std::string header =
+        "YUV4MPEG2 W64 H32 F60:1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+    const std::string first = "FRAME XREPEAT=2\n";
+    const std::string second = "FRAME\n";
+    const size_t plane = DISPLAY_WIDTH * DISPLAY_HEIGHT;
+    CPPUNIT_ASSERT_EQUAL(header.size() + first.size() + second.size() +
+                             6 * plane,
+                         contents.size());
+    CPPUNIT_ASSERT_EQUAL(header, contents.substr(0, header.size()));
+    CPPUNIT_ASSERT_EQUAL(first, contents.substr(header.size(), first.size()));
+    const size_t start = header.size() + first.size() + 3 * plane;
+    CPPUNIT_ASSERT_EQUAL(second, contents.substr(start, second.size()));
+
+    // The pixels of the sprite are white, and the rest black, with no
+    // colour in the chroma planes
+    const std::string y = contents.substr(start + second.size(), plane);
+    const std::string chroma = contents.substr(start + second.size() + plane);
+    for (unsigned int pixel = 0; pixel < plane; pixel++)
+    {
+        const bool set = chip8.getPixel(pixel % DISPLAY_WIDTH,
+                                        pixel / DISPLAY_WIDTH);
+        CPPUNIT_ASSERT_EQUAL(set ? '\xff' : '\x00', y[pixel]);
+    }
+    CPPUNIT_ASSERT_EQUAL(std::string(2 * plane, '\x80'), chroma);
+}
+
+void TestCapture::testCapture_y4mCopies(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+
+    // Three equal frames and then a different one, without repeat tags
+    FrameCapture capture;
+    capture.setRepeatTags(false);
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.open(filename, Y4mFormat));
+    for (unsigned int frame = 0; frame < 3; frame++)
+    {
+        CPPUNIT_ASSERT(capture.capture(chip8));
+    }
+    chip8.setI(FONT_START);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd005));
+    CPPUNIT_ASSERT(capture.capture(chip8));
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.close());
+
+    const CaptureStatistics statistics = capture.getStatistics();
+    CPPUNIT_ASSERT_EQUAL(2ul, statistics.repeated);
+    CPPUNIT_ASSERT_EQUAL(4ul, statistics.written);
+
+    // Every copy of the first frame is written in full, with no tag
+    const std::string contents = readCapture();
+    const std::string header =
+        "YUV4MPEG2 W64 H32 F60:1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+    const std::string frame = "FRAME\n";
+    const size_t size = frame.size() + 3 * DISPLAY_WIDTH * DISPLAY_HEIGHT;
+    CPPUNIT_ASSERT_EQUAL(header.size() + 4 * size, contents.size());
+    CPPUNIT_ASSERT_EQUAL(header, contents.substr(0, header.size()));
+    for (unsigned int copy = 0; copy < 3; copy++)
+    {
+        CPPUNIT_ASSERT_EQUAL(contents.substr(header.size(), size),
+                             contents.substr(header.size() + copy * size,
+                                             size));
+    }
+    CPPUNIT_ASSERT_EQUAL(frame, contents.substr(header.size() + 3 * size,
+                                                frame.size()));
+}
+
+void TestCapture::testCapture_raw(void)
+{
+    // Every frame run by the interpreter is written, repeats included
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram("games/BRIX"));
+    FrameCapture capture(4096);
+    capture.setScale(2);
+    capture.setColors(0xff0000ffu, 0xff00ff00u);
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.open(filename, RawFormat));
+    chip8.setCapture(&capture);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(120));
+    chip8.setCapture(nullptr);
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.close());
+
+    const CaptureStatistics statistics = capture.getStatistics();
+    CPPUNIT_ASSERT_EQUAL(120ul, statistics.captured);
+    CPPUNIT_ASSERT_EQUAL(0ul, statistics.dropped);
+    CPPUNIT_ASSERT_EQUAL(120ul, statistics.written);
+
+    // The last frame holds the RGBA bytes of the display
+    const std::string contents = readCapture();
+    const size_t size = 4 * 4 * DISPLAY_WIDTH * DISPLAY_HEIGHT;
+    CPPUNIT_ASSERT_EQUAL(120 * size, contents.size());
+    FrameScaler scaler(2);
+    scaler.setColors(0xff0000ffu, 0xff00ff00u);
+    std::vector<uint32_t> pixels(size / 4);
+    scaler.expand(chip8, pixels.data());
+    for (size_t pixel = 0; pixel < pixels.size(); pixel++)
+    {
+        const bool set = pixels[pixel] == 0xff0000ffu;
+        const std::string expected = set ? std::string("\xff\x00\x00\xff", 4)
+                                         : std::string("\x00\xff\x00\xff", 4);
+        CPPUNIT_ASSERT_EQUAL(expected,
+                             contents.substr(119 * size + 4 * pixel, 4));
+    }
+}
+
+void TestCapture::testCapture_dropped(void)
+{
+    // A frame of another size than the first one is dropped
+    Chip8 classic;
+    classic.setLogging(false);
+    classic.initialize();
+    Chip8 extended;
+    extended.setLogging(false);
+    extended.setExtended(true);
+    extended.initialize();
+    FrameCapture capture(2);
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.open(filename, Y4mFormat));
+    CPPUNIT_ASSERT(capture.capture(classic));
+    CPPUNIT_ASSERT(!capture.capture(extended));
+
+    // Frames that find the small ring full are dropped instead of waiting
+    // for the writer, and every frame is either written or dropped
+    unsigned long queued = 1;
+    for (unsigned int frame = 0; frame < 2000; frame++)
+    {
+        classic.setRegister(0x0, frame % DISPLAY_WIDTH);
+        CPPUNIT_ASSERT_EQUAL(Ok, classic.executeInstruction(0xd001));
+        queued += capture.capture(classic) ? 1 : 0;
+    }
+    CPPUNIT_ASSERT_EQUAL(Ok, capture.close());
+    readCapture();
+
+    const CaptureStatistics statistics = capture.getStatistics();
+    CPPUNIT_ASSERT_EQUAL(queued, statistics.captured);
+    CPPUNIT_ASSERT_EQUAL(2002 - queued, statistics.dropped);
+    CPPUNIT_ASSERT(statistics.dropped > 1);
+    CPPUNIT_ASSERT_EQUAL(queued, statistics.written);
+}
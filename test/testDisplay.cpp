@@ -0,0 +1,208 @@
+#include <cstdint>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+
+// This class will test the instructions that draw on the display
+class TestDisplay : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestDisplay);
+    CPPUNIT_TEST(testDRW);
+    CPPUNIT_TEST(testDRW_collision);
+    CPPUNIT_TEST(testDRW_clipRight);
+    CPPUNIT_TEST(testDRW_clipBottom);
+    CPPUNIT_TEST(testDRW_wrapPosition);
+    CPPUNIT_TEST(testCLS);
+    CPPUNIT_TEST(testLD_font);
+    CPPUNIT_TEST(testDirtyRows);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testDRW(void);
+    void testDRW_collision(void);
+    void testDRW_clipRight(void);
+    void testDRW_clipBottom(void);
+    void testDRW_wrapPosition(void);
+    void testCLS(void);
+    void testLD_font(void);
+    void testDirtyRows(void);
+
+private:
+    // Draws the two rows of sprite at (x, y) through DRW V0, V1, 2
+    void draw(Chip8 &chip8, unsigned char x, unsigned char y);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDisplay);
+
+void TestDisplay::draw(Chip8 &chip8, unsigned char x, unsigned char y)
+{
+    chip8.setRegister(0x0, x);
+    chip8.setRegister(0x1, y);
+    chip8.setI(0x300);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd012));
+}
+
+void TestDisplay::testDRW(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setMemory(0x300, 0xf1);
+    chip8.setMemory(0x301, 0x80);
+
+    // Draw the sprite on an empty display
+    draw(chip8, 10, 5);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getRegister(0xf));
+
+    // Check the pixels of the sprite are set, and only them
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0xf1} << 46, chip8.getDisplayRow(5));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x80} << 46, chip8.getDisplayRow(6));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x0}, chip8.getDisplayRow(4));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x0}, chip8.getDisplayRow(7));
+    CPPUNIT_ASSERT(chip8.getPixel(10, 5));
+    CPPUNIT_ASSERT(chip8.getPixel(17, 5));
+    CPPUNIT_ASSERT(!chip8.getPixel(14, 5));
+    CPPUNIT_ASSERT(chip8.getPixel(10, 6));
+    CPPUNIT_ASSERT(!chip8.getPixel(11, 6));
+}
+
+void TestDisplay::testDRW_collision(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setMemory(0x300, 0xff);
+    chip8.setMemory(0x301, 0x81);
+
+    // Drawing the same sprite twice erases it and reports the collision
+    draw(chip8, 20, 20);
+    draw(chip8, 20, 20);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getRegister(0xf));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x0}, chip8.getDisplayRow(20));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x0}, chip8.getDisplayRow(21));
+
+    // Sprites that touch without overlapping do not collide
+    draw(chip8, 20, 20);
+    draw(chip8, 28, 20);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getRegister(0xf));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0xffff} << 28, chip8.getDisplayRow(20));
+}
+
+void TestDisplay::testDRW_clipRight(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setMemory(0x300, 0xff);
+    chip8.setMemory(0x301, 0xff);
+
+    // Only the three leftmost pixels fit in the row, and nothing wraps to
+    // the left edge
+    draw(chip8, 61, 0);
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x7}, chip8.getDisplayRow(0));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x7}, chip8.getDisplayRow(1));
+    CPPUNIT_ASSERT(!chip8.getPixel(0, 0));
+}
+
+void TestDisplay::testDRW_clipBottom(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setMemory(0x300, 0x80);
+    chip8.setMemory(0x301, 0x80);
+
+    // Only the first row fits in the display, and nothing wraps to the top
+    draw(chip8, 0, 31);
+    CPPUNIT_ASSERT(chip8.getPixel(0, 31));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x0}, chip8.getDisplayRow(0));
+}
+
+void TestDisplay::testDRW_wrapPosition(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setMemory(0x300, 0x80);
+    chip8.setMemory(0x301, 0x00);
+
+    // A position outside of the display starts the sprite at the wrapped
+    // position
+    draw(chip8, 64 + 3, 32 + 2);
+    CPPUNIT_ASSERT(chip8.getPixel(3, 2));
+}
+
+void TestDisplay::testCLS(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setMemory(0x300, 0xff);
+    chip8.setMemory(0x301, 0xff);
+    draw(chip8, 0, 0);
+    draw(chip8, 56, 30);
+
+    // Clear the display
+    chip8.setPc(0x200);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00e0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x202), chip8.getPc());
+    for (unsigned char row = 0; row < DISPLAY_HEIGHT; row++)
+    {
+        CPPUNIT_ASSERT_EQUAL(uint64_t{0x0}, chip8.getDisplayRow(row));
+    }
+}
+
+void TestDisplay::testLD_font(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+
+    // Point I to the sprite of the digit in the lowest nibble of V3
+    chip8.setRegister(0x3, 0x1a);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf329));
+    CPPUNIT_ASSERT_EQUAL(
+        static_cast<unsigned short>(FONT_START + 0xa * FONT_CHARACTER_SIZE),
+        chip8.getI());
+
+    // Draw it and check the rows of the A
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd005));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0xf0} << 56, chip8.getDisplayRow(0));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x90} << 56, chip8.getDisplayRow(1));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0xf0} << 56, chip8.getDisplayRow(2));
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0x90} << 56, chip8.getDisplayRow(4));
+}
+
+void TestDisplay::testDirtyRows(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setMemory(0x300, 0xff);
+    chip8.setMemory(0x301, 0x00);
+
+    // The whole display has to be drawn after initializing it
+    CPPUNIT_ASSERT(chip8.isDisplayChanged());
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(ALL_DISPLAY_ROWS),
+                         chip8.takeDirtyRows());
+    CPPUNIT_ASSERT(!chip8.isDisplayChanged());
+
+    // Only the rows of the sprite with pixels change
+    draw(chip8, 0, 7);
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(0x1 << 7), chip8.getDirtyRows());
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(0x1 << 7),
+                         chip8.takeDirtyRows());
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(0x0), chip8.getDirtyRows());
+
+    // Clearing the display changes the rows that had pixels, and clearing it
+    // again changes nothing
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00e0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(0x1 << 7),
+                         chip8.takeDirtyRows());
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00e0));
+    CPPUNIT_ASSERT(!chip8.isDisplayChanged());
+
+    // Drawing a sprite that is clipped away changes nothing either
+    chip8.setMemory(0x300, 0x00);
+    chip8.setMemory(0x301, 0xff);
+    draw(chip8, 0, 31);
+    CPPUNIT_ASSERT(!chip8.isDisplayChanged());
+}
@@ -0,0 +1,122 @@
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+#include "vectorEnv.hpp"
+
+// This class will test the vector of environments
+class TestEnv : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestEnv);
+    CPPUNIT_TEST(testEnv_observations);
+    CPPUNIT_TEST(testEnv_rewards);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testEnv_observations(void);
+    void testEnv_rewards(void);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestEnv);
+
+void TestEnv::testEnv_observations(void)
+{
+    // Each environment runs as an interpreter seeded the same way would
+    const size_t count = 7;
+    std::vector<uint64_t> observations(count * OBSERVATION_WORDS, 0);
+    VectorEnv env(count, observations.data(), 3);
+    CPPUNIT_ASSERT_EQUAL(3u, env.getThreads());
+    CPPUNIT_ASSERT_EQUAL(Ok, env.loadProgram("games/BRIX"));
+    env.setFrameSkip(2);
+    std::vector<uint64_t> seeds;
+    for (size_t index = 0; index < count; index++)
+    {
+        seeds.push_back(0x5eed + index);
+    }
+    CPPUNIT_ASSERT_EQUAL(Ok, env.reset(seeds.data()));
+
+    std::vector<Chip8> references(count);
+    for (size_t index = 0; index < count; index++)
+    {
+        references[index].setLogging(false);
+        references[index].initialize();
+        references[index].seedRandom(seeds[index]);
+        CPPUNIT_ASSERT_EQUAL(Ok, references[index].loadProgram("games/BRIX"));
+    }
+
+    std::vector<uint16_t> actions(count);
+    for (unsigned int step = 0; step < 50; step++)
+    {
+        for (size_t index = 0; index < count; index++)
+        {
+            actions[index] = (step + index) % 3 == 0 ? 0x0010 : 0x0040;
+            references[index].setKeys(actions[index]);
+            CPPUNIT_ASSERT_EQUAL(Ok, references[index].runFrames(2));
+        }
+        env.step(actions.data());
+
+        for (size_t index = 0; index < count; index++)
+        {
+            CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                                 env.getDone()[index]);
+            CPPUNIT_ASSERT_EQUAL(references[index].hashState(),
+                                 env.getMachine(index).hashState());
+            for (unsigned char row = 0; row < DISPLAY_HEIGHT; row++)
+            {
+                CPPUNIT_ASSERT_EQUAL(
+                    references[index].getDisplayRow(row),
+                    observations[index * OBSERVATION_WORDS + row]);
+            }
+        }
+    }
+
+    // Resetting writes the whole observation again
+    std::fill(observations.begin(), observations.end(), 0xffffffffffffffffull);
+    CPPUNIT_ASSERT_EQUAL(Ok, env.reset(seeds.data()));
+    for (size_t index = 0; index < count; index++)
+    {
+        for (unsigned char row = 0; row < DISPLAY_HEIGHT; row++)
+        {
+            CPPUNIT_ASSERT_EQUAL(
+                env.getMachine(index).getDisplayRow(row),
+                observations[index * OBSERVATION_WORDS + row]);
+        }
+    }
+}
+
+void TestEnv::testEnv_rewards(void)
+{
+    // Counts in V0 the instructions run while key 1 is pressed, stores the
+    // count at 0x300, and returns from an empty stack when it reaches 16
+    const unsigned char program[] = {0x61, 0x01, 0xe1, 0x9e, 0x12, 0x08,
+                                     0x70, 0x01, 0xa3, 0x00, 0xf0, 0x55,
+                                     0x30, 0x10, 0x12, 0x02, 0x00, 0xee};
+    uint64_t observations[2 * OBSERVATION_WORDS];
+    VectorEnv env(2, observations, 1);
+    CPPUNIT_ASSERT_EQUAL(Ok, env.loadProgram(program, sizeof(program)));
+    env.setScore(0x300, 1);
+    const uint64_t seeds[] = {1, 2};
+    CPPUNIT_ASSERT_EQUAL(Ok, env.reset(seeds));
+
+    // Only the environment pressing the key is rewarded
+    const uint16_t actions[] = {0x0002, 0x0000};
+    env.step(actions);
+    CPPUNIT_ASSERT(env.getRewards()[0] > 0);
+    CPPUNIT_ASSERT_EQUAL(int64_t{0}, env.getRewards()[1]);
+
+    // The environment that fails is done until it is reset
+    for (unsigned int step = 0; step < 20; step++)
+    {
+        env.step(actions);
+    }
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(1), env.getDone()[0]);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0), env.getDone()[1]);
+    CPPUNIT_ASSERT_EQUAL(int64_t{0}, env.getRewards()[0]);
+    CPPUNIT_ASSERT_EQUAL(Ok, env.reset(0, 1));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0), env.getDone()[0]);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                         env.getMachine(0).getRegister(0x0));
+}
@@ -0,0 +1,354 @@
+#include <cstdint>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+
+// This class will test the extended mode of SCHIP and XO-CHIP programs: the
+// planes of its display, its scrolls and its memory
+class TestExtended : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestExtended);
+    CPPUNIT_TEST(testExtended_draw);
+    CPPUNIT_TEST(testExtended_lowResolution);
+    CPPUNIT_TEST(testExtended_planes);
+    CPPUNIT_TEST(testExtended_scroll);
+    CPPUNIT_TEST(testExtended_memory);
+    CPPUNIT_TEST(testExtended_program);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testExtended_draw(void);
+    void testExtended_lowResolution(void);
+    void testExtended_planes(void);
+    void testExtended_scroll(void);
+    void testExtended_memory(void);
+    void testExtended_program(void);
+
+private:
+    // Initializes the interpreter in the extended mode, in the high
+    // resolution if high is set
+    void start(Chip8 &chip8, bool high);
+
+    // Draws the sprite at I at (x, y) through DRW V0, V1, n
+    void draw(Chip8 &chip8, unsigned char x, unsigned char y, unsigned char n);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestExtended);
+
+namespace
+{
+// Returns a row of a plane with the given words
+PlaneRow row(uint64_t left, uint64_t right)
+{
+    return PlaneRow{left, right};
+}
+
+// Asserts two rows of a plane are equal
+void assertRow(PlaneRow expected, PlaneRow actual)
+{
+    CPPUNIT_ASSERT_EQUAL(expected[0], actual[0]);
+    CPPUNIT_ASSERT_EQUAL(expected[1], actual[1]);
+}
+} // namespace
+
+void TestExtended::start(Chip8 &chip8, bool high)
+{
+    chip8.setLogging(false);
+    chip8.setExtended(true);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(high ? 0x00ff : 0x00fe));
+    CPPUNIT_ASSERT_EQUAL(high, chip8.isHighResolution());
+    chip8.setPc(START_AVAILABLE_MEMORY);
+}
+
+void TestExtended::draw(Chip8 &chip8, unsigned char x, unsigned char y,
+                        unsigned char n)
+{
+    chip8.setRegister(0x0, x);
+    chip8.setRegister(0x1, y);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd010 | n));
+}
+
+void TestExtended::testExtended_draw(void)
+{
+    Chip8 chip8;
+    start(chip8, true);
+    chip8.setI(0x300);
+    chip8.setMemory(0x300, 0xf1);
+    chip8.setMemory(0x301, 0x81);
+
+    // A sprite crossing the middle of the display is split between the
+    // words of its rows
+    draw(chip8, 60, 5, 2);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getRegister(0xf));
+    assertRow(row(0xf, uint64_t{0x1} << 60), chip8.getPlaneRow(0, 5));
+    assertRow(row(0x8, uint64_t{0x1} << 60), chip8.getPlaneRow(0, 6));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 7));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getPlanePixel(60, 5));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getPlanePixel(67, 6));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getPlanePixel(64, 5));
+
+    // Drawing it again erases it and reports the collision
+    draw(chip8, 60, 5, 2);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getRegister(0xf));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 5));
+
+    // Dxy0 draws 16x16 pixels, clipped at the right and bottom edges, and
+    // the position wraps around the display
+    for (unsigned short offset = 0; offset < 32; offset++)
+    {
+        chip8.setMemory(0x300 + offset, 0xff);
+    }
+    chip8.takeDirtyRows();
+    draw(chip8, EXTENDED_DISPLAY_WIDTH + 120, 56, 0);
+    for (unsigned char y = 56; y < EXTENDED_DISPLAY_HEIGHT; y++)
+    {
+        assertRow(row(0, 0xff), chip8.getPlaneRow(0, y));
+    }
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 0));
+    CPPUNIT_ASSERT_EQUAL(0xf0000000u, chip8.getDirtyRows());
+}
+
+void TestExtended::testExtended_lowResolution(void)
+{
+    Chip8 chip8;
+    start(chip8, false);
+    chip8.setI(0x300);
+    chip8.setMemory(0x300, 0xa0);
+
+    // Every pixel is drawn as 2x2 pixels, and the display is 64x32
+    draw(chip8, 64 + 31, 3, 1);
+    assertRow(row(0x3, uint64_t{0x30} << 56), chip8.getPlaneRow(0, 6));
+    assertRow(row(0x3, uint64_t{0x30} << 56), chip8.getPlaneRow(0, 7));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 8));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getPlanePixel(62, 7));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getPlanePixel(64, 7));
+
+    // Switching the resolution clears the display
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00ff));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 6));
+}
+
+void TestExtended::testExtended_planes(void)
+{
+    Chip8 chip8;
+    start(chip8, true);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getSelectedPlanes());
+
+    // With two planes selected, each one draws its own sprite from the
+    // bytes after the previous one
+    chip8.setI(0x300);
+    chip8.setMemory(0x300, 0xc0);
+    chip8.setMemory(0x301, 0x80);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf301));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x3),
+                         chip8.getSelectedPlanes());
+    draw(chip8, 0, 0, 1);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x3),
+                         chip8.getPlanePixel(0, 0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getPlanePixel(1, 0));
+
+    // Only the selected planes collide and are cleared
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf201));
+    chip8.setMemory(0x300, 0x40);
+    draw(chip8, 0, 0, 1);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getRegister(0xf));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x3),
+                         chip8.getPlanePixel(1, 0));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00e0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getPlanePixel(0, 0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getPlanePixel(1, 0));
+}
+
+void TestExtended::testExtended_scroll(void)
+{
+    Chip8 chip8;
+    start(chip8, true);
+    chip8.setI(0x300);
+    chip8.setMemory(0x300, 0x81);
+    draw(chip8, 58, 10, 1);
+    const PlaneRow drawn = row(0x20, uint64_t{0x4} << 60);
+    assertRow(drawn, chip8.getPlaneRow(0, 10));
+
+    // Right and left by 4 pixels, carrying the pixels between the words
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00fb));
+    assertRow(row(0x2, uint64_t{0x4} << 56), chip8.getPlaneRow(0, 10));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00fc));
+    assertRow(drawn, chip8.getPlaneRow(0, 10));
+
+    // Down and up, clearing the rows scrolled in
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00c5));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 10));
+    assertRow(drawn, chip8.getPlaneRow(0, 15));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00df));
+    assertRow(drawn, chip8.getPlaneRow(0, 0));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 15));
+    CPPUNIT_ASSERT_EQUAL(ALL_DISPLAY_ROWS, chip8.getDirtyRows());
+
+    // Pixels scrolled past the edges are lost
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00d1));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, 0));
+    assertRow(row(0, 0), chip8.getPlaneRow(0, EXTENDED_DISPLAY_HEIGHT - 1));
+
+    // The low resolution scrolls by its own pixels, and only the selected
+    // planes move
+    Chip8 low;
+    start(low, false);
+    low.setI(0x300);
+    low.setMemory(0x300, 0x80);
+    CPPUNIT_ASSERT_EQUAL(Ok, low.executeInstruction(0xf301));
+    low.setMemory(0x301, 0x80);
+    draw(low, 0, 0, 1);
+    CPPUNIT_ASSERT_EQUAL(Ok, low.executeInstruction(0xf101));
+    CPPUNIT_ASSERT_EQUAL(Ok, low.executeInstruction(0x00fb));
+    CPPUNIT_ASSERT_EQUAL(Ok, low.executeInstruction(0x00c1));
+    assertRow(row(uint64_t{0x3} << 62, 0), low.getPlaneRow(1, 1));
+    assertRow(row(uint64_t{0x3} << 54, 0), low.getPlaneRow(0, 2));
+    assertRow(row(uint64_t{0x3} << 54, 0), low.getPlaneRow(0, 3));
+    assertRow(row(0, 0), low.getPlaneRow(0, 1));
+}
+
+void TestExtended::testExtended_memory(void)
+{
+    Chip8 chip8;
+    start(chip8, true);
+
+    // F000 nnnn loads a 16 bit address into I
+    chip8.setInstructionInMemory(0x200, 0xf000);
+    chip8.setInstructionInMemory(0x202, 0xe323);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0xe323), chip8.getI());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x204), chip8.getPc());
+
+    // Fx33, Fx55 and Fx65 reach past the classic memory
+    chip8.setRegister(0x0, 0x12);
+    chip8.setRegister(0x1, 0x34);
+    chip8.setRegister(0x2, 234);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf155));
+    chip8.setI(0xe325);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf233));
+    chip8.setI(0xe323);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf465));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x12),
+                         chip8.getRegister(0x0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x34),
+                         chip8.getRegister(0x1));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(2), chip8.getRegister(0x2));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(3), chip8.getRegister(0x3));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(4), chip8.getRegister(0x4));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getMemory(0x323));
+
+    // 5xy2 and 5xy3 store and read a range of registers in either order
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x5312));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x5033));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(3), chip8.getRegister(0x0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(2), chip8.getRegister(0x1));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x34),
+                         chip8.getRegister(0x2));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0xe323), chip8.getI());
+
+    // Fx75 and Fx85 save and restore the registers in the flags
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf175));
+    chip8.setRegister(0x0, 0x0);
+    chip8.setRegister(0x1, 0x0);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf185));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(3), chip8.getRegister(0x0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(2), chip8.getRegister(0x1));
+
+    // Fx30 points I to the large digits
+    chip8.setRegister(0x0, 0x1a);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf030));
+    CPPUNIT_ASSERT_EQUAL(
+        static_cast<unsigned short>(LARGE_FONT_START +
+                                    0xa * LARGE_FONT_CHARACTER_SIZE),
+        chip8.getI());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x7e),
+                         chip8.getMemory(chip8.getI()));
+
+    // A skip jumps over the whole of F000 nnnn
+    chip8.setPc(0x300);
+    chip8.setInstructionInMemory(0x302, 0xf000);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x301a));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x306), chip8.getPc());
+
+    // The extended state is forked, and cannot be saved
+    Chip8 fork;
+    fork.setLogging(false);
+    fork.initialize();
+    fork.forkFrom(chip8);
+    CPPUNIT_ASSERT(fork.isExtended());
+    CPPUNIT_ASSERT_EQUAL(chip8.hashState(), fork.hashState());
+    CPPUNIT_ASSERT(chip8.saveState().empty());
+    std::vector<unsigned char> state(Chip8::getStateSize());
+    CPPUNIT_ASSERT_EQUAL(Error, chip8.saveState(state.data(), state.size()));
+    CPPUNIT_ASSERT_EQUAL(Error, chip8.loadState(state.data(), state.size()));
+
+    // The classic mode does not know the extended instructions
+    chip8.setExtended(false);
+    CPPUNIT_ASSERT_EQUAL(UnknownOpcodeError, chip8.executeInstruction(0x00fb));
+    CPPUNIT_ASSERT_EQUAL(UnknownOpcodeError, chip8.executeInstruction(0xf000));
+}
+
+void TestExtended::testExtended_program(void)
+{
+    // A program bigger than the classic memory only fits in the extended
+    // mode, with its end addressable by I
+    std::vector<unsigned char> program(EXTENDED_MEMORY_SIZE -
+                                       START_AVAILABLE_MEMORY);
+    program[0] = 0xf0;
+    program[1] = 0x00;
+    program[2] = 0xff;
+    program[3] = 0xff;
+    program[4] = 0xf0;
+    program[5] = 0x65;
+    program[6] = 0x12;
+    program[7] = 0x06;
+    program.back() = 0x5a;
+
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(NotEnoughMemory,
+                         chip8.loadProgram(program.data(), program.size()));
+    chip8.setExtended(true);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram(program.data(), program.size()));
+
+    // Run its code through every engine, which all stop in the same state on
+    // the jump to itself that ends it
+    std::vector<uint64_t> hashes;
+    for (unsigned int engine = 0; engine < 3; engine++)
+    {
+        Chip8 copy;
+        copy.setLogging(false);
+        copy.initialize();
+        copy.forkFrom(chip8);
+        copy.setPredecode(engine == 1);
+        copy.setBlockCache(engine == 2);
+        copy.setJit(engine == 2);
+        CPPUNIT_ASSERT_EQUAL(Ok, copy.executeJit());
+        CPPUNIT_ASSERT_EQUAL(Ok, copy.executeJit());
+        CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x5a),
+                             copy.getRegister(0x0));
+        hashes.push_back(copy.hashState());
+    }
+    CPPUNIT_ASSERT_EQUAL(hashes[0], hashes[1]);
+    CPPUNIT_ASSERT_EQUAL(hashes[0], hashes[2]);
+}
@@ -0,0 +1,115 @@
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+#include "forkPool.hpp"
+
+// This class will test the pool that forks an interpreter once per sequence
+// of inputs
+class TestFork : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestFork);
+    CPPUNIT_TEST(testFork_threads);
+    CPPUNIT_TEST(testFork_inputs);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testFork_threads(void);
+    void testFork_inputs(void);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestFork);
+
+void TestFork::testFork_threads(void)
+{
+    Chip8 source;
+    source.setLogging(false);
+    source.initialize();
+    source.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, source.loadProgram("games/BRIX"));
+    CPPUNIT_ASSERT_EQUAL(Ok, source.runFrames(30));
+    const uint64_t hash = source.hashState();
+
+    // Sequences that move the paddle left or right, or hold no key
+    std::vector<std::vector<uint16_t>> inputs;
+    for (unsigned int index = 0; index < 64; index++)
+    {
+        inputs.push_back({static_cast<uint16_t>(index % 3 == 0   ? 0x0000
+                                                : index % 3 == 1 ? 0x0010
+                                                                 : 0x0040),
+                          static_cast<uint16_t>(index / 3 % 2 ? 0x0010
+                                                              : 0x0000)});
+    }
+
+    // The forks end as the source would have if run with the same inputs,
+    // whatever the number of threads, and the source does not change
+    ForkPool single(1);
+    ForkPool pool(4);
+    CPPUNIT_ASSERT_EQUAL(4u, pool.getThreads());
+    const std::vector<ForkResult> expected = single.explore(source, inputs, 40);
+    for (unsigned int round = 0; round < 2; round++)
+    {
+        const std::vector<ForkResult> &actual =
+            pool.explore(source, inputs, 40);
+        CPPUNIT_ASSERT_EQUAL(inputs.size(), actual.size());
+        for (size_t index = 0; index < inputs.size(); index++)
+        {
+            Chip8 reference;
+            reference.setLogging(false);
+            reference.forkFrom(source);
+            for (unsigned long frame = 0; frame < 40; frame++)
+            {
+                reference.setKeys(inputs[index][frame < 1 ? 0 : 1]);
+                CPPUNIT_ASSERT_EQUAL(Ok, reference.runFrame());
+            }
+            CPPUNIT_ASSERT_EQUAL(Ok, actual[index].error);
+            CPPUNIT_ASSERT_EQUAL(40ul, actual[index].frames);
+            CPPUNIT_ASSERT_EQUAL(reference.hashState(),
+                                 actual[index].stateHash);
+            CPPUNIT_ASSERT_EQUAL(expected[index].stateHash,
+                                 actual[index].stateHash);
+            CPPUNIT_ASSERT(reference.getDisplay() == actual[index].display);
+        }
+        CPPUNIT_ASSERT_EQUAL(inputs.size(),
+                             static_cast<size_t>(
+                                 pool.getStatistics().forks));
+        CPPUNIT_ASSERT_EQUAL(40ul * inputs.size(),
+                             pool.getStatistics().frames);
+    }
+    CPPUNIT_ASSERT_EQUAL(hash, source.hashState());
+}
+
+void TestFork::testFork_inputs(void)
+{
+    // Counts in V0 the instructions run while key 1 is pressed, and stores
+    // the count at 0x300
+    const unsigned char program[] = {0x61, 0x01, 0xe1, 0x9e, 0x12, 0x08,
+                                     0x70, 0x01, 0xa3, 0x00, 0xf0, 0x55,
+                                     0x12, 0x02};
+    Chip8 source;
+    source.setLogging(false);
+    source.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, source.loadProgram(program, sizeof(program)));
+    source.setKey(0x1, true);
+
+    // Sequences that never press the key, press it in the first frame only,
+    // always press it, and keep the key of the source
+    const std::vector<std::vector<uint16_t>> inputs = {
+        {0x0000}, {0x0002, 0x0000}, {0x0002}, {}};
+    ForkPool pool(2);
+    pool.setScore(0x300, 1);
+    const std::vector<ForkResult> &results = pool.explore(source, inputs, 8);
+    CPPUNIT_ASSERT_EQUAL(uint64_t{0}, results[0].score);
+    CPPUNIT_ASSERT(results[1].score > 0);
+    CPPUNIT_ASSERT(results[2].score > results[1].score);
+    CPPUNIT_ASSERT_EQUAL(results[2].score, results[3].score);
+    CPPUNIT_ASSERT_EQUAL(results[2].stateHash, results[3].stateHash);
+
+    // The score is read big endian
+    const uint64_t score = results[3].score;
+    pool.setScore(0x300, 2);
+    CPPUNIT_ASSERT_EQUAL(score << 8, pool.explore(source, inputs, 8)[3].score);
+}
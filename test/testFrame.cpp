@@ -0,0 +1,158 @@
+#include <chrono>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+
+// This class will test the frame scheduler and the timers it decrements
+class TestFrame : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestFrame);
+    CPPUNIT_TEST(testFrame_instructions);
+    CPPUNIT_TEST(testFrame_timers);
+    CPPUNIT_TEST(testFrame_lazyTimers);
+    CPPUNIT_TEST(testFrame_error);
+    CPPUNIT_TEST(testFrame_realTime);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testFrame_instructions(void);
+    void testFrame_timers(void);
+    void testFrame_lazyTimers(void);
+    void testFrame_error(void);
+    void testFrame_realTime(void);
+
+private:
+    // Loads a program that adds 1 to V0 forever
+    void loadCounter(Chip8 &chip8);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestFrame);
+
+void TestFrame::loadCounter(Chip8 &chip8)
+{
+    const unsigned char program[] = {0x70, 0x01, 0x12, 0x00};
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram(program, sizeof(program)));
+}
+
+void TestFrame::testFrame_instructions(void)
+{
+    Chip8 chip8;
+    loadCounter(chip8);
+
+    // Each frame executes the configured number of instructions
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(
+                             DEFAULT_INSTRUCTIONS_PER_FRAME),
+                         chip8.getInstructionsPerFrame());
+    chip8.setInstructionsPerFrame(8);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(5));
+    CPPUNIT_ASSERT_EQUAL(5ul, chip8.getFrames());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(20), chip8.getRegister(0));
+
+    // Initializing the interpreter starts counting the frames again
+    loadCounter(chip8);
+    CPPUNIT_ASSERT_EQUAL(0ul, chip8.getFrames());
+}
+
+void TestFrame::testFrame_timers(void)
+{
+    Chip8 chip8;
+    loadCounter(chip8);
+    chip8.setDelayTimer(3);
+    chip8.setSoundTimer(1);
+
+    // Both timers are decremented once per frame until they reach zero
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrame());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(2),
+                         chip8.getDelayTimer());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                         chip8.getSoundTimer());
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(4));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                         chip8.getDelayTimer());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                         chip8.getSoundTimer());
+}
+
+void TestFrame::testFrame_lazyTimers(void)
+{
+    Chip8 chip8;
+    loadCounter(chip8);
+
+    // Many ticks at once leave the timers where as many single ticks do
+    chip8.setDelayTimer(200);
+    chip8.setSoundTimer(7);
+    chip8.tickTimers(5);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(195),
+                         chip8.getDelayTimer());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(2),
+                         chip8.getSoundTimer());
+    chip8.tickTimers(1000000);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                         chip8.getDelayTimer());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                         chip8.getSoundTimer());
+
+    // Fx15 and Fx18 set the timers from the current tick, and Fx07 reads
+    // the delay timer as it is at the time
+    chip8.setRegister(0x3, 9);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf315));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf318));
+    chip8.tickTimers(4);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf407));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(5), chip8.getRegister(4));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(5),
+                         chip8.getSoundTimer());
+
+    // A fork and a saved state keep the timers running from the same tick
+    Chip8 fork;
+    fork.setLogging(false);
+    fork.initialize();
+    fork.forkFrom(chip8);
+    CPPUNIT_ASSERT_EQUAL(chip8.hashState(), fork.hashState());
+    fork.tickTimers(2);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(3), fork.getDelayTimer());
+    CPPUNIT_ASSERT_EQUAL(Ok, fork.loadState(chip8.saveState().data(),
+                                            Chip8::getStateSize()));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(5), fork.getDelayTimer());
+}
+
+void TestFrame::testFrame_error(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.setDelayTimer(3);
+
+    // A frame that fails does not decrement the timers, and stops the frames
+    // that follow it
+    const unsigned char program[] = {0x70, 0x01, 0x70, 0x01, 0xff, 0xff};
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram(program, sizeof(program)));
+    chip8.setInstructionsPerFrame(2);
+    CPPUNIT_ASSERT_EQUAL(Error, chip8.runFrames(3));
+    CPPUNIT_ASSERT_EQUAL(1ul, chip8.getFrames());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(2),
+                         chip8.getDelayTimer());
+}
+
+void TestFrame::testFrame_realTime(void)
+{
+    Chip8 chip8;
+    loadCounter(chip8);
+
+    // Frames in real time take at least the period of a frame each
+    chip8.setRealTime(true);
+    const auto start = std::chrono::steady_clock::now();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(6));
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    CPPUNIT_ASSERT(seconds >= 5.0 / FRAME_RATE);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(
+                             6 * DEFAULT_INSTRUCTIONS_PER_FRAME / 2),
+                         chip8.getRegister(0));
+}
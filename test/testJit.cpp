@@ -0,0 +1,204 @@
+#ifdef CHIP8_JIT
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "blockCache.hpp"
+#include "chip8.hpp"
+
+// This class will test the native code generated by the JIT produces the
+// same results as the interpreter
+class TestJit : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestJit);
+    CPPUNIT_TEST(testJit_games);
+    CPPUNIT_TEST(testJit_randomPrograms);
+    CPPUNIT_TEST(testJit_selfModifying);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testJit_games(void);
+    void testJit_randomPrograms(void);
+    void testJit_selfModifying(void);
+
+private:
+    void loadProgram(Chip8 &chip8, const std::vector<unsigned char> &program);
+    void runLockstep(const std::vector<unsigned char> &program,
+                     const size_t maxInstructions);
+    void checkSameState(const Chip8 &expected, const Chip8 &actual);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestJit);
+
+void TestJit::loadProgram(Chip8 &chip8,
+                          const std::vector<unsigned char> &program)
+{
+    chip8.setLogging(false);
+    chip8.initialize();
+    for (size_t index = 0; index < program.size(); index++)
+    {
+        chip8.setMemory(START_AVAILABLE_MEMORY + index, program[index]);
+    }
+}
+
+void TestJit::checkSameState(const Chip8 &expected, const Chip8 &actual)
+{
+    CPPUNIT_ASSERT_EQUAL(expected.getPc(), actual.getPc());
+    CPPUNIT_ASSERT_EQUAL(expected.getI(), actual.getI());
+    CPPUNIT_ASSERT_EQUAL(expected.getStackPointer(), actual.getStackPointer());
+    CPPUNIT_ASSERT_EQUAL(expected.getDelayTimer(), actual.getDelayTimer());
+    CPPUNIT_ASSERT_EQUAL(expected.getSoundTimer(), actual.getSoundTimer());
+    for (unsigned char index = 0; index < NUM_REGISTERS; index++)
+    {
+        CPPUNIT_ASSERT_EQUAL(expected.getRegister(index),
+                             actual.getRegister(index));
+    }
+    for (size_t index = 0; index < SIZE_STACK; index++)
+    {
+        CPPUNIT_ASSERT_EQUAL(expected.getStack()[index],
+                             actual.getStack()[index]);
+    }
+    for (unsigned short index = 0; index < NUM_BYTES_MEMORY; index++)
+    {
+        CPPUNIT_ASSERT_EQUAL(expected.getMemory(index),
+                             actual.getMemory(index));
+    }
+}
+
+void TestJit::runLockstep(const std::vector<unsigned char> &program,
+                          const size_t maxInstructions)
+{
+    Chip8 interpreter;
+    Chip8 jit;
+    loadProgram(interpreter, program);
+    loadProgram(jit, program);
+    interpreter.seedRandom(0x5eed);
+    jit.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, jit.setJit(true));
+
+    // Execute a native block at a time, and then the same number of cycles
+    // in the interpreter
+    size_t executed = 0;
+    while (executed < maxInstructions)
+    {
+        const unsigned long before = jit.getJitStatistics().instructions;
+        const ErrorCode result = jit.executeJit();
+        const unsigned long instructions =
+            jit.getJitStatistics().instructions - before;
+
+        for (unsigned long cycle = 0; cycle < instructions; cycle++)
+        {
+            CPPUNIT_ASSERT_EQUAL(Ok, interpreter.executeCycle());
+        }
+        executed += instructions;
+
+        // A failing instruction fails in both
+        if (result != Ok)
+        {
+            CPPUNIT_ASSERT_EQUAL(Error, interpreter.executeCycle());
+            break;
+        }
+        checkSameState(interpreter, jit);
+
+        // A program waiting on a key makes no progress
+        if (instructions == 0)
+        {
+            break;
+        }
+    }
+    checkSameState(interpreter, jit);
+}
+
+void TestJit::testJit_games(void)
+{
+    for (const auto &entry : std::filesystem::directory_iterator("games"))
+    {
+        std::ifstream file(entry.path(), std::ios::binary);
+        const std::vector<unsigned char> program(
+            (std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+        runLockstep(program, 100000);
+    }
+}
+
+void TestJit::testJit_randomPrograms(void)
+{
+    // Opcodes of all the translated instructions, with random operands
+    const unsigned short opcodes[] = {
+        0x3000, 0x4000, 0x5000, 0x6000, 0x7000, 0x8000, 0x8001,
+        0x8002, 0x8003, 0x8004, 0x8005, 0x8006, 0x8007, 0x800e,
+        0xa000, 0xf007, 0xf015, 0xf018, 0xf01e};
+    std::mt19937 generator(8);
+
+    for (size_t test = 0; test < 200; test++)
+    {
+        // A random sequence of instructions, followed by a jump back to the
+        // start so that blocks are executed repeatedly
+        std::vector<unsigned char> program;
+        for (size_t index = 0; index < 40; index++)
+        {
+            unsigned short opcode =
+                opcodes[generator() % (sizeof(opcodes) / sizeof(opcodes[0]))];
+            if ((opcode & 0xf000) == 0xf000)
+            {
+                opcode |= (generator() & 0xf) << 8;
+            }
+            else if ((opcode & 0xf000) == 0x8000 ||
+                     (opcode & 0xf000) == 0x5000)
+            {
+                opcode |= (generator() & 0xff) << 4;
+            }
+            else
+            {
+                opcode |= generator() & 0xfff;
+            }
+            program.push_back(opcode >> 8);
+            program.push_back(opcode & 0xff);
+        }
+        program.push_back(0x12);
+        program.push_back(0x00);
+
+        runLockstep(program, 2000);
+    }
+}
+
+void TestJit::testJit_selfModifying(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.setJit(true));
+
+    // A block that rewrites its own last instruction, LD V0, 0x05, into
+    // LD V0, 0x07 through LD [I], V1 before reaching it
+    chip8.setInstructionInMemory(0x200, 0xa208);
+    chip8.setInstructionInMemory(0x202, 0x6060);
+    chip8.setInstructionInMemory(0x204, 0x6107);
+    chip8.setInstructionInMemory(0x206, 0xf155);
+    chip8.setInstructionInMemory(0x208, 0x6005);
+    chip8.setInstructionInMemory(0x20a, 0x1200);
+
+    // The first block stops right after the write, and the next one is
+    // translated from the rewritten memory
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeJit());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x208), chip8.getPc());
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeJit());
+
+    // Check the rewritten instruction was the one executed
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x07),
+                         chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x200), chip8.getPc());
+    const BlockStatistics statistics = chip8.getJitStatistics();
+    CPPUNIT_ASSERT_EQUAL(2ul, statistics.executed);
+    CPPUNIT_ASSERT_EQUAL(2ul, statistics.compiled);
+    CPPUNIT_ASSERT_EQUAL(1ul, statistics.invalidated);
+    CPPUNIT_ASSERT_EQUAL(6ul, statistics.instructions);
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+#include "lockstep.hpp"
+
+// This class will test the lanes of the lockstep engine produce the same
+// results as one interpreter per lane
+class TestLockstep : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestLockstep);
+    CPPUNIT_TEST(testLockstep_games);
+    CPPUNIT_TEST(testLockstep_randomPrograms);
+    CPPUNIT_TEST(testLockstep_selfModifying);
+    CPPUNIT_TEST(testLockstep_diverged);
+    CPPUNIT_TEST(testLockstep_occupancy);
+    CPPUNIT_TEST(testLockstep_timers);
+    CPPUNIT_TEST(testLockstep_randomBytes);
+    CPPUNIT_TEST(testLockstep_endOfMemory);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testLockstep_games(void);
+    void testLockstep_randomPrograms(void);
+    void testLockstep_selfModifying(void);
+    void testLockstep_diverged(void);
+    void testLockstep_occupancy(void);
+    void testLockstep_timers(void);
+    void testLockstep_randomBytes(void);
+    void testLockstep_endOfMemory(void);
+
+private:
+    void runLockstep(LockstepEngine &engine,
+                     const std::vector<unsigned char> &program,
+                     const size_t steps);
+    void checkSameState(const Chip8 &expected, const Chip8 &actual);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestLockstep);
+
+void TestLockstep::checkSameState(const Chip8 &expected, const Chip8 &actual)
+{
+    CPPUNIT_ASSERT_EQUAL(expected.getPc(), actual.getPc());
+    CPPUNIT_ASSERT_EQUAL(expected.getI(), actual.getI());
+    CPPUNIT_ASSERT_EQUAL(expected.getStackPointer(), actual.getStackPointer());
+    CPPUNIT_ASSERT_EQUAL(expected.getDelayTimer(), actual.getDelayTimer());
+    CPPUNIT_ASSERT_EQUAL(expected.getSoundTimer(), actual.getSoundTimer());
+    CPPUNIT_ASSERT_EQUAL(expected.hashState(), actual.hashState());
+}
+
+void TestLockstep::runLockstep(LockstepEngine &engine,
+                               const std::vector<unsigned char> &program,
+                               const size_t steps)
+{
+    // Every lane starts with the registers it has in the engine, and the
+    // lanes are seeded from 0x5eed, in order
+    std::vector<std::vector<unsigned char>> registers(engine.getLanes());
+    for (size_t lane = 0; lane < engine.getLanes(); lane++)
+    {
+        for (unsigned char index = 0; index < NUM_REGISTERS; index++)
+        {
+            registers[lane].push_back(engine.getLane(lane).getRegister(index));
+        }
+    }
+    engine.run(steps);
+
+    for (size_t lane = 0; lane < engine.getLanes(); lane++)
+    {
+        Chip8 chip8;
+        chip8.setLogging(false);
+        chip8.initialize();
+        chip8.loadProgram(program.data(), program.size());
+        chip8.seedRandom(0x5eed + lane);
+        for (unsigned char index = 0; index < NUM_REGISTERS; index++)
+        {
+            chip8.setRegister(index, registers[lane][index]);
+        }
+
+        // A lane runs until the step where its interpreter fails
+        size_t step = 0;
+        ErrorCode result = Ok;
+        while (step < steps && (result = chip8.executeCycle()) == Ok)
+        {
+            step++;
+        }
+        CPPUNIT_ASSERT_EQUAL(result == Ok, engine.isRunning(lane));
+        checkSameState(chip8, engine.getLane(lane));
+    }
+}
+
+void TestLockstep::testLockstep_games(void)
+{
+    for (const auto &entry : std::filesystem::directory_iterator("games"))
+    {
+        std::ifstream file(entry.path(), std::ios::binary);
+        const std::vector<unsigned char> program(
+            (std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+
+        // A number of lanes that leaves a block partially used
+        LockstepEngine engine(37);
+        CPPUNIT_ASSERT_EQUAL(Ok,
+                             engine.loadProgram(program.data(), program.size()));
+        engine.seedRandom(0x5eed);
+        runLockstep(engine, program, 3000);
+    }
+}
+
+void TestLockstep::testLockstep_randomPrograms(void)
+{
+    // Opcodes of all the instructions with a vector form, and RND so that the
+    // lanes diverge, with random operands
+    const unsigned short opcodes[] = {
+        0x3000, 0x4000, 0x5000, 0x6000, 0x7000, 0x8000, 0x8001, 0x8002,
+        0x8003, 0x8004, 0x8005, 0x8006, 0x8007, 0x800e, 0xa000, 0xc000,
+        0xf007, 0xf015, 0xf018, 0xf01e};
+    std::mt19937 generator(7);
+
+    for (size_t test = 0; test < 50; test++)
+    {
+        // A random sequence of instructions, followed by a jump back to the
+        // start so that it is executed repeatedly
+        std::vector<unsigned char> program;
+        for (size_t index = 0; index < 40; index++)
+        {
+            unsigned short opcode =
+                opcodes[generator() % (sizeof(opcodes) / sizeof(opcodes[0]))];
+            if ((opcode & 0xf000) == 0xf000)
+            {
+                opcode |= (generator() & 0xf) << 8;
+            }
+            else if ((opcode & 0xf000) == 0x8000 ||
+                     (opcode & 0xf000) == 0x5000)
+            {
+                opcode |= (generator() & 0xff) << 4;
+            }
+            else
+            {
+                opcode |= generator() & 0xfff;
+            }
+            program.push_back(opcode >> 8);
+            program.push_back(opcode & 0xff);
+        }
+        program.push_back(0x12);
+        program.push_back(0x00);
+
+        LockstepEngine engine(70);
+        CPPUNIT_ASSERT_EQUAL(Ok,
+                             engine.loadProgram(program.data(), program.size()));
+        engine.seedRandom(0x5eed);
+        runLockstep(engine, program, 500);
+    }
+}
+
+void TestLockstep::testLockstep_selfModifying(void)
+{
+    // Each lane rewrites the instruction at 0x20a into LD V2 with the value
+    // of its own V1 through LD [I], V1
+    const std::vector<unsigned char> program = {0xa2, 0x0a, 0x60, 0x62, 0xf1,
+                                                0x55, 0x63, 0x00, 0x64, 0x00,
+                                                0x00, 0x00, 0x12, 0x00};
+    LockstepEngine engine(40);
+    CPPUNIT_ASSERT_EQUAL(Ok, engine.loadProgram(program.data(), program.size()));
+    engine.seedRandom(0x5eed);
+    for (size_t lane = 0; lane < engine.getLanes(); lane++)
+    {
+        engine.setRegister(lane, 0x1, lane % 3);
+    }
+    runLockstep(engine, program, 20);
+
+    // Check every lane executed its own version of the instruction
+    for (size_t lane = 0; lane < engine.getLanes(); lane++)
+    {
+        CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(lane % 3),
+                             engine.getLane(lane).getRegister(0x2));
+    }
+}
+
+void TestLockstep::testLockstep_diverged(void)
+{
+    // Every lane jumps to one of 16 entries of a table through JP V0, addr,
+    // with a random V0, so that the lanes spread over many PCs
+    std::vector<unsigned char> program = {0xc0, 0x1e, 0xb2, 0x04};
+    for (size_t entry = 0; entry < 16; entry++)
+    {
+        program.push_back(0x12);
+        program.push_back(0x00);
+    }
+    LockstepEngine engine(40);
+    CPPUNIT_ASSERT_EQUAL(Ok, engine.loadProgram(program.data(), program.size()));
+    engine.seedRandom(0x5eed);
+    runLockstep(engine, program, 300);
+    CPPUNIT_ASSERT(engine.getStatistics().occupancy() < 0.5);
+}
+
+void TestLockstep::testLockstep_occupancy(void)
+{
+    // Lanes that never diverge execute together with vector operations
+    const std::vector<unsigned char> program = {0x60, 0x01, 0x70, 0x01,
+                                                0x81, 0x04, 0x12, 0x02};
+    LockstepEngine engine(64);
+    CPPUNIT_ASSERT_EQUAL(Ok, engine.loadProgram(program.data(), program.size()));
+    CPPUNIT_ASSERT_EQUAL(6400ul, engine.run(100));
+
+    const LockstepStatistics &statistics = engine.getStatistics();
+    CPPUNIT_ASSERT_EQUAL(100ul, statistics.steps);
+    CPPUNIT_ASSERT_EQUAL(100ul, statistics.groups);
+    CPPUNIT_ASSERT_EQUAL(6400ul, statistics.vectorInstructions);
+    CPPUNIT_ASSERT(statistics.occupancy() == 1.0);
+}
+
+void TestLockstep::testLockstep_timers(void)
+{
+    // Every lane sets the delay timer to V3, waits for it with Fx07, 3xkk
+    // and 1nnn, and then counts in V2: 0x200 LD DT, V3, 0x202 LD V1, DT,
+    // 0x204 SE V1, 0, 0x206 JP 0x202, 0x208 ADD V2, 1 and 0x20A JP 0x208
+    const std::vector<unsigned char> program = {0xf3, 0x15, 0xf1, 0x07,
+                                                0x31, 0x00, 0x12, 0x02,
+                                                0x72, 0x01, 0x12, 0x08};
+    LockstepEngine engine(50);
+    CPPUNIT_ASSERT_EQUAL(Ok, engine.loadProgram(program.data(), program.size()));
+    for (size_t lane = 0; lane < engine.getLanes(); lane++)
+    {
+        engine.setRegister(lane, 0x3, lane % 30 + 1);
+    }
+    engine.runFrames(40);
+    CPPUNIT_ASSERT_EQUAL(40ul, engine.getFrames());
+
+    // The timers count down once per frame as in the interpreter, so every
+    // lane gets past its wait
+    for (size_t lane = 0; lane < engine.getLanes(); lane++)
+    {
+        Chip8 chip8;
+        chip8.setLogging(false);
+        chip8.initialize();
+        chip8.loadProgram(program.data(), program.size());
+        chip8.setRegister(0x3, lane % 30 + 1);
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(40));
+        checkSameState(chip8, engine.getLane(lane));
+        CPPUNIT_ASSERT(engine.getLane(lane).getRegister(0x2) > 0);
+        CPPUNIT_ASSERT_EQUAL(chip8.getFrames(),
+                             engine.getLane(lane).getFrames());
+    }
+}
+
+void TestLockstep::testLockstep_randomBytes(void)
+{
+    // RND with the bytes of LD B, Vx, LD [I], Vx and LD Vx, [I], which are
+    // still random numbers: 0x200 LD I, 0x300, 0x202 RND V1, 0x33, 0x204 RND
+    // V2, 0x55, 0x206 RND V3, 0x65, 0x208 RND V0, 0x33 and 0x20A JP 0x202
+    const std::vector<unsigned char> program = {0xa3, 0x00, 0xc1, 0x33,
+                                                0xc2, 0x55, 0xc3, 0x65,
+                                                0xc0, 0x33, 0x12, 0x02};
+    LockstepEngine engine(40);
+    CPPUNIT_ASSERT_EQUAL(Ok, engine.loadProgram(program.data(), program.size()));
+    engine.seedRandom(0x5eed);
+    runLockstep(engine, program, 50);
+}
+
+void TestLockstep::testLockstep_endOfMemory(void)
+{
+    // Write ADD V4, 7 and JP 0x20A at 0x000 with LD [I], V3, then jump to
+    // LD V4, 5 at 0xFFE, after which the pc wraps around to 0x000: 0x200 LD
+    // I, 0x000, 0x202 LD V0, 0x74, 0x204 LD V1, 0x07, 0x206 LD V2, 0x12,
+    // 0x208 LD V3, 0x0A, 0x20A LD [I], V3 and 0x20C JP 0xFFE
+    std::vector<unsigned char> program = {0xa0, 0x00, 0x60, 0x74, 0x61,
+                                          0x07, 0x62, 0x12, 0x63, 0x0a,
+                                          0xf3, 0x55, 0x1f, 0xfe};
+    program.resize(NUM_BYTES_MEMORY - 0x200);
+    program[NUM_BYTES_MEMORY - 0x202] = 0x64;
+    program[NUM_BYTES_MEMORY - 0x201] = 0x05;
+
+    // The lanes keep running past the end of memory as the interpreter does
+    LockstepEngine engine(40);
+    CPPUNIT_ASSERT_EQUAL(Ok, engine.loadProgram(program.data(), program.size()));
+    runLockstep(engine, program, 10);
+    for (size_t lane = 0; lane < engine.getLanes(); lane++)
+    {
+        CPPUNIT_ASSERT(engine.isRunning(lane));
+        CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(12),
+                             engine.getLane(lane).getRegister(0x4));
+    }
+}
@@ -0,0 +1,133 @@
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+
+// This class will test the pages of memory are shared between interpreters
+// until they are written
+class TestMemory : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestMemory);
+    CPPUNIT_TEST(testMemory_sharedProgram);
+    CPPUNIT_TEST(testMemory_copyOnWrite);
+    CPPUNIT_TEST(testMemory_fork);
+    CPPUNIT_TEST(testMemory_loadState);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testMemory_sharedProgram(void);
+    void testMemory_copyOnWrite(void);
+    void testMemory_fork(void);
+    void testMemory_loadState(void);
+
+private:
+    // Loads a program that stores V0 to V3 at 0x400 and counts in V0
+    void load(Chip8 &chip8);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestMemory);
+
+void TestMemory::load(Chip8 &chip8)
+{
+    const unsigned char program[] = {0xa4, 0x00, 0xf3, 0x55,
+                                     0x70, 0x01, 0x12, 0x00};
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram(program, sizeof(program)));
+}
+
+void TestMemory::testMemory_sharedProgram(void)
+{
+    // Interpreters that load the same program hold no page of their own
+    Chip8 first;
+    Chip8 second;
+    load(first);
+    load(second);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), first.getPrivatePages());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), second.getPrivatePages());
+    CPPUNIT_ASSERT_EQUAL(first.hashState(), second.hashState());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0xf0),
+                         first.getMemory(FONT_START));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0xa4),
+                         first.getMemory(START_AVAILABLE_MEMORY));
+}
+
+void TestMemory::testMemory_copyOnWrite(void)
+{
+    Chip8 first;
+    Chip8 second;
+    load(first);
+    load(second);
+    first.setRegister(0x1, 0x11);
+
+    // Writing to memory copies only the page written, and the other
+    // interpreter keeps the contents it had
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, first.runCycles(2).reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), first.getPrivatePages());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x11),
+                         first.getMemory(0x401));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x00),
+                         second.getMemory(0x401));
+
+    // A page written again is not copied again
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, first.runCycles(4).reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), first.getPrivatePages());
+
+    // Writing to the program copies its page too
+    first.setInstructionInMemory(0x206, 0x1202);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), first.getPrivatePages());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x12),
+                         second.getMemory(0x206));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x00),
+                         second.getMemory(0x207));
+}
+
+void TestMemory::testMemory_fork(void)
+{
+    Chip8 source;
+    load(source);
+    source.seedRandom(0x5eed);
+    source.setRegister(0x2, 0x22);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, source.runCycles(10).reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), source.getPrivatePages());
+
+    // A fork is the same interpreter, sharing every page
+    Chip8 fork;
+    fork.setLogging(false);
+    fork.forkFrom(source);
+    CPPUNIT_ASSERT_EQUAL(source.hashState(), fork.hashState());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), source.getPrivatePages());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), fork.getPrivatePages());
+
+    // Each of them copies the page it writes, without changing the other
+    fork.setRegister(0x2, 0x33);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, fork.runCycles(4).reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x33),
+                         fork.getMemory(0x402));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x22),
+                         source.getMemory(0x402));
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, source.runCycles(4).reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x22),
+                         source.getMemory(0x402));
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), source.getPrivatePages());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), fork.getPrivatePages());
+
+    // Both continue the same way from the same state
+    fork.forkFrom(source);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, source.runCycles(100).reason);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, fork.runCycles(100).reason);
+    CPPUNIT_ASSERT_EQUAL(source.hashState(), fork.hashState());
+}
+
+void TestMemory::testMemory_loadState(void)
+{
+    // Restoring a state does not copy the pages it leaves the same
+    Chip8 chip8;
+    load(chip8);
+    const std::vector<unsigned char> saved = chip8.saveState();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadState(saved.data(), saved.size()));
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), chip8.getPrivatePages());
+}
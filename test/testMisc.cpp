@@ -12,6 +12,8 @@ class TestMisc : public CppUnit::TestFixture
     CPPUNIT_TEST(testJP);
     CPPUNIT_TEST(testCALL);
     CPPUNIT_TEST(testJP_withReg0);
+    CPPUNIT_TEST(testRND);
+    CPPUNIT_TEST(testRND_seeded);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -19,6 +21,8 @@ public:
     void testJP(void);
     void testCALL(void);
     void testJP_withReg0(void);
+    void testRND(void);
+    void testRND_seeded(void);
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TestMisc);
@@ -134,3 +138,58 @@ void TestMisc::testJP_withReg0(void)
     // Check the pc has jumped to the proper value
     CPPUNIT_ASSERT_EQUAL(finalPc, chip8.getPc());
 }
+
+void TestMisc::testRND(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+
+    // Decide some values for the test
+    unsigned short instruction = 0xc30f;
+    unsigned short initialPc = 0x2;
+    unsigned short finalPc = 0x4;
+    unsigned char regIndex = 0x3;
+
+    // Initialize instruction and program counter
+    chip8.setInstructionInMemory(initialPc, instruction);
+    chip8.setPc(initialPc);
+    chip8.setRegister(regIndex, 0xff);
+
+    // Execute a cycle
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+
+    // Check the random value has been masked with the byte provided
+    CPPUNIT_ASSERT_EQUAL(0x0, chip8.getRegister(regIndex) & 0xf0);
+
+    // Check the pc has incremented
+    CPPUNIT_ASSERT_EQUAL(finalPc, chip8.getPc());
+}
+
+void TestMisc::testRND_seeded(void)
+{
+    // Two interpreters seeded with the same value
+    Chip8 chip8;
+    Chip8 other;
+    chip8.initialize();
+    other.initialize();
+    chip8.seedRandom(0x5eed);
+    other.seedRandom(0x5eed);
+
+    // Check they produce the same sequence of random numbers, which is not
+    // the same number over and over
+    unsigned short instruction = 0xc0ff;
+    bool allEqual = true;
+    unsigned char first = 0x0;
+    for (size_t draw = 0; draw < 16; draw++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(instruction));
+        CPPUNIT_ASSERT_EQUAL(Ok, other.executeInstruction(instruction));
+        CPPUNIT_ASSERT_EQUAL(chip8.getRegister(0x0), other.getRegister(0x0));
+        if (draw == 0)
+        {
+            first = chip8.getRegister(0x0);
+        }
+        allEqual = allEqual && chip8.getRegister(0x0) == first;
+    }
+    CPPUNIT_ASSERT(!allEqual);
+}
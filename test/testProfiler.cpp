@@ -0,0 +1,124 @@
+#ifdef CHIP8_PROFILE
+
+#include <sstream>
+#include <string>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+#include "profiler.hpp"
+
+// This class will test the counters of the profiler
+class TestProfiler : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestProfiler);
+    CPPUNIT_TEST(testProfiler_cycles);
+    CPPUNIT_TEST(testProfiler_blocks);
+    CPPUNIT_TEST(testProfiler_disabled);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testProfiler_cycles(void);
+    void testProfiler_blocks(void);
+    void testProfiler_disabled(void);
+
+private:
+    void loadLoop(Chip8 &chip8);
+    void checkLoop(const Profiler &profiler);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestProfiler);
+
+void TestProfiler::loadLoop(Chip8 &chip8)
+{
+    // A loop that adds to V0 until it reaches ten, followed by a call to a
+    // subroutine that jumps to itself
+    chip8.initialize();
+    chip8.setInstructionInMemory(0x200, 0x7001);
+    chip8.setInstructionInMemory(0x202, 0x300a);
+    chip8.setInstructionInMemory(0x204, 0x1200);
+    chip8.setInstructionInMemory(0x206, 0x2300);
+    chip8.setInstructionInMemory(0x300, 0x1300);
+}
+
+void TestProfiler::checkLoop(const Profiler &profiler)
+{
+    // Ten iterations of the loop, the last one skipping the jump back, the
+    // call, and the jump to itself for the rest of the instructions
+    CPPUNIT_ASSERT_EQUAL(50ul, profiler.getInstructions());
+    CPPUNIT_ASSERT_EQUAL(10ul, profiler.getAddressCount(0x200));
+    CPPUNIT_ASSERT_EQUAL(9ul, profiler.getAddressCount(0x204));
+    CPPUNIT_ASSERT_EQUAL(1ul, profiler.getAddressCount(0x206));
+    CPPUNIT_ASSERT_EQUAL(20ul, profiler.getAddressCount(0x300));
+
+    // Only the subroutine runs with an address in the stack
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(1), profiler.getMaxDepth());
+    CPPUNIT_ASSERT_EQUAL(30ul, profiler.getDepthCount(0));
+    CPPUNIT_ASSERT_EQUAL(20ul, profiler.getDepthCount(1));
+
+    const auto classes = profiler.getOpcodeClasses();
+    CPPUNIT_ASSERT_EQUAL(std::string("1nnn"), classes[0].first);
+    CPPUNIT_ASSERT_EQUAL(29ul, classes[0].second);
+
+    // Only the jump back to the start closes a loop
+    const std::vector<Profiler::Loop> loops = profiler.getLoops();
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), loops.size());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x200), loops[0].head);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x204), loops[0].end);
+    CPPUNIT_ASSERT_EQUAL(9ul, loops[0].count);
+}
+
+void TestProfiler::testProfiler_cycles(void)
+{
+    Chip8 chip8;
+    loadLoop(chip8);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.setProfiling(true));
+    for (size_t cycle = 0; cycle < 50; cycle++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    }
+    checkLoop(*chip8.getProfiler());
+
+    // Both reports list the hottest loop
+    std::ostringstream report;
+    chip8.getProfiler()->writeReport(report);
+    CPPUNIT_ASSERT(report.str().find("0x0200-0x0204") != std::string::npos);
+    std::ostringstream json;
+    chip8.getProfiler()->writeJson(json);
+    CPPUNIT_ASSERT(json.str().find("{\"head\": \"0x0200\", \"end\": \"0x0204\", "
+                                   "\"count\": 9}") != std::string::npos);
+}
+
+void TestProfiler::testProfiler_blocks(void)
+{
+    Chip8 chip8;
+    loadLoop(chip8);
+    chip8.setBlockCache(true);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.setProfiling(true));
+    while (chip8.getProfiler()->getInstructions() < 50)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeJit());
+    }
+    checkLoop(*chip8.getProfiler());
+}
+
+void TestProfiler::testProfiler_disabled(void)
+{
+    Chip8 chip8;
+    loadLoop(chip8);
+    CPPUNIT_ASSERT(chip8.getProfiler() == nullptr);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+
+    // Counting starts when the profiler is enabled, and disabling it throws
+    // the counters away
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.setProfiling(true));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(1ul, chip8.getProfiler()->getInstructions());
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.setProfiling(false));
+    CPPUNIT_ASSERT(!chip8.isProfilingEnabled());
+    CPPUNIT_ASSERT(chip8.getProfiler() == nullptr);
+}
+
+#endif
@@ -0,0 +1,217 @@
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "blockCache.hpp"
+#include "chip8.hpp"
+#include "lockstep.hpp"
+#include "quirks.hpp"
+
+// This class will test the instructions that differ between platforms follow
+// the selected quirk set in every execution engine, and the configuration of
+// the quirk set of each program
+class TestQuirks : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestQuirks);
+    CPPUNIT_TEST(testQuirks_instructions);
+    CPPUNIT_TEST(testQuirks_engines);
+    CPPUNIT_TEST(testQuirks_config);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testQuirks_instructions(void);
+    void testQuirks_engines(void);
+    void testQuirks_config(void);
+
+private:
+    // Initializes the interpreter with the given quirk set and loads a
+    // program that goes through all the instructions that have quirks
+    void load(Chip8 &chip8, unsigned char quirks);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestQuirks);
+
+namespace
+{
+// Shifts, ORs, stores and reads V0 to V3, and then jumps with B21C to
+// 0x21C + V0 or 0x21E + V2 before looping
+const std::vector<unsigned char> program = {
+    0x60, 0x81, 0x61, 0x03, 0x6f, 0x55, 0x80, 0x16, 0x82, 0x1e, 0x83, 0x11,
+    0xa3, 0x00, 0xf3, 0x55, 0xf1, 0x65, 0x60, 0x00, 0x62, 0x02, 0xb2, 0x1c,
+    0x60, 0x00, 0x60, 0x00, 0x75, 0x01, 0x76, 0x10, 0x12, 0x00};
+} // namespace
+
+void TestQuirks::load(Chip8 &chip8, unsigned char quirks)
+{
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.setQuirks(quirks);
+    CPPUNIT_ASSERT_EQUAL(Ok,
+                         chip8.loadProgram(program.data(), program.size()));
+}
+
+void TestQuirks::testQuirks_instructions(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0), chip8.getQuirks());
+
+    // Without quirks, 8xy6 shifts Vx and 8xy1 leaves VF alone
+    chip8.setRegister(0x0, 0x81);
+    chip8.setRegister(0x1, 0x04);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x8016));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x40),
+                         chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getRegister(15));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x8011));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getRegister(15));
+
+    // With the COSMAC quirks, 8xyE shifts Vy into Vx, 8xy2 clears VF and
+    // Fx55 and Fx65 move I past the registers
+    chip8.setQuirks(COSMAC_QUIRKS);
+    chip8.setRegister(0x1, 0x84);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x801e));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x08),
+                         chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x1),
+                         chip8.getRegister(15));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x8012));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x0),
+                         chip8.getRegister(15));
+    chip8.setI(0x300);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf255));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x303), chip8.getI());
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf065));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x304), chip8.getI());
+
+    // Bnnn jumps with V0, and with Vx on SCHIP
+    chip8.setRegister(0x0, 0x10);
+    chip8.setRegister(0x3, 0x20);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xb300));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x310), chip8.getPc());
+    chip8.setQuirks(SCHIP_QUIRKS);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xb300));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x320), chip8.getPc());
+}
+
+void TestQuirks::testQuirks_engines(void)
+{
+    const unsigned char sets[] = {0, COSMAC_QUIRKS, SCHIP_QUIRKS,
+                                  NUM_QUIRK_SETS - 1};
+    std::vector<uint64_t> hashes;
+    for (const unsigned char quirks : sets)
+    {
+        Chip8 start;
+        load(start, quirks);
+
+        // The caches and the JIT decode the instructions for the quirk set
+        // in use. Warm them up with another set, and check they are dropped
+        // when the quirk set is selected and when forking from it.
+        Chip8 cached;
+        load(cached, quirks ^ ShiftVyQuirk);
+        cached.setPredecode(true);
+        cached.setBlockCache(true);
+        const bool jit = cached.setJit(true) == Ok;
+        auto blockInstructions = [&cached, jit]()
+        {
+            return jit ? cached.getJitStatistics().instructions
+                       : cached.getBlockStatistics().instructions;
+        };
+        CPPUNIT_ASSERT_EQUAL(BudgetExhausted, cached.runCycles(500).reason);
+        for (unsigned int block = 0; block < 50; block++)
+        {
+            CPPUNIT_ASSERT_EQUAL(Ok, cached.executeJit());
+        }
+        cached.setQuirks(quirks);
+        cached.forkFrom(start);
+
+        CPPUNIT_ASSERT_EQUAL(BudgetExhausted, cached.runCycles(500).reason);
+        const unsigned long before = blockInstructions();
+        for (unsigned int block = 0; block < 50; block++)
+        {
+            CPPUNIT_ASSERT_EQUAL(Ok, cached.executeJit());
+        }
+        const unsigned long cycles = 500 + blockInstructions() - before;
+
+        Chip8 expected;
+        load(expected, quirks);
+        CPPUNIT_ASSERT_EQUAL(BudgetExhausted,
+                             expected.runCycles(cycles).reason);
+        CPPUNIT_ASSERT_EQUAL(expected.hashState(), cached.hashState());
+        CPPUNIT_ASSERT_EQUAL(expected.getI(), cached.getI());
+        hashes.push_back(expected.hashState());
+
+        // So do the lanes of the lockstep engine
+        LockstepEngine engine(LANE_BLOCK);
+        engine.setQuirks(quirks);
+        CPPUNIT_ASSERT_EQUAL(
+            Ok, engine.loadProgram(program.data(), program.size()));
+        engine.run(cycles);
+        for (size_t lane = 0; lane < engine.getLanes(); lane++)
+        {
+            CPPUNIT_ASSERT_EQUAL(expected.hashState(),
+                                 engine.getLane(lane).hashState());
+            CPPUNIT_ASSERT_EQUAL(expected.getI(), engine.getLane(lane).getI());
+        }
+    }
+
+    // Every quirk set behaves differently on the program
+    for (size_t first = 0; first < hashes.size(); first++)
+    {
+        for (size_t second = first + 1; second < hashes.size(); second++)
+        {
+            CPPUNIT_ASSERT(hashes[first] != hashes[second]);
+        }
+    }
+}
+
+void TestQuirks::testQuirks_config(void)
+{
+    const std::string filename = "testQuirks.cfg";
+    {
+        std::ofstream file(filename);
+        file << "# Program   Quirks\n"
+                "\n"
+                "*           schip\n"
+                "ORIGINAL    cosmac   # Comment\n"
+                "SHIFTING    shift-vy reset-vf\n"
+                "PLAIN       none\n";
+    }
+
+    // Programs are found by the name of their file
+    QuirkConfig config;
+    CPPUNIT_ASSERT_EQUAL(Ok, config.load(filename));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(COSMAC_QUIRKS),
+                         config.find("games/ORIGINAL"));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(ShiftVyQuirk |
+                                                    ResetVfQuirk),
+                         config.find("SHIFTING"));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0), config.find("PLAIN"));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(SCHIP_QUIRKS),
+                         config.find("/somewhere/else/OTHER"));
+
+    // Loading a program selects its quirk set
+    config.set("PONG", IncrementIQuirk);
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram("./games/PONG", config));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(IncrementIQuirk),
+                         chip8.getQuirks());
+
+    // A quirk that is not known fails
+    {
+        std::ofstream file(filename);
+        file << "BROKEN cosmac shift-vx\n";
+    }
+    CPPUNIT_ASSERT_EQUAL(Error, QuirkConfig().load(filename));
+    std::remove(filename.c_str());
+    CPPUNIT_ASSERT_EQUAL(FileOpenError, QuirkConfig().load(filename));
+}
@@ -0,0 +1,157 @@
+#include <cstdint>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+#include "rewind.hpp"
+
+// This class will test the states restored by the rewind buffer are the ones
+// recorded
+class TestRewind : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestRewind);
+    CPPUNIT_TEST(testRewind_frames);
+    CPPUNIT_TEST(testRewind_recordAfterRewind);
+    CPPUNIT_TEST(testRewind_ring);
+    CPPUNIT_TEST(testRewind_memory);
+    CPPUNIT_TEST(testRewind_extended);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testRewind_frames(void);
+    void testRewind_recordAfterRewind(void);
+    void testRewind_ring(void);
+    void testRewind_memory(void);
+    void testRewind_extended(void);
+
+private:
+    // Loads a game, and runs and records the given number of frames,
+    // returning the hash of the state of each of them
+    std::vector<uint64_t> record(Chip8 &chip8, Rewind &rewind,
+                                 unsigned long frames);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestRewind);
+
+std::vector<uint64_t> TestRewind::record(Chip8 &chip8, Rewind &rewind,
+                                         unsigned long frames)
+{
+    std::vector<uint64_t> hashes;
+    for (unsigned long frame = 0; frame < frames; frame++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrame());
+        CPPUNIT_ASSERT_EQUAL(Ok, rewind.record(chip8));
+        hashes.push_back(chip8.hashState());
+    }
+    return hashes;
+}
+
+void TestRewind::testRewind_frames(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram("games/BRIX"));
+    Rewind rewind(1000, 16);
+    const std::vector<uint64_t> hashes = record(chip8, rewind, 300);
+    CPPUNIT_ASSERT_EQUAL(300ul, rewind.getFrames());
+
+    // Go back step by step, through deltas and keyframes
+    for (unsigned long frame = 0; frame < 40; frame++)
+    {
+        CPPUNIT_ASSERT_EQUAL(Ok, rewind.rewind(chip8, frame == 0 ? 0 : 1));
+        CPPUNIT_ASSERT_EQUAL(hashes[299 - frame], chip8.hashState());
+    }
+
+    // Jump back to the first frame, and no further
+    CPPUNIT_ASSERT_EQUAL(Error, rewind.rewind(chip8, 300));
+    CPPUNIT_ASSERT_EQUAL(Ok, rewind.rewind(chip8, rewind.getFrames() - 1));
+    CPPUNIT_ASSERT_EQUAL(hashes[0], chip8.hashState());
+    CPPUNIT_ASSERT_EQUAL(1ul, rewind.getFrames());
+}
+
+void TestRewind::testRewind_recordAfterRewind(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram("games/BRIX"));
+    Rewind rewind(1000, 10);
+    const std::vector<uint64_t> first = record(chip8, rewind, 100);
+
+    // Going back and running again records the same frames again
+    CPPUNIT_ASSERT_EQUAL(Ok, rewind.rewind(chip8, 25));
+    CPPUNIT_ASSERT_EQUAL(first[74], chip8.hashState());
+    const std::vector<uint64_t> second = record(chip8, rewind, 25);
+    for (size_t frame = 0; frame < second.size(); frame++)
+    {
+        CPPUNIT_ASSERT_EQUAL(first[75 + frame], second[frame]);
+    }
+    CPPUNIT_ASSERT_EQUAL(100ul, rewind.getFrames());
+    CPPUNIT_ASSERT_EQUAL(Ok, rewind.rewind(chip8, 7));
+    CPPUNIT_ASSERT_EQUAL(first[92], chip8.hashState());
+}
+
+void TestRewind::testRewind_ring(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram("games/BRIX"));
+
+    // Only the newest frames are kept, and the deltas of the oldest are
+    // dropped with their keyframe
+    Rewind rewind(50, 20);
+    const std::vector<uint64_t> hashes = record(chip8, rewind, 500);
+    CPPUNIT_ASSERT(rewind.getFrames() <= 50);
+    CPPUNIT_ASSERT(rewind.getFrames() > 50 - 20);
+    const unsigned long oldest = rewind.getFrames() - 1;
+    CPPUNIT_ASSERT_EQUAL(Error, rewind.rewind(chip8, oldest + 1));
+    CPPUNIT_ASSERT_EQUAL(Ok, rewind.rewind(chip8, oldest));
+    CPPUNIT_ASSERT_EQUAL(hashes[499 - oldest], chip8.hashState());
+}
+
+void TestRewind::testRewind_memory(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram("games/BRIX"));
+
+    // A minute of history takes a fraction of what whole states would
+    Rewind rewind;
+    record(chip8, rewind, 60 * FRAME_RATE);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned long>(60 * FRAME_RATE),
+                         rewind.getFrames());
+    CPPUNIT_ASSERT(rewind.getMemoryUsage() <
+                   60 * FRAME_RATE * Chip8::getStateSize() / 10);
+}
+
+void TestRewind::testRewind_extended(void)
+{
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram("games/BRIX"));
+    Rewind rewind(100, 16);
+    const std::vector<uint64_t> hashes = record(chip8, rewind, 10);
+
+    // The state of the extended mode cannot be saved, so its frames are not
+    // recorded and the ones before them are still restored
+    Chip8 extended;
+    extended.setLogging(false);
+    extended.setExtended(true);
+    extended.initialize();
+    CPPUNIT_ASSERT_EQUAL(Error, rewind.record(extended));
+    CPPUNIT_ASSERT_EQUAL(10ul, rewind.getFrames());
+    CPPUNIT_ASSERT_EQUAL(Ok, rewind.rewind(chip8, 0));
+    CPPUNIT_ASSERT_EQUAL(hashes.back(), chip8.hashState());
+}
@@ -0,0 +1,231 @@
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+
+// This class will test the runs of many instructions and the reasons they
+// stop for
+class TestRun : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestRun);
+    CPPUNIT_TEST(testRun_budget);
+    CPPUNIT_TEST(testRun_unknownOpcode);
+    CPPUNIT_TEST(testRun_stackOverflow);
+    CPPUNIT_TEST(testRun_stackUnderflow);
+    CPPUNIT_TEST(testRun_waitingOnKey);
+    CPPUNIT_TEST(testRun_breakpoint);
+    CPPUNIT_TEST(testRun_breakpointEndOfMemory);
+    CPPUNIT_TEST(testRun_until);
+    CPPUNIT_TEST(testRun_idleLoop);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testRun_budget(void);
+    void testRun_unknownOpcode(void);
+    void testRun_stackOverflow(void);
+    void testRun_stackUnderflow(void);
+    void testRun_waitingOnKey(void);
+    void testRun_breakpoint(void);
+    void testRun_breakpointEndOfMemory(void);
+    void testRun_until(void);
+    void testRun_idleLoop(void);
+
+private:
+    // Initializes the interpreter and loads the program
+    void load(Chip8 &chip8, const std::vector<unsigned char> &program);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestRun);
+
+void TestRun::load(Chip8 &chip8, const std::vector<unsigned char> &program)
+{
+    chip8.setLogging(false);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram(program.data(), program.size()));
+}
+
+void TestRun::testRun_budget(void)
+{
+    // ADD V0, 1 and a jump back to it
+    Chip8 chip8;
+    load(chip8, {0x70, 0x01, 0x12, 0x00});
+
+    const RunResult result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, result.reason);
+    CPPUNIT_ASSERT_EQUAL(100ul, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(50), chip8.getRegister(0));
+}
+
+void TestRun::testRun_unknownOpcode(void)
+{
+    Chip8 chip8;
+    load(chip8, {0x60, 0x01, 0x61, 0x02, 0xff, 0xff});
+
+    // The failing instruction is not counted, and the PC stays on it
+    const RunResult result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(UnknownOpcode, result.reason);
+    CPPUNIT_ASSERT_EQUAL(2ul, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x204), chip8.getPc());
+}
+
+void TestRun::testRun_stackOverflow(void)
+{
+    // A subroutine that calls itself
+    Chip8 chip8;
+    load(chip8, {0x22, 0x00});
+
+    const RunResult result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(StackOverflow, result.reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned long>(SIZE_STACK - 1),
+                         result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(SIZE_STACK - 1),
+                         chip8.getStackPointer());
+}
+
+void TestRun::testRun_stackUnderflow(void)
+{
+    // A return without a call
+    Chip8 chip8;
+    load(chip8, {0x00, 0xee});
+
+    const RunResult result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(StackUnderflow, result.reason);
+    CPPUNIT_ASSERT_EQUAL(0ul, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0),
+                         chip8.getStackPointer());
+}
+
+void TestRun::testRun_waitingOnKey(void)
+{
+    // LD V3, K followed by ADD V3, 1
+    Chip8 chip8;
+    load(chip8, {0xf3, 0x0a, 0x73, 0x01, 0x12, 0x04});
+
+    // Nothing is executed until a key is pressed
+    RunResult result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(WaitingOnKey, result.reason);
+    CPPUNIT_ASSERT_EQUAL(0ul, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x200), chip8.getPc());
+
+    // A cycle waiting on a key is not an error for executeCycle
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x200), chip8.getPc());
+
+    // The lowest key pressed is loaded
+    chip8.setKey(0x9, true);
+    chip8.setKey(0x6, true);
+    result = chip8.runCycles(2);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, result.reason);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x7),
+                         chip8.getRegister(0x3));
+}
+
+void TestRun::testRun_breakpoint(void)
+{
+    Chip8 chip8;
+    load(chip8, {0x70, 0x01, 0x71, 0x01, 0x72, 0x01, 0x12, 0x00});
+    chip8.setBreakpoint(0x204);
+
+    // Stop before the instruction at the breakpoint
+    RunResult result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(Breakpoint, result.reason);
+    CPPUNIT_ASSERT_EQUAL(2ul, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x204), chip8.getPc());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0), chip8.getRegister(2));
+
+    // Running again resumes from it until it is reached again
+    result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(Breakpoint, result.reason);
+    CPPUNIT_ASSERT_EQUAL(4ul, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(1), chip8.getRegister(2));
+
+    // Without breakpoints, the budget is exhausted
+    chip8.clearBreakpoints();
+    result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, result.reason);
+}
+
+void TestRun::testRun_breakpointEndOfMemory(void)
+{
+    // 0x200 JP 0xFFE, 0xFFE LD V0, 1, and then the instructions at the
+    // start of memory: 0x000 ADD V1, 2 and 0x002 JP 0x200
+    Chip8 chip8;
+    load(chip8, {0x1f, 0xfe});
+    chip8.setInstructionInMemory(0xffe, 0x6001);
+    chip8.setInstructionInMemory(0x000, 0x7102);
+    chip8.setInstructionInMemory(0x002, 0x1200);
+    chip8.setBreakpoint(0x000);
+
+    // The pc wraps around past the end of memory onto the breakpoint
+    RunResult result = chip8.runCycles(100);
+    CPPUNIT_ASSERT_EQUAL(Breakpoint, result.reason);
+    CPPUNIT_ASSERT_EQUAL(2ul, result.cycles);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(1), chip8.getRegister(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0), chip8.getRegister(1));
+
+    // The same holds when running until a condition
+    load(chip8, {0x1f, 0xfe});
+    chip8.setInstructionInMemory(0xffe, 0x6001);
+    result = chip8.runUntil([](const Chip8 &state) { return false; }, 100);
+    CPPUNIT_ASSERT_EQUAL(Breakpoint, result.reason);
+    CPPUNIT_ASSERT_EQUAL(2ul, result.cycles);
+}
+
+void TestRun::testRun_until(void)
+{
+    Chip8 chip8;
+    load(chip8, {0x70, 0x01, 0x12, 0x00});
+
+    // Run until V0 reaches a value
+    RunResult result = chip8.runUntil([](const Chip8 &state)
+                                      { return state.getRegister(0) == 30; });
+    CPPUNIT_ASSERT_EQUAL(ConditionMet, result.reason);
+    CPPUNIT_ASSERT_EQUAL(59ul, result.cycles);
+
+    // The budget stops a condition that never holds
+    result = chip8.runUntil([](const Chip8 &state) { return false; }, 10);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, result.reason);
+    CPPUNIT_ASSERT_EQUAL(10ul, result.cycles);
+}
+
+void TestRun::testRun_idleLoop(void)
+{
+    // Set the delay timer to 3 and wait for it with Fx07, 3xkk and a jump
+    // back, then wait for key 5 with ExA1 and a jump back, and count in V2
+    const std::vector<unsigned char> program = {
+        0x60, 0x03, 0xf0, 0x15, 0xf1, 0x07, 0x31, 0x00, 0x12, 0x04,
+        0x63, 0x05, 0xe3, 0xa1, 0x12, 0x0c, 0x72, 0x01, 0x12, 0x10};
+    Chip8 skipping;
+    Chip8 stepping;
+    load(skipping, program);
+    load(stepping, program);
+    stepping.setIdleSkipping(false);
+
+    // Both end every run in the same state, but the loops are skipped
+    // through, while the timer and the key change between runs
+    const unsigned long budgets[] = {1000, 7, 1, 2, 100000, 5, 1000};
+    for (size_t run = 0; run < sizeof(budgets) / sizeof(budgets[0]); run++)
+    {
+        const RunResult expected = stepping.runCycles(budgets[run]);
+        const RunResult actual = skipping.runCycles(budgets[run]);
+        CPPUNIT_ASSERT_EQUAL(expected.reason, actual.reason);
+        CPPUNIT_ASSERT_EQUAL(expected.cycles, actual.cycles);
+        CPPUNIT_ASSERT_EQUAL(stepping.hashState(), skipping.hashState());
+        stepping.tickTimers();
+        skipping.tickTimers();
+        stepping.setKey(0x5, run < 4);
+        skipping.setKey(0x5, run < 4);
+    }
+    CPPUNIT_ASSERT_EQUAL(0ul, stepping.getElidedCycles());
+    CPPUNIT_ASSERT(skipping.getElidedCycles() > 100000);
+    CPPUNIT_ASSERT(skipping.getRegister(2) > 0);
+
+    // Nothing is skipped with a breakpoint set, which may be in the loop
+    load(skipping, program);
+    skipping.setBreakpoint(0x300);
+    CPPUNIT_ASSERT_EQUAL(BudgetExhausted, skipping.runCycles(1000).reason);
+    CPPUNIT_ASSERT_EQUAL(0ul, skipping.getElidedCycles());
+}
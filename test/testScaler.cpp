@@ -0,0 +1,224 @@
+#include <cstdint>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+#include "frameScaler.hpp"
+
+// This class will test the expansion of the display into scaled pixels: the
+// kernels against each other, the colours, the rows and the decay
+class TestScaler : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestScaler);
+    CPPUNIT_TEST(testScaler_kernels);
+    CPPUNIT_TEST(testScaler_pixels);
+    CPPUNIT_TEST(testScaler_extended);
+    CPPUNIT_TEST(testScaler_rows);
+    CPPUNIT_TEST(testScaler_decay);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testScaler_kernels(void);
+    void testScaler_pixels(void);
+    void testScaler_extended(void);
+    void testScaler_rows(void);
+    void testScaler_decay(void);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestScaler);
+
+namespace
+{
+const uint32_t foreground = 0xff20c0f0u;
+const uint32_t background = 0xff102030u;
+
+// Returns a display of the given size with a pattern in every row that
+// leaves some bytes empty and fills some others
+std::vector<uint64_t> pattern(unsigned int width, unsigned int height)
+{
+    std::vector<uint64_t> display(width / 64 * height);
+    for (size_t word = 0; word < display.size(); word++)
+    {
+        display[word] = 0x8000ff00f0f01234ull * (word + 1) ^ (word << 17);
+    }
+    return display;
+}
+} // namespace
+
+void TestScaler::testScaler_kernels(void)
+{
+    // Both kernels write the same pixels for every size and scale
+    for (const unsigned int width : {DISPLAY_WIDTH, EXTENDED_DISPLAY_WIDTH})
+    {
+        const unsigned int height = width / 2;
+        const std::vector<uint64_t> display = pattern(width, height);
+        for (const unsigned int scale : {1u, 2u, 3u, 5u, 8u})
+        {
+            FrameScaler scaler(scale);
+            scaler.setColors(foreground, background);
+            const size_t size =
+                static_cast<size_t>(width) * height * scale * scale;
+            std::vector<uint32_t> scalar(size), vector(size);
+            scaler.setKernel(ScalarKernel);
+            scaler.expand(display.data(), width, height, scalar.data());
+            scaler.setKernel(VectorKernel);
+            scaler.expand(display.data(), width, height, vector.data());
+            CPPUNIT_ASSERT(scalar == vector);
+        }
+    }
+}
+
+void TestScaler::testScaler_pixels(void)
+{
+    // Draw the 0 of the font at (2, 1), scaled by 3
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.setRegister(0x0, 2);
+    chip8.setRegister(0x1, 1);
+    chip8.setI(FONT_START);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd015));
+
+    FrameScaler scaler(3);
+    scaler.setColors(foreground, background);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(3 * DISPLAY_WIDTH),
+                         scaler.getWidth(chip8));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(3 * DISPLAY_HEIGHT),
+                         scaler.getHeight(chip8));
+    std::vector<uint32_t> pixels(scaler.getWidth(chip8) *
+                                 scaler.getHeight(chip8));
+    scaler.expand(chip8, pixels.data());
+
+    const unsigned int width = scaler.getWidth(chip8);
+    for (unsigned int y = 0; y < scaler.getHeight(chip8); y++)
+    {
+        for (unsigned int x = 0; x < width; x++)
+        {
+            const bool set = chip8.getPixel(x / 3, y / 3);
+            CPPUNIT_ASSERT_EQUAL(set ? foreground : background,
+                                 pixels[y * width + x]);
+        }
+    }
+    CPPUNIT_ASSERT_EQUAL(foreground, pixels[3 * width + 6]);
+    CPPUNIT_ASSERT_EQUAL(background, pixels[3 * width + 5]);
+
+    // The scale is kept between 1 and MAX_SCALE
+    scaler.setScale(0);
+    CPPUNIT_ASSERT_EQUAL(1u, scaler.getScale());
+    scaler.setScale(MAX_SCALE + 1);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(MAX_SCALE),
+                         scaler.getScale());
+}
+
+void TestScaler::testScaler_extended(void)
+{
+    // A pixel is set if it is set in any plane of the extended display
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.setExtended(true);
+    chip8.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0x00ff));
+    chip8.setI(FONT_START);
+    chip8.setRegister(0x0, 120);
+    chip8.setRegister(0x1, 60);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf101));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd014));
+    chip8.setRegister(0x0, 0);
+    chip8.setRegister(0x1, 0);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xf201));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xd014));
+
+    FrameScaler scaler(2);
+    scaler.setColors(foreground, background);
+    const unsigned int width = scaler.getWidth(chip8);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(2 * EXTENDED_DISPLAY_WIDTH),
+                         width);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(2 * EXTENDED_DISPLAY_HEIGHT),
+                         scaler.getHeight(chip8));
+    std::vector<uint32_t> pixels(width * scaler.getHeight(chip8));
+    scaler.expand(chip8, pixels.data());
+    for (unsigned int y = 0; y < scaler.getHeight(chip8); y++)
+    {
+        for (unsigned int x = 0; x < width; x++)
+        {
+            const bool set = chip8.getPlanePixel(x / 2, y / 2) != 0;
+            CPPUNIT_ASSERT_EQUAL(set ? foreground : background,
+                                 pixels[y * width + x]);
+        }
+    }
+    CPPUNIT_ASSERT_EQUAL(foreground, pixels[0]);
+    CPPUNIT_ASSERT_EQUAL(foreground, pixels[120 * width + 240]);
+}
+
+void TestScaler::testScaler_rows(void)
+{
+    // Only the selected rows are written, for each kernel
+    const std::vector<uint64_t> display =
+        pattern(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    for (const ScalerKernel kernel : {ScalarKernel, VectorKernel})
+    {
+        FrameScaler scaler(2);
+        scaler.setKernel(kernel);
+        const unsigned int width = 2 * DISPLAY_WIDTH;
+        std::vector<uint32_t> pixels(width * 2 * DISPLAY_HEIGHT, 0x12345678);
+        scaler.expand(display.data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                      pixels.data(), 0x00000005);
+        for (unsigned int y = 0; y < 2 * DISPLAY_HEIGHT; y++)
+        {
+            const bool selected = y / 2 == 0 || y / 2 == 2;
+            for (unsigned int x = 0; x < width; x++)
+            {
+                CPPUNIT_ASSERT_EQUAL(selected,
+                                     pixels[y * width + x] != 0x12345678u);
+            }
+        }
+    }
+}
+
+void TestScaler::testScaler_decay(void)
+{
+    FrameScaler scaler(2);
+    scaler.setColors(0xffffffffu, 0xff000000u);
+    scaler.setDecay(128);
+    std::vector<uint64_t> display(DISPLAY_HEIGHT);
+    std::vector<uint32_t> pixels(4 * DISPLAY_WIDTH * DISPLAY_HEIGHT);
+    const unsigned int width = 2 * DISPLAY_WIDTH;
+
+    // A pixel that is set is drawn in the foreground at once
+    display[1] = 0x1ull << 63;
+    scaler.expand(display.data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                  pixels.data());
+    CPPUNIT_ASSERT_EQUAL(0xffffffffu, pixels[2 * width]);
+    CPPUNIT_ASSERT_EQUAL(0xffffffffu, pixels[3 * width + 1]);
+    CPPUNIT_ASSERT_EQUAL(0xff000000u, pixels[2 * width + 2]);
+
+    // Once it is turned off it fades through grey, even in a row that is not
+    // selected, and ends in the background
+    display[1] = 0;
+    scaler.expand(display.data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                  pixels.data(), 0);
+    CPPUNIT_ASSERT_EQUAL(0xff7f7f7fu, pixels[2 * width]);
+    CPPUNIT_ASSERT_EQUAL(0xff7f7f7fu, pixels[3 * width + 1]);
+    scaler.expand(display.data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                  pixels.data());
+    CPPUNIT_ASSERT_EQUAL(0xff3f3f3fu, pixels[2 * width]);
+    for (unsigned int frame = 0; frame < 8; frame++)
+    {
+        scaler.expand(display.data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                      pixels.data());
+    }
+    CPPUNIT_ASSERT_EQUAL(0xff000000u, pixels[2 * width]);
+
+    // Resetting the scaler forgets what was drawn
+    display[1] = 0x1ull << 63;
+    scaler.expand(display.data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                  pixels.data());
+    display[1] = 0;
+    scaler.reset();
+    scaler.expand(display.data(), DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                  pixels.data());
+    CPPUNIT_ASSERT_EQUAL(0xff000000u, pixels[2 * width]);
+}
@@ -14,6 +14,8 @@ class TestSkip : public CppUnit::TestFixture
     CPPUNIT_TEST(testSNE_noSkip);
     CPPUNIT_TEST(testSE_registers_skip);
     CPPUNIT_TEST(testSE_registers_noSkip);
+    CPPUNIT_TEST(testSKP);
+    CPPUNIT_TEST(testSKNP);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -24,6 +26,8 @@ public:
     void testSNE_noSkip(void);
     void testSE_registers_skip(void);
     void testSE_registers_noSkip(void);
+    void testSKP(void);
+    void testSKNP(void);
 
 private:
     void testSE(const unsigned short initialPc,
@@ -189,4 +193,36 @@ void TestSkip::testSE_registers_noSkip()
 
     testSE_registers(initialPc, registerIndex1, registerValue1, registerIndex2,
                      registerValue2, false);
-}
\ No newline at end of file
+}
+
+void TestSkip::testSKP(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setRegister(0x4, 0xb);
+
+    // Skip only while the key in V4 is pressed
+    chip8.setPc(0x300);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xe49e));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x302), chip8.getPc());
+    chip8.setKey(0xb, true);
+    chip8.setPc(0x300);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xe49e));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x304), chip8.getPc());
+}
+
+void TestSkip::testSKNP(void)
+{
+    Chip8 chip8;
+    chip8.initialize();
+    chip8.setRegister(0x4, 0xb);
+
+    // Skip only while the key in V4 is not pressed
+    chip8.setPc(0x300);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xe4a1));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x304), chip8.getPc());
+    chip8.setKey(0xb, true);
+    chip8.setPc(0x300);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeInstruction(0xe4a1));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned short>(0x302), chip8.getPc());
+}
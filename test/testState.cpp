@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <vector>
+
+#include "cppunit/TestCase.h"
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+
+#include "chip8.hpp"
+
+// This class will test saving and restoring the state of the interpreter
+class TestState : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TestState);
+    CPPUNIT_TEST(testState_roundTrip);
+    CPPUNIT_TEST(testState_file);
+    CPPUNIT_TEST(testState_corrupted);
+    CPPUNIT_TEST(testState_bufferTooSmall);
+    CPPUNIT_TEST(testState_code);
+    CPPUNIT_TEST(testState_quirks);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testState_roundTrip(void);
+    void testState_file(void);
+    void testState_corrupted(void);
+    void testState_bufferTooSmall(void);
+    void testState_code(void);
+    void testState_quirks(void);
+
+private:
+    // Loads a program that draws random sprites and calls a subroutine
+    void load(Chip8 &chip8);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestState);
+
+void TestState::load(Chip8 &chip8)
+{
+    const unsigned char program[] = {0xc0, 0x3f, 0xc1, 0x1f, 0xf2, 0x29,
+                                     0xd0, 0x15, 0x22, 0x0e, 0x12, 0x00,
+                                     0x00, 0x00, 0x72, 0x01, 0xf3, 0x15,
+                                     0x12, 0x00};
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.seedRandom(0x5eed);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadProgram(program, sizeof(program)));
+}
+
+void TestState::testState_roundTrip(void)
+{
+    Chip8 chip8;
+    load(chip8);
+    chip8.setDelayTimer(9);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(3));
+    const std::vector<unsigned char> saved = chip8.saveState();
+    CPPUNIT_ASSERT_EQUAL(Chip8::getStateSize(), saved.size());
+    const uint64_t hash = chip8.hashState();
+
+    // Run further, and keep the state reached
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(5));
+    const uint64_t later = chip8.hashState();
+
+    // A different interpreter restored from the saved state is the same one,
+    // and runs the same, random numbers included
+    Chip8 restored;
+    restored.setLogging(false);
+    restored.initialize();
+    CPPUNIT_ASSERT_EQUAL(Ok, restored.loadState(saved.data(), saved.size()));
+    CPPUNIT_ASSERT_EQUAL(hash, restored.hashState());
+    CPPUNIT_ASSERT_EQUAL(3ul, restored.getFrames());
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(ALL_DISPLAY_ROWS),
+                         restored.getDirtyRows());
+    CPPUNIT_ASSERT_EQUAL(Ok, restored.runFrames(5));
+    CPPUNIT_ASSERT_EQUAL(later, restored.hashState());
+}
+
+void TestState::testState_file(void)
+{
+    Chip8 chip8;
+    load(chip8);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(4));
+    const uint64_t hash = chip8.hashState();
+
+    const std::string filename = "testState.bin";
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.saveState(filename));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(4));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadState(filename));
+    CPPUNIT_ASSERT_EQUAL(hash, chip8.hashState());
+    std::remove(filename.c_str());
+
+    CPPUNIT_ASSERT_EQUAL(FileOpenError, chip8.loadState(filename));
+}
+
+void TestState::testState_corrupted(void)
+{
+    Chip8 chip8;
+    load(chip8);
+    std::vector<unsigned char> saved = chip8.saveState();
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.runFrames(2));
+    const uint64_t hash = chip8.hashState();
+
+    // A changed byte of the state fails the checksum, and a changed version
+    // is not accepted either. Nothing is restored in both cases
+    saved[saved.size() - 100] ^= 0x1;
+    CPPUNIT_ASSERT_EQUAL(InvalidState,
+                         chip8.loadState(saved.data(), saved.size()));
+    saved[saved.size() - 100] ^= 0x1;
+    saved[4]++;
+    CPPUNIT_ASSERT_EQUAL(InvalidState,
+                         chip8.loadState(saved.data(), saved.size()));
+    CPPUNIT_ASSERT_EQUAL(hash, chip8.hashState());
+
+    // A truncated state is not accepted
+    saved[4]--;
+    CPPUNIT_ASSERT_EQUAL(InvalidState,
+                         chip8.loadState(saved.data(), saved.size() - 1));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadState(saved.data(), saved.size()));
+}
+
+void TestState::testState_bufferTooSmall(void)
+{
+    Chip8 chip8;
+    load(chip8);
+    std::vector<unsigned char> buffer(Chip8::getStateSize() - 1);
+    CPPUNIT_ASSERT_EQUAL(NotEnoughMemory,
+                         chip8.saveState(buffer.data(), buffer.size()));
+}
+
+void TestState::testState_code(void)
+{
+    // The predecoded instructions are dropped when a state with different
+    // code is restored
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.setPredecode(true);
+    chip8.setInstructionInMemory(0x200, 0x6001);
+    const std::vector<unsigned char> saved = chip8.saveState();
+
+    chip8.setInstructionInMemory(0x200, 0x6002);
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.loadState(saved.data(), saved.size()));
+    CPPUNIT_ASSERT_EQUAL(Ok, chip8.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x01),
+                         chip8.getRegister(0));
+}
+
+void TestState::testState_quirks(void)
+{
+    // The quirk set is restored with the state, so that the instructions
+    // that differ between platforms run as they did when it was saved
+    Chip8 chip8;
+    chip8.setLogging(false);
+    chip8.initialize();
+    chip8.setQuirks(COSMAC_QUIRKS);
+    chip8.setPredecode(true);
+    chip8.setInstructionInMemory(0x200, 0x801e);
+    const std::vector<unsigned char> saved = chip8.saveState();
+
+    Chip8 restored;
+    restored.setLogging(false);
+    restored.initialize();
+    restored.setPredecode(true);
+    restored.setInstructionInMemory(0x200, 0x801e);
+    CPPUNIT_ASSERT_EQUAL(Ok, restored.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(Ok, restored.loadState(saved.data(), saved.size()));
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(COSMAC_QUIRKS),
+                         restored.getQuirks());
+
+    // 8xyE shifts Vy into Vx with the COSMAC quirks
+    restored.setRegister(0x1, 0x81);
+    CPPUNIT_ASSERT_EQUAL(Ok, restored.executeCycle());
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned char>(0x02),
+                         restored.getRegister(0));
+}